@@ -0,0 +1,58 @@
+/*
+ * lucihttp - HTTP utility library - memory budget component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __BUDGET_H
+#define __BUDGET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+struct lh_budget
+{
+	size_t limit;
+	size_t used;
+};
+
+
+struct lh_budget *
+lh_budget_new(size_t);
+
+void
+lh_budget_set_limit(struct lh_budget *, size_t);
+
+bool
+lh_budget_acquire(struct lh_budget *, size_t);
+
+void
+lh_budget_release(struct lh_budget *, size_t);
+
+size_t
+lh_budget_used(struct lh_budget *);
+
+void
+lh_budget_set_default(struct lh_budget *);
+
+struct lh_budget *
+lh_budget_default(void);
+
+void
+lh_budget_free(struct lh_budget *);
+
+
+#endif /* __BUDGET_H */
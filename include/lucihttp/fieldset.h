@@ -0,0 +1,53 @@
+/*
+ * lucihttp - HTTP utility library - field name set component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __FIELDSET_H
+#define __FIELDSET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+struct lh_fieldset_slot
+{
+	const char *name;
+	size_t len;
+};
+
+struct lh_fieldset
+{
+	uint32_t seed;
+	size_t mask;
+	bool probing;
+	struct lh_fieldset_slot *slots;
+	char *names;
+};
+
+
+struct lh_fieldset *
+lh_fieldset_new(const char * const *, size_t);
+
+bool
+lh_fieldset_match(const struct lh_fieldset *, const char *, size_t);
+
+void
+lh_fieldset_free(struct lh_fieldset *);
+
+
+#endif /* __FIELDSET_H */
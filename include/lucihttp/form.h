@@ -0,0 +1,186 @@
+/*
+ * lucihttp - HTTP utility library - form snapshot component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __FORM_H
+#define __FORM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define LH_FORM_MAGIC 0x6c68666d /* "lhfm" */
+#define LH_FORM_VERSION 1
+
+enum lh_form_type {
+	LH_FORM_FIELD = 0,
+	LH_FORM_FILE
+};
+
+/*
+ * The snapshot is a single contiguous buffer in host byte order, starting
+ * with a header followed by count records. Each record consists of a fixed
+ * size record header, followed by the NUL terminated name, value and path
+ * strings and is padded to a multiple of 8 bytes, the record length includes
+ * the header, strings and padding.
+ *
+ * For fields, the value holds the field value and size its length. For file
+ * parts, the value holds the client supplied file name, path the location
+ * the data has been stored to, if any, and size the amount of data.
+ */
+
+struct lh_form_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t length;
+};
+
+struct lh_form_record
+{
+	uint32_t length;
+	uint32_t type;
+	uint32_t namelen;
+	uint32_t valuelen;
+	uint32_t pathlen;
+	uint32_t reserved;
+	uint64_t size;
+};
+
+struct lh_form_field
+{
+	enum lh_form_type type;
+	const char *name;
+	size_t namelen;
+	const char *value;
+	size_t valuelen;
+	const char *path;
+	size_t pathlen;
+	uint64_t size;
+	size_t next;
+	size_t dup;
+};
+
+/*
+ * The in-memory name index of a form is an open addressing hash table of
+ * slots, one per distinct name, each referring to a list of entries for the
+ * records carrying that name in snapshot order. Entry references are stored
+ * as index + 1, zero denotes none.
+ */
+
+struct lh_form_slot
+{
+	uint32_t hash;
+	uint32_t first;
+	uint32_t last;
+	uint32_t count;
+};
+
+struct lh_form_entry
+{
+	uint32_t offset;
+	uint32_t next;
+};
+
+struct lh_budget;
+
+struct lh_form
+{
+	char *data;
+	size_t len;
+	size_t size;
+	size_t record;
+	char *name;
+	char *filename;
+	char *path;
+	bool pending;
+	bool readonly;
+	bool failed;
+	bool exhausted;
+	bool unindexed;
+	struct lh_form_slot *slots;
+	size_t nslots;
+	size_t nnames;
+	struct lh_form_entry *entries;
+	size_t nentries;
+	size_t entries_size;
+	size_t indexed;
+	struct lh_budget *budget;
+	size_t reserved;
+};
+
+
+struct lh_form *
+lh_form_new(void);
+
+struct lh_form *
+lh_form_load(const void *, size_t);
+
+bool
+lh_form_set_budget(struct lh_form *, struct lh_budget *);
+
+bool
+lh_form_add(struct lh_form *, enum lh_form_type, const char *, size_t,
+            const char *, size_t, uint64_t);
+
+bool
+lh_form_add_encoded(struct lh_form *, enum lh_form_type, const char *, size_t,
+                    const char *, size_t);
+
+void
+lh_form_part_begin(struct lh_form *);
+
+void
+lh_form_part_disposition(struct lh_form *, const char *, size_t);
+
+void
+lh_form_part_data(struct lh_form *, bool, const char *, size_t);
+
+void
+lh_form_part_end(struct lh_form *, bool);
+
+bool
+lh_form_set_path(struct lh_form *, const char *);
+
+const char *
+lh_form_finish(struct lh_form *, size_t *);
+
+int
+lh_form_memfd(struct lh_form *);
+
+bool
+lh_form_next(struct lh_form *, struct lh_form_field *);
+
+bool
+lh_form_get(struct lh_form *, const char *, struct lh_form_field *);
+
+bool
+lh_form_lookup(struct lh_form *, const char *, size_t, struct lh_form_field *);
+
+bool
+lh_form_get_next(struct lh_form *, struct lh_form_field *);
+
+size_t
+lh_form_count(struct lh_form *, const char *, size_t);
+
+void
+lh_form_free(struct lh_form *);
+
+
+#endif /* __FORM_H */
@@ -0,0 +1,68 @@
+/*
+ * lucihttp - HTTP utility library - incremental inflate component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __INFLATE_H
+#define __INFLATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <zlib.h>
+
+
+#define LH_INFLATE_WINDOW_SIZE 16384
+
+enum lh_inflate_flag {
+	LH_INFLATE_F_INIT = (1 << 0),
+	LH_INFLATE_F_GZIP = (1 << 1),
+	LH_INFLATE_F_END  = (1 << 2)
+};
+
+typedef bool (*lh_inflate_callback)(const char *, size_t, void *);
+
+struct lh_inflate
+{
+	z_stream zs;
+	unsigned int flags;
+	unsigned char head[2];
+	size_t headlen;
+	char *window;
+	size_t size;
+	size_t limit;
+	size_t total;
+	const char *error;
+};
+
+
+struct lh_inflate *
+lh_inflate_new(size_t);
+
+bool
+lh_inflate_supported(const char *);
+
+void
+lh_inflate_set_limit(struct lh_inflate *, size_t);
+
+bool
+lh_inflate_parse(struct lh_inflate *, const char *, size_t,
+                 lh_inflate_callback, void *);
+
+void
+lh_inflate_free(struct lh_inflate *);
+
+
+#endif /* __INFLATE_H */
@@ -0,0 +1,92 @@
+/*
+ * lucihttp - HTTP utility library - non-blocking ingest adapter
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __INGEST_H
+#define __INGEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+#define LH_INGEST_BUFFER_SIZE 65536
+
+enum lh_ingest_status {
+	LH_INGEST_AGAIN = 0,
+	LH_INGEST_PAUSED,
+	LH_INGEST_DONE,
+	LH_INGEST_ERROR
+};
+
+enum lh_ingest_flag {
+	LH_INGEST_F_CLOSE      = (1 << 0),
+	LH_INGEST_F_LENGTH     = (1 << 1),
+	LH_INGEST_F_REGISTERED = (1 << 2),
+	LH_INGEST_F_PAUSED     = (1 << 3),
+	LH_INGEST_F_DONE       = (1 << 4)
+};
+
+struct lh_ingest;
+struct lh_ring;
+struct lh_mpart;
+struct lh_urldec;
+
+typedef bool (*lh_ingest_parse_fn)(struct lh_ingest *, bool);
+
+struct lh_ingest
+{
+	int fd;
+	int epfd;
+	void *data;
+	unsigned int flags;
+	size_t remaining;
+	int error;
+	struct lh_ring *ring;
+	lh_ingest_parse_fn parse;
+	void *parser;
+};
+
+
+struct lh_ingest *
+lh_ingest_new(int, bool, size_t);
+
+void
+lh_ingest_set_mpart(struct lh_ingest *, struct lh_mpart *);
+
+void
+lh_ingest_set_urldec(struct lh_ingest *, struct lh_urldec *);
+
+void
+lh_ingest_set_length(struct lh_ingest *, size_t);
+
+bool
+lh_ingest_register(struct lh_ingest *, int, void *);
+
+enum lh_ingest_status
+lh_ingest_handle(struct lh_ingest *);
+
+bool
+lh_ingest_pause(struct lh_ingest *);
+
+bool
+lh_ingest_resume(struct lh_ingest *);
+
+void
+lh_ingest_free(struct lh_ingest *);
+
+
+#endif /* __INGEST_H */
@@ -26,6 +26,7 @@
 #define LUCIHTTP_META "lucihttp"
 #define LUCIHTTP_MPART_META LUCIHTTP_META ".multipart"
 #define LUCIHTTP_URLDEC_META LUCIHTTP_META ".urlencoded"
+#define LUCIHTTP_UNTAR_META LUCIHTTP_META ".untar"
 
 LUALIB_API int luaopen_lucihttp(lua_State *L);
 
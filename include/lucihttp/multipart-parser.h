@@ -22,8 +22,11 @@
 #include <stdio.h>
 #include <stdbool.h>
 
+#include <lucihttp/utils.h>
+
 
 #define LH_MP_T_DEFAULT_SIZE_LIMIT 4096
+#define LH_MP_DEFAULT_INFLATE_LIMIT (16 * 1024 * 1024)
 
 enum lh_mpart_state {
 	LH_MP_S_START = 0,
@@ -52,6 +55,7 @@ enum lh_mpart_token_type {
 	LH_MP_T_BOUNDARY1,
 	LH_MP_T_BOUNDARY2,
 	LH_MP_T_BOUNDARY3,
+	LH_MP_T_DECODED,
 	__LH_MP_T_COUNT
 };
 
@@ -60,7 +64,11 @@ enum lh_mpart_flag {
 	LH_MP_F_IN_PART   = (1 << 1),
 	LH_MP_F_PAST_NAME = (1 << 2),
 	LH_MP_F_MULTILINE = (1 << 3),
-	LH_MP_F_BUFFERING = (1 << 4)
+	LH_MP_F_BUFFERING = (1 << 4),
+	LH_MP_F_LENGTH    = (1 << 5),
+	LH_MP_F_BUDGET    = (1 << 6),
+	LH_MP_F_SKIP      = (1 << 7),
+	LH_MP_F_BASE64    = (1 << 8)
 };
 
 enum lh_mpart_callback_type {
@@ -77,6 +85,13 @@ enum lh_mpart_callback_type {
 };
 
 struct lh_mpart;
+struct lh_ring;
+struct lh_progress;
+struct lh_tee;
+struct lh_inflate;
+struct lh_form;
+struct lh_budget;
+struct lh_fieldset;
 
 typedef bool (*lh_mpart_callback)(struct lh_mpart *,
                                   enum lh_mpart_callback_type,
@@ -98,11 +113,25 @@ struct lh_mpart
 	size_t offset;
 	size_t total;
 	size_t size_limit;
+	size_t chunk_size;
+	size_t body_limit;
+	size_t inflate_limit;
+	size_t content_length;
+	size_t received;
 	char *error;
 	int nesting;
 	unsigned int flags;
 	struct lh_mpart_token token[__LH_MP_T_COUNT];
 	FILE *trace;
+	struct lh_progress *progress;
+	struct lh_tee *tee;
+	struct lh_inflate *inflate;
+	struct lh_form *form;
+	struct lh_budget *budget;
+	size_t reserved;
+	struct lh_fieldset *fields;
+	bool transfer_decoding;
+	struct lh_base64 base64;
 	lh_mpart_callback cb;
 	void *priv;
 };
@@ -120,12 +149,48 @@ lh_mpart_set_callback(struct lh_mpart *, lh_mpart_callback, void *);
 void
 lh_mpart_set_size_limit(struct lh_mpart *, size_t);
 
+void
+lh_mpart_set_chunk_size(struct lh_mpart *, size_t);
+
+void
+lh_mpart_set_progress(struct lh_mpart *, struct lh_progress *);
+
+void
+lh_mpart_set_tee(struct lh_mpart *, struct lh_tee *);
+
+void
+lh_mpart_set_form(struct lh_mpart *, struct lh_form *);
+
+bool
+lh_mpart_set_budget(struct lh_mpart *, struct lh_budget *);
+
+void
+lh_mpart_set_fields(struct lh_mpart *, struct lh_fieldset *);
+
+void
+lh_mpart_set_body_limit(struct lh_mpart *, size_t);
+
+void
+lh_mpart_set_inflate_limit(struct lh_mpart *, size_t);
+
+bool
+lh_mpart_set_content_length(struct lh_mpart *, size_t);
+
+bool
+lh_mpart_set_content_encoding(struct lh_mpart *, const char *);
+
+void
+lh_mpart_set_transfer_decoding(struct lh_mpart *, bool);
+
 char *
 lh_mpart_parse_boundary(struct lh_mpart *, const char *, size_t *);
 
 bool
 lh_mpart_parse(struct lh_mpart *, const char *, size_t);
 
+bool
+lh_mpart_parse_ring(struct lh_mpart *, struct lh_ring *, bool);
+
 void
 lh_mpart_free(struct lh_mpart *);
 
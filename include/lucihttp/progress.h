@@ -0,0 +1,91 @@
+/*
+ * lucihttp - HTTP utility library - upload progress component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __PROGRESS_H
+#define __PROGRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define LH_PROGRESS_MAGIC 0x6c687072 /* "lhpr" */
+#define LH_PROGRESS_NAME_SIZE 128
+#define LH_PROGRESS_DEFAULT_INTERVAL 65536
+
+enum lh_progress_status {
+	LH_PROGRESS_RUNNING = 0,
+	LH_PROGRESS_DONE,
+	LH_PROGRESS_FAILED
+};
+
+struct lh_progress_shm
+{
+	uint32_t magic;
+	uint32_t seq;
+	uint64_t bytes;
+	uint64_t total;
+	uint32_t part;
+	uint32_t status;
+	char name[LH_PROGRESS_NAME_SIZE];
+};
+
+struct lh_progress_info
+{
+	uint64_t bytes;
+	uint64_t total;
+	uint32_t part;
+	enum lh_progress_status status;
+	char name[LH_PROGRESS_NAME_SIZE];
+};
+
+struct lh_progress
+{
+	struct lh_progress_shm *shm;
+	size_t interval;
+	size_t last;
+	bool writable;
+};
+
+
+struct lh_progress *
+lh_progress_open(const char *, size_t);
+
+struct lh_progress *
+lh_progress_attach(const char *);
+
+void
+lh_progress_update(struct lh_progress *, size_t, size_t);
+
+void
+lh_progress_next_part(struct lh_progress *);
+
+void
+lh_progress_set_name(struct lh_progress *, const char *, size_t);
+
+void
+lh_progress_finish(struct lh_progress *, size_t, bool);
+
+bool
+lh_progress_read(struct lh_progress *, struct lh_progress_info *);
+
+void
+lh_progress_close(struct lh_progress *);
+
+
+#endif /* __PROGRESS_H */
@@ -0,0 +1,57 @@
+/*
+ * lucihttp - HTTP utility library - mirrored ring buffer component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __RING_BUFFER_H
+#define __RING_BUFFER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+
+struct lh_ring
+{
+	char *base;
+	size_t size;
+	size_t head;
+	size_t tail;
+};
+
+
+struct lh_ring *
+lh_ring_new(size_t);
+
+char *
+lh_ring_write_ptr(struct lh_ring *, size_t *);
+
+void
+lh_ring_commit(struct lh_ring *, size_t);
+
+const char *
+lh_ring_read_ptr(struct lh_ring *, size_t *);
+
+void
+lh_ring_consume(struct lh_ring *, size_t);
+
+ssize_t
+lh_ring_read_fd(struct lh_ring *, int);
+
+void
+lh_ring_free(struct lh_ring *);
+
+
+#endif /* __RING_BUFFER_H */
@@ -0,0 +1,59 @@
+/*
+ * lucihttp - HTTP utility library - raw body tee component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __TEE_H
+#define __TEE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+
+#define LH_TEE_BUFFER_SIZE 16384
+
+struct lh_tee
+{
+	int fd;
+	int pipe[2];
+	bool close;
+	char *buf;
+	size_t len;
+	size_t pending;
+};
+
+
+struct lh_tee *
+lh_tee_new(int, bool);
+
+struct lh_tee *
+lh_tee_open(const char *);
+
+bool
+lh_tee_write(struct lh_tee *, const char *, size_t);
+
+ssize_t
+lh_tee_read(struct lh_tee *, int, char *, size_t);
+
+bool
+lh_tee_flush(struct lh_tee *);
+
+void
+lh_tee_free(struct lh_tee *);
+
+
+#endif /* __TEE_H */
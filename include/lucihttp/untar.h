@@ -0,0 +1,118 @@
+/*
+ * lucihttp - HTTP utility library - streaming tar extraction component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __UNTAR_H
+#define __UNTAR_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define LH_UT_BLOCK_SIZE 512
+#define LH_UT_META_SIZE_LIMIT 4096
+
+enum lh_untar_state {
+	LH_UT_S_START = 0,
+	LH_UT_S_HEADER,
+	LH_UT_S_META,
+	LH_UT_S_DATA,
+	LH_UT_S_PADDING,
+	LH_UT_S_END,
+	LH_UT_S_ERROR
+};
+
+enum lh_untar_member_type {
+	LH_UT_M_FILE = 0,
+	LH_UT_M_DIRECTORY,
+	LH_UT_M_SYMLINK,
+	LH_UT_M_HARDLINK,
+	LH_UT_M_OTHER
+};
+
+enum lh_untar_flag {
+	LH_UT_F_LONGNAME  = (1 << 0),
+	LH_UT_F_LONGLINK  = (1 << 1),
+	LH_UT_F_ZEROBLOCK = (1 << 2),
+	LH_UT_F_SKIP      = (1 << 3)
+};
+
+enum lh_untar_callback_type {
+	LH_UT_CB_MEMBER_BEGIN,
+	LH_UT_CB_MEMBER_DATA,
+	LH_UT_CB_MEMBER_END,
+	LH_UT_CB_EOF,
+	LH_UT_CB_ERROR
+};
+
+struct lh_untar;
+struct lh_inflate;
+
+typedef bool (*lh_untar_callback)(struct lh_untar *,
+                                  enum lh_untar_callback_type,
+                                  const char *, size_t, void *);
+
+struct lh_untar_member
+{
+	enum lh_untar_member_type type;
+	char *name;
+	char *linkname;
+	uint32_t mode;
+	uint64_t size;
+	int64_t mtime;
+};
+
+struct lh_untar
+{
+	enum lh_untar_state state;
+	size_t total;
+	char *error;
+	unsigned int flags;
+	struct lh_inflate *inflate;
+	char block[LH_UT_BLOCK_SIZE];
+	size_t blocklen;
+	char *meta;
+	size_t metalen;
+	char meta_type;
+	uint64_t remain;
+	struct lh_untar_member member;
+	int dirfd;
+	int fd;
+	FILE *trace;
+	lh_untar_callback cb;
+	void *priv;
+};
+
+
+struct lh_untar *
+lh_untar_new(FILE *);
+
+void
+lh_untar_set_callback(struct lh_untar *, lh_untar_callback, void *);
+
+bool
+lh_untar_set_directory(struct lh_untar *, const char *);
+
+bool
+lh_untar_parse(struct lh_untar *, const char *, size_t);
+
+void
+lh_untar_free(struct lh_untar *);
+
+
+#endif /* __UNTAR_H */
@@ -24,6 +24,7 @@
 
 
 #define LH_UD_T_DEFAULT_SIZE_LIMIT 4096
+#define LH_UD_DEFAULT_INFLATE_LIMIT (1024 * 1024)
 
 enum lh_urldec_state {
 	LH_UD_S_NAME_START = 0,
@@ -43,7 +44,16 @@ enum lh_urldec_token_type {
 enum lh_urldec_flag {
 	LH_UD_F_GOT_NAME  = (1 << 0),
 	LH_UD_F_GOT_VALUE = (1 << 1),
-	LH_UD_F_BUFFERING = (1 << 2)
+	LH_UD_F_BUFFERING = (1 << 2),
+	LH_UD_F_LENGTH    = (1 << 3),
+	LH_UD_F_BUDGET    = (1 << 4),
+	LH_UD_F_DECODE    = (1 << 5),
+	LH_UD_F_SPANS     = (1 << 6),
+	LH_UD_F_IN_SPAN   = (1 << 7),
+	LH_UD_F_SKIP      = (1 << 8),
+	LH_UD_F_PATHS     = (1 << 9),
+	LH_UD_F_BATCH     = (1 << 10),
+	LH_UD_F_OVERFLOW  = (1 << 11)
 };
 
 enum lh_urldec_callback_type {
@@ -51,10 +61,16 @@ enum lh_urldec_callback_type {
 	LH_UD_CB_NAME,
 	LH_UD_CB_VALUE,
 	LH_UD_CB_EOF,
-	LH_UD_CB_ERROR
+	LH_UD_CB_ERROR,
+	LH_UD_CB_SEGMENT
 };
 
 struct lh_urldec;
+struct lh_tee;
+struct lh_inflate;
+struct lh_form;
+struct lh_budget;
+struct lh_fieldset;
 
 typedef bool (*lh_urldec_callback)(struct lh_urldec *,
                                    enum lh_urldec_callback_type,
@@ -67,16 +83,50 @@ struct lh_urldec_token
 	size_t len;
 };
 
+/*
+ * A tuple stored by lh_urldec_parse_tuples(), names and values are not NUL
+ * terminated and point either into the parsed input buffer or into the
+ * batch storage of the parser.
+ */
+
+struct lh_urldec_tuple
+{
+	const char *name;
+	size_t namelen;
+	const char *value;
+	size_t valuelen;
+};
+
 struct lh_urldec
 {
 	enum lh_urldec_state state;
 	size_t offset;
 	size_t total;
 	size_t size_limit;
+	size_t body_limit;
+	size_t inflate_limit;
+	size_t content_length;
+	size_t received;
 	char *error;
 	unsigned int flags;
 	struct lh_urldec_token token[__LH_UD_T_COUNT];
+	char escape[3];
+	size_t escape_len;
+	size_t span_offset;
+	size_t span_len;
 	FILE *trace;
+	struct lh_tee *tee;
+	struct lh_inflate *inflate;
+	struct lh_form *form;
+	struct lh_budget *budget;
+	size_t reserved;
+	struct lh_fieldset *fields;
+	struct lh_urldec_tuple *batch;
+	size_t batch_count;
+	size_t batch_max;
+	char *arena;
+	size_t arena_size;
+	size_t arena_len;
 	lh_urldec_callback cb;
 	void *priv;
 };
@@ -94,11 +144,51 @@ lh_urldec_set_callback(struct lh_urldec *, lh_urldec_callback, void *);
 void
 lh_urldec_set_size_limit(struct lh_urldec *, size_t);
 
+void
+lh_urldec_set_body_limit(struct lh_urldec *, size_t);
+
+void
+lh_urldec_set_inflate_limit(struct lh_urldec *, size_t);
+
+bool
+lh_urldec_set_content_length(struct lh_urldec *, size_t);
+
+bool
+lh_urldec_set_content_encoding(struct lh_urldec *, const char *);
+
+void
+lh_urldec_set_tee(struct lh_urldec *, struct lh_tee *);
+
+void
+lh_urldec_set_form(struct lh_urldec *, struct lh_form *);
+
+void
+lh_urldec_set_decode(struct lh_urldec *, bool);
+
+void
+lh_urldec_set_spans(struct lh_urldec *, bool);
+
+void
+lh_urldec_set_fields(struct lh_urldec *, struct lh_fieldset *);
+
+void
+lh_urldec_set_paths(struct lh_urldec *, bool);
+
+bool
+lh_urldec_set_budget(struct lh_urldec *, struct lh_budget *);
+
 bool
 lh_urldec_parse(struct lh_urldec *, const char *, size_t);
 
+size_t
+lh_urldec_parse_tuples(struct lh_urldec *, const char *, size_t,
+                       struct lh_urldec_tuple *, size_t);
+
 void
 lh_urldec_free(struct lh_urldec *);
 
+bool
+lh_urldec_path_next(const char *, size_t, size_t *, const char **, size_t *);
+
 
 #endif /* __URLDECODED_PARSER_H */
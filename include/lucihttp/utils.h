@@ -20,6 +20,8 @@
 #define __UTILS_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 enum lh_urlencode_flags {
 	LH_URLENCODE_FULL       = (1 << 0),
@@ -34,9 +36,57 @@ enum lh_urldecode_flags {
 	LH_URLDECODE_PLUS       = (1 << 3)
 };
 
+enum lh_base64_flags {
+	LH_BASE64_URL           = (1 << 0),
+	LH_BASE64_NO_PAD        = (1 << 1)
+};
+
+/* upper bounds for the output of one update call, or a whole run */
+#define LH_BASE64_ENCODED_SIZE(n) ((((n) + 2) / 3) * 4)
+#define LH_BASE64_DECODED_SIZE(n) ((((n) + 3) / 4) * 3)
+
+struct lh_base64 {
+	uint32_t bits;
+	unsigned int count;
+	unsigned int pad;
+	unsigned int flags;
+};
+
+struct lh_header_param {
+	const char *name;
+	size_t namelen;
+	const char *value;
+	size_t valuelen;
+};
+
 char *lh_urlencode(const char *, size_t, size_t *, unsigned int);
 char *lh_urldecode(const char *, size_t, size_t *, unsigned int);
 
+ssize_t lh_urlencode_into(const char *, size_t, char *, size_t, unsigned int);
+ssize_t lh_urldecode_into(const char *, size_t, char *, size_t, unsigned int);
+ssize_t lh_urldecode_inplace(char *, size_t, unsigned int);
+
 char *lh_header_attribute(const char *, size_t, const char *, size_t *);
+ssize_t lh_header_attribute_into(const char *, size_t, const char *,
+                                 char *, size_t);
+
+size_t lh_header_params(const char *, size_t, struct lh_header_param *,
+                        size_t);
+const struct lh_header_param *lh_header_param_get(
+	const struct lh_header_param *, size_t, const char *);
+size_t lh_header_param_value(const struct lh_header_param *, char *, size_t);
+
+ssize_t lh_query_get(const char *, size_t, const char *, char *, size_t);
+
+char *lh_base64_encode(const char *, size_t, size_t *, unsigned int);
+char *lh_base64_decode(const char *, size_t, size_t *, unsigned int);
+
+void lh_base64_init(struct lh_base64 *, unsigned int);
+size_t lh_base64_encode_update(struct lh_base64 *, const char *, size_t,
+                               char *);
+size_t lh_base64_encode_final(struct lh_base64 *, char *);
+ssize_t lh_base64_decode_update(struct lh_base64 *, const char *, size_t,
+                                char *);
+ssize_t lh_base64_decode_final(struct lh_base64 *, char *);
 
 #endif /* __UTILS_H */
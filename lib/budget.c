@@ -0,0 +1,127 @@
+/*
+ * lucihttp - HTTP utility library - memory budget component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <lucihttp/budget.h>
+
+#include <stdlib.h>
+#include <errno.h>
+
+
+static struct lh_budget *lh_budget_global;
+
+/*
+ * Allocate a memory budget of the given amount of bytes, a limit of zero
+ * allows unlimited usage while still accounting it. A budget may be shared
+ * by any number of parsers, also across threads, and must outlive them.
+ *
+ * Returns NULL if memory cannot be allocated.
+ */
+
+struct lh_budget *
+lh_budget_new(size_t limit)
+{
+	struct lh_budget *b;
+
+	b = calloc(1, sizeof(*b));
+
+	if (!b)
+		return NULL;
+
+	b->limit = limit;
+
+	return b;
+}
+
+/*
+ * Change the limit of the budget. Lowering the limit below the currently
+ * used amount does not revoke existing allocations but fails all further
+ * ones until enough memory has been released.
+ */
+
+void
+lh_budget_set_limit(struct lh_budget *b, size_t limit)
+{
+	__atomic_store_n(&b->limit, limit, __ATOMIC_RELAXED);
+}
+
+/*
+ * Draw the given amount of bytes from the budget.
+ *
+ * Returns false and sets errno to ENOBUFS if the budget is exhausted.
+ */
+
+bool
+lh_budget_acquire(struct lh_budget *b, size_t len)
+{
+	size_t limit = __atomic_load_n(&b->limit, __ATOMIC_RELAXED);
+	size_t used = __atomic_load_n(&b->used, __ATOMIC_RELAXED);
+
+	do {
+		if (limit && (used > limit || len > limit - used)) {
+			errno = ENOBUFS;
+
+			return false;
+		}
+	} while (!__atomic_compare_exchange_n(&b->used, &used, used + len, true,
+	                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	return true;
+}
+
+/*
+ * Return the given amount of bytes to the budget.
+ */
+
+void
+lh_budget_release(struct lh_budget *b, size_t len)
+{
+	__atomic_sub_fetch(&b->used, len, __ATOMIC_RELAXED);
+}
+
+size_t
+lh_budget_used(struct lh_budget *b)
+{
+	return __atomic_load_n(&b->used, __ATOMIC_RELAXED);
+}
+
+/*
+ * Set the process wide budget which newly created parsers draw from unless
+ * they are assigned a different one. Pass NULL to disable accounting for
+ * subsequently created parsers.
+ */
+
+void
+lh_budget_set_default(struct lh_budget *b)
+{
+	__atomic_store_n(&lh_budget_global, b, __ATOMIC_RELEASE);
+}
+
+struct lh_budget *
+lh_budget_default(void)
+{
+	return __atomic_load_n(&lh_budget_global, __ATOMIC_ACQUIRE);
+}
+
+void
+lh_budget_free(struct lh_budget *b)
+{
+	if (lh_budget_default() == b)
+		lh_budget_set_default(NULL);
+
+	free(b);
+}
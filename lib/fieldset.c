@@ -0,0 +1,192 @@
+/*
+ * lucihttp - HTTP utility library - field name set component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <lucihttp/fieldset.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+
+static uint32_t
+lh_fieldset_hash(uint32_t seed, const char *name, size_t len)
+{
+	uint32_t h = 0x811c9dc5 ^ seed;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)name[i];
+		h *= 0x01000193;
+	}
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return h;
+}
+
+/*
+ * Place all names into the table using the current seed. Without probing,
+ * fail if two names end up in the same slot.
+ */
+static bool
+lh_fieldset_place(struct lh_fieldset *s, const char * const *names,
+                  const size_t *lens, size_t count)
+{
+	struct lh_fieldset_slot *slot;
+	const char *name;
+	size_t i, j;
+
+	memset(s->slots, 0, (s->mask + 1) * sizeof(*s->slots));
+
+	for (i = 0, name = s->names; i < count; name += lens[i++] + 1) {
+		j = lh_fieldset_hash(s->seed, names[i], lens[i]) & s->mask;
+
+		for (slot = &s->slots[j]; slot->name; slot = &s->slots[j]) {
+			/* tolerate duplicate names */
+			if (slot->len == lens[i] && !memcmp(slot->name, names[i], lens[i]))
+				break;
+
+			if (!s->probing)
+				return false;
+
+			j = (j + 1) & s->mask;
+		}
+
+		slot->name = name;
+		slot->len = lens[i];
+	}
+
+	return true;
+}
+
+/*
+ * Compile the given list of field names into a set for the parsers to match
+ * field names against. The names are placed into a collision free hash
+ * table if one of reasonable size can be found, so that matching a name
+ * costs one hash and at most one comparison. Larger sets fall back to
+ * linear probing.
+ *
+ * Returns NULL and sets errno if memory cannot be allocated.
+ */
+
+struct lh_fieldset *
+lh_fieldset_new(const char * const *names, size_t count)
+{
+	struct lh_fieldset *s;
+	size_t i, size, total;
+	size_t *lens;
+	char *p;
+
+	s = calloc(1, sizeof(*s));
+	lens = calloc(count ? count : 1, sizeof(*lens));
+
+	if (!s || !lens)
+		goto err;
+
+	for (i = 0, total = 0; i < count; i++) {
+		lens[i] = strlen(names[i]);
+		total += lens[i] + 1;
+	}
+
+	s->names = malloc(total ? total : 1);
+
+	if (!s->names)
+		goto err;
+
+	for (i = 0, p = s->names; i < count; p += lens[i++] + 1)
+		memcpy(p, names[i], lens[i] + 1);
+
+	for (size = 8; size < count * 2; size *= 2)
+		;
+
+	for (; ; size *= 2) {
+		free(s->slots);
+
+		s->mask = size - 1;
+		s->slots = calloc(size, sizeof(*s->slots));
+
+		if (!s->slots)
+			goto err;
+
+		for (s->seed = 0; s->seed < 64; s->seed++)
+			if (lh_fieldset_place(s, names, lens, count))
+				goto out;
+
+		if (size >= count * 8) {
+			s->probing = true;
+			lh_fieldset_place(s, names, lens, count);
+
+			goto out;
+		}
+	}
+
+out:
+	free(lens);
+
+	return s;
+
+err:
+	free(lens);
+
+	if (s) {
+		free(s->slots);
+		free(s->names);
+		free(s);
+	}
+
+	errno = ENOMEM;
+
+	return NULL;
+}
+
+/*
+ * Test whether the given field name is part of the set.
+ */
+
+bool
+lh_fieldset_match(const struct lh_fieldset *s, const char *name, size_t len)
+{
+	const struct lh_fieldset_slot *slot;
+	size_t i;
+
+	i = lh_fieldset_hash(s->seed, name, len) & s->mask;
+
+	for (slot = &s->slots[i]; slot->name; slot = &s->slots[i]) {
+		if (slot->len == len && !memcmp(slot->name, name, len))
+			return true;
+
+		if (!s->probing)
+			break;
+
+		i = (i + 1) & s->mask;
+	}
+
+	return false;
+}
+
+void
+lh_fieldset_free(struct lh_fieldset *s)
+{
+	free(s->slots);
+	free(s->names);
+	free(s);
+}
@@ -0,0 +1,989 @@
+/*
+ * lucihttp - HTTP utility library - form snapshot component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <lucihttp/form.h>
+#include <lucihttp/utils.h>
+#include <lucihttp/budget.h>
+
+#include <endian.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+
+
+#define LH_FORM_ALIGN(x) (((x) + 7) & ~(size_t)7)
+
+#define LH_FORM_PARAMS 8
+
+#define LH_FORM_INITIAL_SIZE 256
+
+#define ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND(v0, v1, v2, v3)                   \
+	do {                                           \
+		v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0;     \
+		v0 = ROTL(v0, 32);                         \
+		v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2;     \
+		v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0;     \
+		v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2;     \
+		v2 = ROTL(v2, 32);                         \
+	} while (0)
+
+/* per-process key of the name hash, protecting the index against flooding */
+static uint64_t lh_form_key[2];
+
+static void __attribute__((constructor))
+lh_form_key_init(void)
+{
+	struct timespec ts;
+
+	if (getrandom(lh_form_key, sizeof(lh_form_key), GRND_NONBLOCK) ==
+	    sizeof(lh_form_key))
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	lh_form_key[0] = ((uint64_t)ts.tv_sec << 32) ^ ts.tv_nsec ^ getpid();
+	lh_form_key[1] = (uintptr_t)&ts ^ ((uint64_t)getppid() << 40);
+}
+
+/* SipHash-1-3 of the given name */
+static uint32_t
+lh_form_hash(const char *name, size_t len)
+{
+	uint64_t v0 = lh_form_key[0] ^ 0x736f6d6570736575ULL;
+	uint64_t v1 = lh_form_key[1] ^ 0x646f72616e646f6dULL;
+	uint64_t v2 = lh_form_key[0] ^ 0x6c7967656e657261ULL;
+	uint64_t v3 = lh_form_key[1] ^ 0x7465646279746573ULL;
+	uint64_t m, b = (uint64_t)len << 56;
+	size_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		memcpy(&m, name + i, sizeof(m));
+		m = le64toh(m);
+
+		v3 ^= m;
+		SIPROUND(v0, v1, v2, v3);
+		v0 ^= m;
+	}
+
+	for (m = 0; i < len; i++)
+		m |= (uint64_t)(unsigned char)name[i] << (8 * (i & 7));
+
+	b |= m;
+
+	v3 ^= b;
+	SIPROUND(v0, v1, v2, v3);
+	v0 ^= b;
+
+	v2 ^= 0xff;
+	SIPROUND(v0, v1, v2, v3);
+	SIPROUND(v0, v1, v2, v3);
+	SIPROUND(v0, v1, v2, v3);
+
+	b = v0 ^ v1 ^ v2 ^ v3;
+
+	return (uint32_t)(b ^ (b >> 32));
+}
+
+static struct lh_form_header *
+lh_form_header(struct lh_form *f)
+{
+	return (struct lh_form_header *)f->data;
+}
+
+static struct lh_form_record *
+lh_form_record(struct lh_form *f, size_t off)
+{
+	return (struct lh_form_record *)(f->data + off);
+}
+
+static bool
+lh_form_charge(struct lh_form *f, size_t len)
+{
+	if (f->budget && !lh_budget_acquire(f->budget, len))
+		return false;
+
+	f->reserved += len;
+
+	return true;
+}
+
+static void
+lh_form_uncharge(struct lh_form *f, size_t len)
+{
+	if (f->budget)
+		lh_budget_release(f->budget, len);
+
+	f->reserved -= len;
+}
+
+static bool
+lh_form_reserve(struct lh_form *f, size_t len)
+{
+	size_t size = f->size;
+	char *tmp;
+
+	while (f->len + len > size)
+		size *= 2;
+
+	if (size != f->size) {
+		if (!lh_form_charge(f, size - f->size)) {
+			f->exhausted = true;
+			f->failed = true;
+
+			return false;
+		}
+
+		tmp = realloc(f->data, size);
+
+		if (!tmp) {
+			lh_form_uncharge(f, size - f->size);
+			f->failed = true;
+
+			return false;
+		}
+
+		f->data = tmp;
+		f->size = size;
+	}
+
+	return true;
+}
+
+static bool
+lh_form_put(struct lh_form *f, const char *buf, size_t len)
+{
+	if (!lh_form_reserve(f, len))
+		return false;
+
+	if (len)
+		memcpy(f->data + f->len, buf, len);
+
+	f->len += len;
+
+	return true;
+}
+
+/*
+ * Allocate an empty form snapshot. Fields and file parts are added to the
+ * snapshot by the parsers as they are encountered. The snapshot and its
+ * name index are drawn from the process wide default memory budget until
+ * the form is attached to a parser or given a budget of its own.
+ *
+ * Returns NULL if memory cannot be allocated.
+ */
+
+struct lh_form *
+lh_form_new(void)
+{
+	struct lh_form_header hdr = {
+		.magic = LH_FORM_MAGIC,
+		.version = LH_FORM_VERSION,
+		.length = sizeof(hdr)
+	};
+	struct lh_form *f;
+
+	f = calloc(1, sizeof(*f));
+
+	if (!f)
+		return NULL;
+
+	f->budget = lh_budget_default();
+
+	if (!lh_form_charge(f, LH_FORM_INITIAL_SIZE)) {
+		free(f);
+
+		return NULL;
+	}
+
+	f->size = LH_FORM_INITIAL_SIZE;
+	f->data = malloc(f->size);
+
+	if (!f->data) {
+		lh_form_uncharge(f, f->size);
+		free(f);
+
+		return NULL;
+	}
+
+	lh_form_put(f, (const char *)&hdr, sizeof(hdr));
+
+	return f;
+}
+
+/*
+ * Wrap an existing snapshot, e.g. one mapped from a file descriptor passed
+ * by another process, for lookups. The data is validated but not copied and
+ * must stay valid and unchanged until the form is freed.
+ *
+ * Returns NULL and sets errno if the data is not a valid snapshot.
+ */
+
+struct lh_form *
+lh_form_load(const void *data, size_t len)
+{
+	const struct lh_form_header *hdr = data;
+	const struct lh_form_record *rec;
+	const char *s = data;
+	struct lh_form *f;
+	size_t off, n, i;
+
+	if (len < sizeof(*hdr) || ((uintptr_t)data & 7) ||
+	    hdr->magic != LH_FORM_MAGIC || hdr->version != LH_FORM_VERSION ||
+	    hdr->length < sizeof(*hdr) || hdr->length > len)
+		goto inval;
+
+	for (off = sizeof(*hdr), i = 0; off < hdr->length; off += rec->length, i++) {
+		rec = (const struct lh_form_record *)(s + off);
+
+		if (hdr->length - off < sizeof(*rec) || (rec->length & 7) ||
+		    rec->length > hdr->length - off || rec->length < sizeof(*rec))
+			goto inval;
+
+		n = (size_t)rec->namelen + rec->valuelen + rec->pathlen + 3;
+
+		if (n > rec->length - sizeof(*rec))
+			goto inval;
+
+		n = off + sizeof(*rec);
+
+		if (s[n + rec->namelen] ||
+		    s[n + rec->namelen + 1 + rec->valuelen] ||
+		    s[n + rec->namelen + 1 + rec->valuelen + 1 + rec->pathlen])
+			goto inval;
+	}
+
+	if (i != hdr->count)
+		goto inval;
+
+	f = calloc(1, sizeof(*f));
+
+	if (!f)
+		return NULL;
+
+	f->data = (char *)data;
+	f->len = hdr->length;
+	f->size = hdr->length;
+	f->readonly = true;
+
+	return f;
+
+inval:
+	errno = EINVAL;
+
+	return NULL;
+}
+
+/*
+ * Draw the snapshot and its name index from the given memory budget, NULL
+ * disables the accounting. Memory already held by the form is moved over to
+ * the new budget. Once the budget is exhausted, further fields are refused
+ * and the form is marked as failed and exhausted. The data of loaded
+ * snapshots is not accounted. The budget is not owned by the form.
+ *
+ * Returns false if the new budget cannot cover the memory already held.
+ */
+
+bool
+lh_form_set_budget(struct lh_form *f, struct lh_budget *b)
+{
+	if (b == f->budget)
+		return true;
+
+	if (b && !lh_budget_acquire(b, f->reserved))
+		return false;
+
+	if (f->budget)
+		lh_budget_release(f->budget, f->reserved);
+
+	f->budget = b;
+
+	return true;
+}
+
+static bool
+lh_form_open(struct lh_form *f, enum lh_form_type type,
+             const char *name, size_t namelen,
+             const char *value, size_t valuelen)
+{
+	struct lh_form_record rec = {
+		.type = type,
+		.namelen = namelen,
+		.valuelen = valuelen
+	};
+	size_t off = f->len;
+
+	if (f->readonly || f->failed ||
+	    !lh_form_reserve(f, sizeof(rec) + namelen + valuelen + 1))
+		return false;
+
+	lh_form_put(f, (const char *)&rec, sizeof(rec));
+	lh_form_put(f, name, namelen);
+	lh_form_put(f, "", 1);
+	lh_form_put(f, value, valuelen);
+
+	f->record = off;
+
+	return true;
+}
+
+static bool
+lh_form_close(struct lh_form *f, const char *path)
+{
+	size_t pathlen = path ? strlen(path) : 0;
+	struct lh_form_record *rec;
+	size_t pad;
+
+	pad = LH_FORM_ALIGN(f->len + pathlen + 2) - (f->len + pathlen + 2);
+
+	if (!lh_form_reserve(f, pathlen + 2 + pad))
+		return false;
+
+	lh_form_put(f, "", 1);
+	lh_form_put(f, path, pathlen);
+	lh_form_put(f, "\0\0\0\0\0\0\0\0", pad + 1);
+
+	rec = lh_form_record(f, f->record);
+	rec->pathlen = pathlen;
+	rec->length = f->len - f->record;
+
+	lh_form_header(f)->count++;
+	lh_form_header(f)->length = f->len;
+
+	f->record = 0;
+
+	return true;
+}
+
+/*
+ * Add a complete record to the snapshot.
+ *
+ * Returns false if memory cannot be allocated.
+ */
+
+bool
+lh_form_add(struct lh_form *f, enum lh_form_type type,
+            const char *name, size_t namelen,
+            const char *value, size_t valuelen, uint64_t size)
+{
+	if (!lh_form_open(f, type, name, namelen, value, valuelen))
+		return false;
+
+	lh_form_record(f, f->record)->size = size;
+
+	return lh_form_close(f, NULL);
+}
+
+/*
+ * Add a complete record whose name and value are still URL-encoded. Both
+ * are decoded in place within the snapshot, plus characters included, so
+ * no intermediate copies are needed. The size is the decoded value length.
+ *
+ * Returns false if memory cannot be allocated.
+ */
+
+bool
+lh_form_add_encoded(struct lh_form *f, enum lh_form_type type,
+                    const char *name, size_t namelen,
+                    const char *value, size_t valuelen)
+{
+	struct lh_form_record *rec;
+	char *s, *v;
+
+	if (!lh_form_open(f, type, name, namelen, value, valuelen))
+		return false;
+
+	rec = lh_form_record(f, f->record);
+	s = (char *)(rec + 1);
+	v = s + namelen + 1;
+
+	if (namelen)
+		namelen = lh_urldecode_inplace(s, namelen, LH_URLDECODE_PLUS);
+
+	if (valuelen)
+		valuelen = lh_urldecode_inplace(v, valuelen, LH_URLDECODE_PLUS);
+
+	s[namelen] = 0;
+	memmove(s + namelen + 1, v, valuelen);
+
+	rec->namelen = namelen;
+	rec->valuelen = valuelen;
+	rec->size = valuelen;
+
+	f->len = (s - f->data) + namelen + 1 + valuelen;
+
+	return lh_form_close(f, NULL);
+}
+
+static void
+lh_form_part_reset(struct lh_form *f)
+{
+	free(f->name);
+	free(f->filename);
+	free(f->path);
+
+	f->name = NULL;
+	f->filename = NULL;
+	f->path = NULL;
+	f->pending = false;
+}
+
+/*
+ * Start collecting a new multipart part. The record is added to the snapshot
+ * once the part data arrives, either as field if the part is buffered or as
+ * file part otherwise.
+ */
+
+void
+lh_form_part_begin(struct lh_form *f)
+{
+	if (f->record)
+		lh_form_close(f, f->path);
+
+	lh_form_part_reset(f);
+
+	f->pending = true;
+}
+
+static char *
+lh_form_param_dup(const struct lh_header_param *params, size_t count,
+                  const char *name)
+{
+	const struct lh_header_param *param;
+	char *s;
+
+	param = lh_header_param_get(params, count, name);
+
+	if (!param)
+		return NULL;
+
+	s = malloc(param->valuelen + 1);
+
+	if (s)
+		lh_header_param_value(param, s, param->valuelen + 1);
+
+	return s;
+}
+
+/*
+ * Record the field name and file name from the given Content-Disposition
+ * header value of the current part, tokenizing the header value only once.
+ */
+
+void
+lh_form_part_disposition(struct lh_form *f, const char *value, size_t len)
+{
+	struct lh_header_param params[LH_FORM_PARAMS];
+	size_t n;
+
+	if (!f->pending || f->record)
+		return;
+
+	free(f->name);
+	free(f->filename);
+
+	n = lh_header_params(value, len, params, LH_FORM_PARAMS);
+
+	/* a disposition with that many parameters is rather unusual */
+	if (n > LH_FORM_PARAMS) {
+		f->name = lh_header_attribute(value, len, "name", NULL);
+		f->filename = lh_header_attribute(value, len, "filename", NULL);
+
+		return;
+	}
+
+	f->name = lh_form_param_dup(params, n, "name");
+	f->filename = lh_form_param_dup(params, n, "filename");
+}
+
+static bool
+lh_form_part_open(struct lh_form *f, bool buffered)
+{
+	const char *value = buffered ? NULL : f->filename;
+
+	return lh_form_open(f, buffered ? LH_FORM_FIELD : LH_FORM_FILE,
+	                    f->name, f->name ? strlen(f->name) : 0,
+	                    value, value ? strlen(value) : 0);
+}
+
+/*
+ * Account data of the current part. The data of buffered parts is stored as
+ * field value, for other parts only the size is recorded.
+ */
+
+void
+lh_form_part_data(struct lh_form *f, bool buffered, const char *buf,
+                  size_t len)
+{
+	if (!f->pending || f->failed)
+		return;
+
+	if (!f->record && !lh_form_part_open(f, buffered))
+		return;
+
+	if (buffered) {
+		if (!lh_form_put(f, buf, len))
+			return;
+
+		lh_form_record(f, f->record)->valuelen += len;
+	}
+
+	lh_form_record(f, f->record)->size += len;
+}
+
+/*
+ * Finish the record of the current part.
+ */
+
+void
+lh_form_part_end(struct lh_form *f, bool buffered)
+{
+	if (!f->pending)
+		return;
+
+	if (f->record || lh_form_part_open(f, buffered))
+		lh_form_close(f, f->path);
+
+	lh_form_part_reset(f);
+}
+
+/*
+ * Record the location the data of the current file part is stored to.
+ *
+ * Returns false if no part is being collected or if memory cannot be
+ * allocated.
+ */
+
+bool
+lh_form_set_path(struct lh_form *f, const char *path)
+{
+	char *tmp;
+
+	if (!f->pending)
+		return false;
+
+	tmp = strdup(path);
+
+	if (!tmp)
+		return false;
+
+	free(f->path);
+	f->path = tmp;
+
+	return true;
+}
+
+/*
+ * Return the serialized snapshot and store its length in the given length
+ * pointer. A part which is still being collected is not included.
+ *
+ * Returns NULL and sets errno to ENOMEM if memory could not be allocated
+ * while collecting the snapshot, since it would be incomplete.
+ */
+
+const char *
+lh_form_finish(struct lh_form *f, size_t *len)
+{
+	const struct lh_form_header *hdr = lh_form_header(f);
+
+	if (f->failed) {
+		errno = ENOMEM;
+
+		return NULL;
+	}
+
+	if (len)
+		*len = hdr->length;
+
+	return f->data;
+}
+
+/*
+ * Copy the snapshot into a sealed memory file, suitable for passing to
+ * another process which maps it and wraps it with lh_form_load().
+ *
+ * Returns the file descriptor or -1 on error with errno set accordingly.
+ */
+
+int
+lh_form_memfd(struct lh_form *f)
+{
+	const char *data;
+	size_t len;
+	ssize_t rv;
+	int fd, err;
+
+	data = lh_form_finish(f, &len);
+
+	if (!data)
+		return -1;
+
+	fd = memfd_create("lucihttp-form", MFD_CLOEXEC|MFD_ALLOW_SEALING);
+
+	if (fd == -1)
+		return -1;
+
+	while (len > 0) {
+		rv = write(fd, data, len);
+
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+
+			goto err;
+		}
+
+		data += rv;
+		len -= rv;
+	}
+
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_WRITE|
+	                           F_SEAL_SEAL) == -1 ||
+	    lseek(fd, 0, SEEK_SET) == -1)
+		goto err;
+
+	return fd;
+
+err:
+	err = errno;
+	close(fd);
+	errno = err;
+
+	return -1;
+}
+
+static void
+lh_form_fill(struct lh_form *f, size_t off, struct lh_form_field *field)
+{
+	const struct lh_form_record *rec = lh_form_record(f, off);
+	const char *s = (const char *)(rec + 1);
+
+	field->type = rec->type;
+	field->name = s;
+	field->namelen = rec->namelen;
+	field->value = s + rec->namelen + 1;
+	field->valuelen = rec->valuelen;
+	field->path = rec->pathlen ? field->value + rec->valuelen + 1 : NULL;
+	field->pathlen = rec->pathlen;
+	field->size = rec->size;
+	field->next = off + rec->length;
+}
+
+/*
+ * Iterate the records of the snapshot. The field structure must be zeroed
+ * before the first invocation and is updated to describe the next record.
+ *
+ * Returns false if there are no more records.
+ */
+
+bool
+lh_form_next(struct lh_form *f, struct lh_form_field *field)
+{
+	size_t off = field->next ? field->next : sizeof(struct lh_form_header);
+
+	if (off >= lh_form_header(f)->length)
+		return false;
+
+	lh_form_fill(f, off, field);
+	field->dup = 0;
+
+	return true;
+}
+
+static bool
+lh_form_name_eq(struct lh_form *f, size_t off, const char *name, size_t len)
+{
+	const struct lh_form_record *rec = lh_form_record(f, off);
+
+	return (rec->namelen == len && !memcmp(rec + 1, name, len));
+}
+
+static struct lh_form_slot *
+lh_form_slot(struct lh_form *f, uint32_t hash, const char *name, size_t len)
+{
+	size_t mask = f->nslots - 1, i;
+	struct lh_form_slot *slot;
+
+	for (i = hash & mask; ; i = (i + 1) & mask) {
+		slot = &f->slots[i];
+
+		if (!slot->first ||
+		    (slot->hash == hash &&
+		     lh_form_name_eq(f, f->entries[slot->first - 1].offset,
+		                     name, len)))
+			return slot;
+	}
+}
+
+static bool
+lh_form_rehash(struct lh_form *f, size_t nslots)
+{
+	struct lh_form_slot *old = f->slots, *slot;
+	size_t i, n = f->nslots;
+
+	if (!lh_form_charge(f, nslots * sizeof(*f->slots)))
+		return false;
+
+	f->slots = calloc(nslots, sizeof(*f->slots));
+
+	if (!f->slots) {
+		lh_form_uncharge(f, nslots * sizeof(*f->slots));
+		f->slots = old;
+
+		return false;
+	}
+
+	lh_form_uncharge(f, n * sizeof(*f->slots));
+	f->nslots = nslots;
+
+	for (i = 0; i < n; i++) {
+		if (!old[i].first)
+			continue;
+
+		for (slot = &f->slots[old[i].hash & (nslots - 1)]; slot->first;
+		     slot = &f->slots[(slot - f->slots + 1) & (nslots - 1)])
+			;
+
+		*slot = old[i];
+	}
+
+	free(old);
+
+	return true;
+}
+
+static bool
+lh_form_index_record(struct lh_form *f, size_t off)
+{
+	const struct lh_form_record *rec = lh_form_record(f, off);
+	const char *name = (const char *)(rec + 1);
+	struct lh_form_entry *tmp;
+	struct lh_form_slot *slot;
+	uint32_t hash;
+	size_t n, grow;
+
+	if (f->nentries == f->entries_size) {
+		n = f->entries_size ? f->entries_size * 2 : 32;
+		grow = (n - f->entries_size) * sizeof(*f->entries);
+
+		if (!lh_form_charge(f, grow))
+			return false;
+
+		tmp = realloc(f->entries, n * sizeof(*f->entries));
+
+		if (!tmp) {
+			lh_form_uncharge(f, grow);
+
+			return false;
+		}
+
+		f->entries = tmp;
+		f->entries_size = n;
+	}
+
+	/* keep the load factor below 3/4 */
+	if ((f->nnames + 1) * 4 > f->nslots * 3 &&
+	    !lh_form_rehash(f, f->nslots ? f->nslots * 2 : 64))
+		return false;
+
+	hash = lh_form_hash(name, rec->namelen);
+	slot = lh_form_slot(f, hash, name, rec->namelen);
+
+	f->entries[f->nentries].offset = off;
+	f->entries[f->nentries].next = 0;
+	f->nentries++;
+
+	if (slot->first) {
+		f->entries[slot->last - 1].next = f->nentries;
+		slot->last = f->nentries;
+		slot->count++;
+	}
+	else {
+		slot->hash = hash;
+		slot->first = f->nentries;
+		slot->last = f->nentries;
+		slot->count = 1;
+		f->nnames++;
+	}
+
+	return true;
+}
+
+/*
+ * Bring the name index up to date with the records added since the last
+ * lookup. If memory for the index cannot be allocated, lookups fall back
+ * to scanning the records.
+ */
+static bool
+lh_form_index(struct lh_form *f)
+{
+	size_t off = f->indexed ? f->indexed : sizeof(struct lh_form_header);
+	size_t len = lh_form_header(f)->length;
+
+	if (f->unindexed)
+		return false;
+
+	while (off < len) {
+		if (!lh_form_index_record(f, off)) {
+			f->unindexed = true;
+
+			return false;
+		}
+
+		off += lh_form_record(f, off)->length;
+	}
+
+	f->indexed = off;
+
+	return true;
+}
+
+static bool
+lh_form_scan(struct lh_form *f, const char *name, size_t len,
+             struct lh_form_field *field)
+{
+	while (lh_form_next(f, field))
+		if (field->namelen == len && !memcmp(field->name, name, len))
+			return true;
+
+	return false;
+}
+
+/*
+ * Look up the first record with the given name and length through the
+ * name index of the form, further records with the same name can be
+ * retrieved with lh_form_get_next().
+ *
+ * Returns false if no such record exists.
+ */
+
+bool
+lh_form_lookup(struct lh_form *f, const char *name, size_t len,
+               struct lh_form_field *field)
+{
+	struct lh_form_slot *slot;
+	struct lh_form_entry *e;
+
+	memset(field, 0, sizeof(*field));
+
+	if (!lh_form_index(f))
+		return lh_form_scan(f, name, len, field);
+
+	if (!f->nslots)
+		return false;
+
+	slot = lh_form_slot(f, lh_form_hash(name, len), name, len);
+
+	if (!slot->first)
+		return false;
+
+	e = &f->entries[slot->first - 1];
+
+	lh_form_fill(f, e->offset, field);
+	field->dup = e->next;
+
+	return true;
+}
+
+/*
+ * Look up the first record with the given name.
+ *
+ * Returns false if no such record exists.
+ */
+
+bool
+lh_form_get(struct lh_form *f, const char *name, struct lh_form_field *field)
+{
+	return lh_form_lookup(f, name, strlen(name), field);
+}
+
+/*
+ * Advance the field returned by lh_form_get() or lh_form_lookup() to the
+ * next record carrying the same name.
+ *
+ * Returns false if there are no more such records.
+ */
+
+bool
+lh_form_get_next(struct lh_form *f, struct lh_form_field *field)
+{
+	struct lh_form_entry *e;
+
+	if (f->unindexed)
+		return lh_form_scan(f, field->name, field->namelen, field);
+
+	if (!field->dup)
+		return false;
+
+	e = &f->entries[field->dup - 1];
+
+	lh_form_fill(f, e->offset, field);
+	field->dup = e->next;
+
+	return true;
+}
+
+/*
+ * Count the records carrying the given name.
+ */
+
+size_t
+lh_form_count(struct lh_form *f, const char *name, size_t len)
+{
+	struct lh_form_field field;
+	size_t n = 0;
+
+	if (!lh_form_index(f)) {
+		memset(&field, 0, sizeof(field));
+
+		while (lh_form_scan(f, name, len, &field))
+			n++;
+
+		return n;
+	}
+
+	if (!f->nslots)
+		return 0;
+
+	return lh_form_slot(f, lh_form_hash(name, len), name, len)->count;
+}
+
+void
+lh_form_free(struct lh_form *f)
+{
+	if (!f->readonly)
+		free(f->data);
+
+	lh_form_part_reset(f);
+	free(f->slots);
+	free(f->entries);
+
+	if (f->budget)
+		lh_budget_release(f->budget, f->reserved);
+
+	free(f);
+}
@@ -0,0 +1,239 @@
+/*
+ * lucihttp - HTTP utility library - incremental inflate component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <lucihttp/inflate.h>
+
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+
+/*
+ * Allocate an inflate stage using an output window of the given size, or
+ * of 16KB if the size is zero. The compression format is detected from the
+ * first bytes of the input: gzip, zlib and raw deflate streams are accepted.
+ *
+ * Returns NULL if memory cannot be allocated.
+ */
+
+struct lh_inflate *
+lh_inflate_new(size_t size)
+{
+	struct lh_inflate *in;
+
+	in = calloc(1, sizeof(*in));
+
+	if (!in)
+		return NULL;
+
+	in->size = size ? size : LH_INFLATE_WINDOW_SIZE;
+	in->window = malloc(in->size);
+
+	if (!in->window) {
+		free(in);
+
+		return NULL;
+	}
+
+	return in;
+}
+
+/*
+ * Test whether the given Content-Encoding value is supported. The identity
+ * encoding is not considered supported as it requires no inflate stage.
+ */
+
+bool
+lh_inflate_supported(const char *encoding)
+{
+	return (!strcasecmp(encoding, "gzip") ||
+	        !strcasecmp(encoding, "x-gzip") ||
+	        !strcasecmp(encoding, "deflate"));
+}
+
+/*
+ * Limit the total amount of decompressed data, to protect against highly
+ * compressed inputs exceeding the quotas of the consumer. A limit of zero
+ * disables the check.
+ */
+
+void
+lh_inflate_set_limit(struct lh_inflate *in, size_t limit)
+{
+	in->limit = limit;
+}
+
+static bool
+lh_inflate_init(struct lh_inflate *in)
+{
+	int bits;
+
+	/* gzip magic, zlib header with valid check bits or raw deflate data */
+	if (in->head[0] == 0x1f)
+		bits = 16 + MAX_WBITS;
+	else if ((in->head[0] & 0x0f) == Z_DEFLATED &&
+	         ((in->head[0] << 8) | in->head[1]) % 31 == 0)
+		bits = MAX_WBITS;
+	else
+		bits = -MAX_WBITS;
+
+	if (inflateInit2(&in->zs, bits) != Z_OK) {
+		in->error = "out of memory";
+
+		return false;
+	}
+
+	in->flags |= LH_INFLATE_F_INIT;
+
+	if (bits > MAX_WBITS)
+		in->flags |= LH_INFLATE_F_GZIP;
+
+	return true;
+}
+
+static bool
+lh_inflate_run(struct lh_inflate *in, const char *buf, size_t len,
+               lh_inflate_callback cb, void *priv)
+{
+	size_t n;
+	int rv;
+
+	in->zs.next_in = (Bytef *)buf;
+	in->zs.avail_in = len;
+
+	while (in->zs.avail_in) {
+		if (in->flags & LH_INFLATE_F_END) {
+			/* concatenated gzip members are decoded as one stream */
+			if (!(in->flags & LH_INFLATE_F_GZIP)) {
+				in->error = "trailing data after the compressed stream";
+
+				return false;
+			}
+
+			inflateReset(&in->zs);
+			in->flags &= ~LH_INFLATE_F_END;
+		}
+
+		do {
+			in->zs.next_out = (Bytef *)in->window;
+			in->zs.avail_out = in->size;
+
+			rv = inflate(&in->zs, Z_NO_FLUSH);
+
+			if (rv == Z_STREAM_END) {
+				in->flags |= LH_INFLATE_F_END;
+			}
+			else if (rv != Z_OK && rv != Z_BUF_ERROR) {
+				in->error = in->zs.msg ? in->zs.msg
+				                       : "invalid compressed data";
+
+				return false;
+			}
+
+			n = in->size - in->zs.avail_out;
+
+			/* pass on the data up to the limit before failing */
+			if (in->limit && n > in->limit - in->total) {
+				n = in->limit - in->total;
+
+				if (n && !cb(in->window, n, priv))
+					return false;
+
+				in->total += n;
+				in->error = "the decompressed data exceeds the maximum "
+				            "allowed size";
+
+				return false;
+			}
+
+			in->total += n;
+
+			if (n && !cb(in->window, n, priv))
+				return false;
+		} while (!in->zs.avail_out && !(in->flags & LH_INFLATE_F_END));
+
+		if (rv == Z_BUF_ERROR && in->zs.avail_in)
+			break;
+	}
+
+	return true;
+}
+
+/*
+ * Decompress the given input and pass the decompressed data to the callback
+ * in chunks of at most the window size. Passing a NULL buffer signals the end
+ * of the input and verifies that the compressed stream is complete.
+ *
+ * Returns false if the input is invalid, exceeds the limit or if the
+ * callback returned false. In the former cases, the error member points to a
+ * description of the problem, otherwise it is NULL.
+ */
+
+bool
+lh_inflate_parse(struct lh_inflate *in, const char *buf, size_t len,
+                 lh_inflate_callback cb, void *priv)
+{
+	const char *head;
+	size_t n;
+
+	in->error = NULL;
+
+	if (!buf) {
+		if (!(in->flags & LH_INFLATE_F_END)) {
+			in->error = "the compressed data is truncated";
+
+			return false;
+		}
+
+		return true;
+	}
+
+	/* collect enough input to detect the stream format */
+	if (!(in->flags & LH_INFLATE_F_INIT)) {
+		n = 2 - in->headlen;
+		n = (len < n) ? len : n;
+
+		memcpy(in->head + in->headlen, buf, n);
+		in->headlen += n;
+		buf += n;
+		len -= n;
+
+		if (in->headlen < 2 && in->head[0] != 0x1f)
+			return true;
+
+		if (!lh_inflate_init(in))
+			return false;
+
+		head = (const char *)in->head;
+
+		if (!lh_inflate_run(in, head, in->headlen, cb, priv))
+			return false;
+	}
+
+	return lh_inflate_run(in, buf, len, cb, priv);
+}
+
+void
+lh_inflate_free(struct lh_inflate *in)
+{
+	if (in->flags & LH_INFLATE_F_INIT)
+		inflateEnd(&in->zs);
+
+	free(in->window);
+	free(in);
+}
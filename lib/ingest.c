@@ -0,0 +1,317 @@
+/*
+ * lucihttp - HTTP utility library - non-blocking ingest adapter
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <lucihttp/ingest.h>
+#include <lucihttp/ring-buffer.h>
+#include <lucihttp/multipart-parser.h>
+#include <lucihttp/urlencoded-parser.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+
+
+/*
+ * Feed the data readable from the given descriptor into a parser from within
+ * an epoll based event loop. The descriptor is switched to non-blocking mode
+ * and read into a ring buffer of at least the given size, zero selects the
+ * default size. If close is set, the descriptor is owned by the adapter and
+ * closed when freeing it.
+ *
+ * Returns NULL and sets errno if the adapter cannot be allocated, the file
+ * status flags of the descriptor are left unchanged in this case.
+ */
+
+struct lh_ingest *
+lh_ingest_new(int fd, bool close, size_t size)
+{
+	struct lh_ingest *i;
+	int fl, err;
+
+	fl = fcntl(fd, F_GETFL);
+
+	if (fl == -1 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) == -1)
+		return NULL;
+
+	i = calloc(1, sizeof(*i));
+
+	if (i)
+		i->ring = lh_ring_new(size ? size : LH_INGEST_BUFFER_SIZE);
+
+	if (!i || !i->ring) {
+		err = errno;
+
+		free(i);
+		fcntl(fd, F_SETFL, fl);
+
+		errno = err;
+
+		return NULL;
+	}
+
+	i->fd = fd;
+	i->epfd = -1;
+
+	if (close)
+		i->flags |= LH_INGEST_F_CLOSE;
+
+	return i;
+}
+
+static bool
+lh_ingest_parse_mpart(struct lh_ingest *i, bool eof)
+{
+	return lh_mpart_parse_ring(i->parser, i->ring, eof);
+}
+
+static bool
+lh_ingest_parse_urldec(struct lh_ingest *i, bool eof)
+{
+	const char *buf;
+	size_t len;
+
+	buf = lh_ring_read_ptr(i->ring, &len);
+
+	if (len && !lh_urldec_parse(i->parser, buf, len))
+		return false;
+
+	lh_ring_consume(i->ring, len);
+
+	return eof ? lh_urldec_parse(i->parser, NULL, 0) : true;
+}
+
+/*
+ * Select the parser to feed. A trailing partial multipart delimiter is kept
+ * in the ring until more data arrives, like lh_mpart_parse_ring() does.
+ */
+
+void
+lh_ingest_set_mpart(struct lh_ingest *i, struct lh_mpart *p)
+{
+	i->parse = lh_ingest_parse_mpart;
+	i->parser = p;
+}
+
+void
+lh_ingest_set_urldec(struct lh_ingest *i, struct lh_urldec *p)
+{
+	i->parse = lh_ingest_parse_urldec;
+	i->parser = p;
+}
+
+/*
+ * Stop reading after the given amount of bytes and treat it as end of input,
+ * e.g. for request bodies on persistent connections.
+ */
+
+void
+lh_ingest_set_length(struct lh_ingest *i, size_t len)
+{
+	i->remaining = len;
+	i->flags |= LH_INGEST_F_LENGTH;
+}
+
+/*
+ * Add the descriptor to or remove it from the epoll instance. A paused
+ * adapter is not part of the epoll set at all, since epoll reports hangups
+ * and errors even without any requested events.
+ */
+static bool
+lh_ingest_watch(struct lh_ingest *i, bool watch)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.ptr = i->data
+	};
+
+	if (!(i->flags & LH_INGEST_F_REGISTERED) ||
+	    (i->flags & LH_INGEST_F_PAUSED))
+		return true;
+
+	return (epoll_ctl(i->epfd, watch ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+	                  i->fd, &ev) == 0);
+}
+
+/*
+ * Watch the descriptor for readability with the given epoll instance. The
+ * given data pointer is passed as event data, NULL selects the adapter itself.
+ * The caller invokes lh_ingest_handle() whenever the descriptor is ready.
+ * A paused adapter is only added to the epoll instance once resumed.
+ *
+ * Returns false and sets errno if the descriptor cannot be registered.
+ */
+
+bool
+lh_ingest_register(struct lh_ingest *i, int epfd, void *data)
+{
+	if (i->flags & LH_INGEST_F_REGISTERED) {
+		lh_ingest_watch(i, false);
+		i->flags &= ~LH_INGEST_F_REGISTERED;
+	}
+
+	i->epfd = epfd;
+	i->data = data ? data : i;
+	i->flags |= LH_INGEST_F_REGISTERED;
+
+	if (!lh_ingest_watch(i, true)) {
+		i->flags &= ~LH_INGEST_F_REGISTERED;
+
+		return false;
+	}
+
+	return true;
+}
+
+static enum lh_ingest_status
+lh_ingest_finish(struct lh_ingest *i, enum lh_ingest_status status)
+{
+	i->flags |= LH_INGEST_F_DONE;
+
+	lh_ingest_watch(i, false);
+	i->flags &= ~LH_INGEST_F_REGISTERED;
+
+	return status;
+}
+
+/*
+ * Drain the descriptor into the parser until it would block, the end of
+ * input is reached or the adapter is paused, e.g. by a parser callback.
+ * Pausing takes effect once the data read so far has been parsed.
+ *
+ * Returns LH_INGEST_AGAIN if more data is expected, LH_INGEST_PAUSED if the
+ * adapter has been paused, LH_INGEST_DONE once the complete input has been
+ * parsed or LH_INGEST_ERROR if reading failed, with the errno value stored
+ * in the error member, or if the parser reported an error.
+ */
+
+enum lh_ingest_status
+lh_ingest_handle(struct lh_ingest *i)
+{
+	size_t avail;
+	ssize_t n;
+	bool eof;
+	char *ptr;
+
+	if (i->flags & LH_INGEST_F_DONE)
+		return i->error ? LH_INGEST_ERROR : LH_INGEST_DONE;
+
+	while (!(i->flags & LH_INGEST_F_PAUSED)) {
+		ptr = lh_ring_write_ptr(i->ring, &avail);
+
+		if ((i->flags & LH_INGEST_F_LENGTH) && avail > i->remaining)
+			avail = i->remaining;
+
+		eof = false;
+
+		if (avail) {
+			n = read(i->fd, ptr, avail);
+
+			if (n == -1) {
+				if (errno == EINTR)
+					continue;
+
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					return LH_INGEST_AGAIN;
+
+				i->error = errno;
+
+				return lh_ingest_finish(i, LH_INGEST_ERROR);
+			}
+
+			lh_ring_commit(i->ring, n);
+
+			if (i->flags & LH_INGEST_F_LENGTH)
+				i->remaining -= n;
+
+			eof = (n == 0);
+		}
+		else {
+			/* nothing left to read or the ring is completely filled */
+			eof = (i->flags & LH_INGEST_F_LENGTH) && !i->remaining;
+		}
+
+		if (!i->parse(i, eof)) {
+			i->error = EINVAL;
+
+			return lh_ingest_finish(i, LH_INGEST_ERROR);
+		}
+
+		if (eof)
+			return lh_ingest_finish(i, LH_INGEST_DONE);
+	}
+
+	return LH_INGEST_PAUSED;
+}
+
+/*
+ * Stop watching the descriptor, e.g. while a consumer of the parsed data
+ * cannot keep up, until lh_ingest_resume() is called. The descriptor is
+ * removed from the epoll instance meanwhile, so that a hangup of the peer
+ * does not wake up the event loop over and over.
+ *
+ * Returns false and sets errno if the epoll registration cannot be updated.
+ */
+
+bool
+lh_ingest_pause(struct lh_ingest *i)
+{
+	if (i->flags & LH_INGEST_F_PAUSED)
+		return true;
+
+	if (!lh_ingest_watch(i, false))
+		return false;
+
+	i->flags |= LH_INGEST_F_PAUSED;
+
+	return true;
+}
+
+bool
+lh_ingest_resume(struct lh_ingest *i)
+{
+	if (!(i->flags & LH_INGEST_F_PAUSED))
+		return true;
+
+	i->flags &= ~LH_INGEST_F_PAUSED;
+
+	if (!lh_ingest_watch(i, true)) {
+		i->flags |= LH_INGEST_F_PAUSED;
+
+		return false;
+	}
+
+	return true;
+}
+
+void
+lh_ingest_free(struct lh_ingest *i)
+{
+	int err = errno;
+
+	lh_ingest_watch(i, false);
+
+	if (i->flags & LH_INGEST_F_CLOSE)
+		close(i->fd);
+
+	lh_ring_free(i->ring);
+	free(i);
+
+	errno = err;
+}
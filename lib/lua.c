@@ -20,8 +20,411 @@
 #include <lucihttp/utils.h>
 #include <lucihttp/multipart-parser.h>
 #include <lucihttp/urlencoded-parser.h>
+#include <lucihttp/progress.h>
+#include <lucihttp/tee.h>
+#include <lucihttp/untar.h>
+#include <lucihttp/form.h>
+#include <lucihttp/budget.h>
+#include <lucihttp/fieldset.h>
 
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+
+/*
+ * Create a tee from the given argument, either an already opened file
+ * descriptor number or a path name of a file to create.
+ */
+
+static struct lh_tee *
+lh_L_tee_new(lua_State *L, int idx)
+{
+	if (lua_type(L, idx) == LUA_TNUMBER)
+		return lh_tee_new(lua_tointeger(L, idx), false);
+
+	return lh_tee_open(luaL_checkstring(L, idx));
+}
+
+/*
+ * Enable the form snapshot of a parser, return the snapshot as string or
+ * a sealed memory file descriptor of it.
+ */
+
+static int
+lh_L_form_enable(lua_State *L, struct lh_form **f)
+{
+	if (!*f)
+		*f = lh_form_new();
+
+	if (!*f) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Out of memory");
+		return 2;
+	}
+
+	lua_pushboolean(L, true);
+	return 1;
+}
+
+static int
+lh_L_form_push(lua_State *L, struct lh_form *f, bool as_fd)
+{
+	const char *data;
+	size_t len;
+	int fd;
+
+	if (!f) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Form snapshot not enabled");
+		return 2;
+	}
+
+	if (as_fd) {
+		fd = lh_form_memfd(f);
+
+		if (fd == -1) {
+			lua_pushnil(L);
+			lua_pushstring(L, strerror(errno));
+			return 2;
+		}
+
+		lua_pushinteger(L, fd);
+		return 1;
+	}
+
+	data = lh_form_finish(f, &len);
+
+	if (!data) {
+		lua_pushnil(L);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
+
+	lua_pushlstring(L, data, len);
+	return 1;
+}
+
+/*
+ * Look up the form field named by argument #2, return its value or, if
+ * argument #3 is true, a table of the values of all fields with the name.
+ */
+
+static int
+lh_L_form_field(lua_State *L, struct lh_form *f)
+{
+	struct lh_form_field field;
+	const char *name;
+	size_t len;
+	bool found;
+	int i;
+
+	name = luaL_checklstring(L, 2, &len);
+
+	if (!f) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Form snapshot not enabled");
+		return 2;
+	}
+
+	found = lh_form_lookup(f, name, len, &field);
+
+	if (!lua_toboolean(L, 3)) {
+		if (found)
+			lua_pushlstring(L, field.value, field.valuelen);
+		else
+			lua_pushnil(L);
+
+		return 1;
+	}
+
+	lua_createtable(L, found ? lh_form_count(f, name, len) : 0, 0);
+
+	for (i = 1; found; i++, found = lh_form_get_next(f, &field)) {
+		lua_pushlstring(L, field.value, field.valuelen);
+		lua_rawseti(L, -2, i);
+	}
+
+	return 1;
+}
+
+/*
+ * Build a nested table from the bracket paths of the form field names, so
+ * that "a[b][]=1" yields { a = { b = { "1" } } }. Fields are applied in
+ * order, a later field replaces a conflicting earlier value.
+ */
+
+static int
+lh_L_form_tree(lua_State *L, struct lh_form *f)
+{
+	struct lh_form_field field = { 0 };
+	size_t off, seglen;
+	const char *seg;
+
+	if (!f) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Form snapshot not enabled");
+		return 2;
+	}
+
+	lua_newtable(L);
+
+	while (lh_form_next(f, &field)) {
+		off = 0;
+
+		if (!lh_urldec_path_next(field.name, field.namelen, &off,
+		                         &seg, &seglen))
+			continue;
+
+		lua_pushvalue(L, -1);
+		lua_pushlstring(L, seg, seglen);
+
+		while (lh_urldec_path_next(field.name, field.namelen, &off,
+		                           &seg, &seglen)) {
+			/* descend into the table at the pending key, replacing
+			 * non-table values */
+			lua_pushvalue(L, -1);
+			lua_rawget(L, -3);
+
+			if (!lua_istable(L, -1)) {
+				lua_pop(L, 1);
+				lua_newtable(L);
+				lua_pushvalue(L, -2);
+				lua_pushvalue(L, -2);
+				lua_rawset(L, -5);
+			}
+
+			lua_remove(L, -2);
+			lua_remove(L, -2);
+
+			if (seg)
+				lua_pushlstring(L, seg, seglen);
+			else
+				lua_pushinteger(L, lua_objlen(L, -1) + 1);
+		}
+
+		lua_pushlstring(L, field.value, field.valuelen);
+		lua_rawset(L, -3);
+		lua_pop(L, 1);
+	}
+
+	return 1;
+}
+
+/*
+ * Compile the table of field names at argument #2 into a field set, nil
+ * removes the field set.
+ */
+
+static int
+lh_L_fields_new(lua_State *L, struct lh_fieldset **s)
+{
+	const char **names = NULL;
+	size_t i, n = 0;
+
+	if (!lua_isnoneornil(L, 2)) {
+		luaL_checktype(L, 2, LUA_TTABLE);
+
+		n = lua_objlen(L, 2);
+		names = lua_newuserdata(L, (n ? n : 1) * sizeof(*names));
+
+		for (i = 0; i < n; i++) {
+			lua_rawgeti(L, 2, i + 1);
+			names[i] = luaL_checkstring(L, -1);
+			lua_pop(L, 1);
+		}
+	}
+
+	if (*s)
+		lh_fieldset_free(*s);
+
+	*s = names ? lh_fieldset_new(names, n) : NULL;
+
+	if (names && !*s) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Out of memory");
+		return 2;
+	}
+
+	lua_pushboolean(L, true);
+	return 1;
+}
+
+/*
+ * tar extractor binding
+ * -------------------------------------------------------------------------
+ */
+
+struct lh_L_untar {
+	lua_State *L;
+	int callback;
+	struct lh_untar *untar;
+};
+
+static bool
+lh_L_untar_cb(struct lh_untar *u, enum lh_untar_callback_type type,
+              const char *buf, size_t len, void *priv)
+{
+	struct lh_L_untar *uu = priv;
+	bool rv = false;
+
+	/* function itself */
+	lua_rawgeti(uu->L, LUA_REGISTRYINDEX, uu->callback);
+
+	/* arg #1: callback type */
+	lua_pushnumber(uu->L, type);
+
+	/* arg #2: buffer data or nil */
+	if (buf)
+		lua_pushlstring(uu->L, buf, len);
+	else
+		lua_pushnil(uu->L);
+
+	/* arg #3: buffer length */
+	lua_pushnumber(uu->L, len);
+
+	/* call, expect one boolean return */
+	lua_call(uu->L, 3, 1);
+
+	/* fetch result */
+	rv = lua_toboolean(uu->L, -1);
+
+	/* pop result */
+	lua_pop(uu->L, 1);
+
+	return rv;
+}
+
+static int
+lh_L_untar_new(lua_State *L)
+{
+	const char *dir = luaL_optstring(L, 1, NULL);
+	struct lh_L_untar *uu;
+	struct lh_untar *u;
+
+	u = lh_untar_new(NULL);
+
+	if (!u) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Out of memory");
+		return 2;
+	}
+
+	if (dir && !lh_untar_set_directory(u, dir)) {
+		lh_untar_free(u);
+		lua_pushnil(L);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
+
+	uu = lua_newuserdata(L, sizeof(*uu));
+
+	if (!uu) {
+		lh_untar_free(u);
+		return 0;
+	}
+
+	luaL_getmetatable(L, LUCIHTTP_UNTAR_META);
+	lua_setmetatable(L, -2);
+
+	if (lua_type(L, 2) == LUA_TFUNCTION) {
+		lua_pushvalue(L, 2);
+		uu->callback = luaL_ref(L, LUA_REGISTRYINDEX);
+		lh_untar_set_callback(u, lh_L_untar_cb, uu);
+	}
+	else {
+		uu->callback = -1;
+	}
+
+	uu->L = L;
+	uu->untar = u;
+	return 1;
+}
+
+static int
+lh_L_untar_parse(lua_State *L)
+{
+	size_t len = 0;
+	struct lh_L_untar *uu = luaL_checkudata(L, 1, LUCIHTTP_UNTAR_META);
+	const char *buf = luaL_optlstring(L, 2, NULL, &len);
+
+	if (uu->untar)
+		lua_pushboolean(L, lh_untar_parse(uu->untar, buf, len));
+	else
+		lua_pushnil(L);
+
+	return 1;
+}
+
+static int
+lh_L_untar_error(lua_State *L)
+{
+	struct lh_L_untar *uu = luaL_checkudata(L, 1, LUCIHTTP_UNTAR_META);
+
+	if (uu->untar && uu->untar->error)
+		lua_pushstring(L, uu->untar->error);
+	else
+		lua_pushnil(L);
+
+	return 1;
+}
+
+static int
+lh_L_untar_member(lua_State *L)
+{
+	struct lh_L_untar *uu = luaL_checkudata(L, 1, LUCIHTTP_UNTAR_META);
+	static const char *types[] = {
+		"file", "directory", "symlink", "hardlink", "other"
+	};
+	struct lh_untar_member *m;
+
+	if (!uu->untar || !uu->untar->member.name)
+		return 0;
+
+	m = &uu->untar->member;
+
+	lua_newtable(L);
+
+	lua_pushstring(L, m->name);
+	lua_setfield(L, -2, "name");
+
+	lua_pushstring(L, types[m->type]);
+	lua_setfield(L, -2, "type");
+
+	lua_pushnumber(L, m->size);
+	lua_setfield(L, -2, "size");
+
+	lua_pushnumber(L, m->mode);
+	lua_setfield(L, -2, "mode");
+
+	lua_pushnumber(L, m->mtime);
+	lua_setfield(L, -2, "mtime");
+
+	if (m->type == LH_UT_M_SYMLINK || m->type == LH_UT_M_HARDLINK) {
+		lua_pushstring(L, m->linkname);
+		lua_setfield(L, -2, "linkname");
+	}
+
+	return 1;
+}
+
+static int
+lh_L_untar__gc(lua_State *L)
+{
+	struct lh_L_untar *uu = luaL_checkudata(L, 1, LUCIHTTP_UNTAR_META);
+
+	if (uu && uu->untar) {
+		lh_untar_free(uu->untar);
+		uu->untar = NULL;
+	}
+
+	if (uu && uu->callback != -1) {
+		luaL_unref(L, LUA_REGISTRYINDEX, uu->callback);
+		uu->callback = -1;
+	}
+
+	return 0;
+}
 
 
 /*
@@ -33,6 +436,13 @@ struct lh_L_mpart {
 	lua_State *L;
 	int callback;
 	void *parser;
+	struct lh_progress *progress;
+	struct lh_tee *tee;
+	struct lh_form *form;
+	struct lh_fieldset *fields;
+	struct lh_untar *untar;
+	int untar_ref;
+	bool untar_failed;
 };
 
 static bool
@@ -42,6 +452,26 @@ lh_L_mpart_cb(struct lh_mpart *p, enum lh_mpart_callback_type type,
 	struct lh_L_mpart *pu = priv;
 	bool rv = false;
 
+	/* route the part data to an attached tar extractor, a failure of it
+	 * is reported by the next parse() call */
+	if (pu->untar) {
+		if (type == LH_MP_CB_PART_DATA) {
+			if (!lh_untar_parse(pu->untar, buf, len))
+				pu->untar_failed = true;
+
+			return true;
+		}
+
+		if (type == LH_MP_CB_PART_END || type == LH_MP_CB_ERROR) {
+			if (type == LH_MP_CB_PART_END &&
+			    !lh_untar_parse(pu->untar, NULL, 0))
+				pu->untar_failed = true;
+
+			luaL_unref(pu->L, LUA_REGISTRYINDEX, pu->untar_ref);
+			pu->untar = NULL;
+		}
+	}
+
 	if (pu->callback != -1) {
 		/* function itself */
 		lua_rawgeti(pu->L, LUA_REGISTRYINDEX, pu->callback);
@@ -122,6 +552,11 @@ lh_L_mpart_new(lua_State *L)
 
 	pu->L = L;
 	pu->parser = p;
+	pu->progress = NULL;
+	pu->tee = NULL;
+	pu->form = NULL;
+	pu->fields = NULL;
+	pu->untar = NULL;
 	return 1;
 }
 
@@ -132,133 +567,618 @@ lh_L_mpart_parse(lua_State *L)
 	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
 	const char *buf = luaL_optlstring(L, 2, NULL, &len);
 
-	if (pu->parser)
-		lua_pushboolean(L, lh_mpart_parse(pu->parser, buf, len));
-	else
+	if (!pu->parser) {
 		lua_pushnil(L);
+		return 1;
+	}
+
+	if (!lh_mpart_parse(pu->parser, buf, len)) {
+		lua_pushboolean(L, false);
+		return 1;
+	}
+
+	/* an attached tar extractor failed on the part data */
+	if (pu->untar_failed) {
+		lua_pushboolean(L, false);
+		lua_pushstring(L, "Unable to extract the archive");
+		return 2;
+	}
 
+	lua_pushboolean(L, true);
 	return 1;
 }
 
 static int
-lh_L_mpart__gc(lua_State *L)
+lh_L_mpart_set_chunk_size(lua_State *L)
 {
 	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+	size_t size = luaL_checknumber(L, 2);
 
-	if (pu && pu->parser) {
-		lh_mpart_free(pu->parser);
-		pu->parser = NULL;
-	}
+	if (pu->parser)
+		lh_mpart_set_chunk_size(pu->parser, size);
+
+	return 0;
+}
+
+static int
+lh_L_mpart_set_body_limit(lua_State *L)
+{
+	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+	size_t limit = luaL_checknumber(L, 2);
+
+	if (pu->parser)
+		lh_mpart_set_body_limit(pu->parser, limit);
 
 	return 0;
 }
 
+static int
+lh_L_mpart_set_inflate_limit(lua_State *L)
+{
+	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+	size_t limit = luaL_checknumber(L, 2);
 
-/*
- * urlencoded parser binding
- * -------------------------------------------------------------------------
- */
+	if (pu->parser)
+		lh_mpart_set_inflate_limit(pu->parser, limit);
 
-struct lh_L_urldec {
-	lua_State *L;
-	int callback;
-	struct lh_urldec *parser;
-};
+	return 0;
+}
 
-static bool
-lh_L_urldec_cb(struct lh_urldec *p, enum lh_urldec_callback_type type,
-               const char *buf, size_t len, void *priv)
+static int
+lh_L_mpart_set_content_length(lua_State *L)
 {
-	struct lh_L_urldec *pu = priv;
-	bool rv = false;
+	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+	size_t len = luaL_checknumber(L, 2);
+
+	if (pu->parser)
+		lua_pushboolean(L, lh_mpart_set_content_length(pu->parser, len));
+	else
+		lua_pushnil(L);
+
+	return 1;
+}
+
+static int
+lh_L_mpart_set_content_encoding(lua_State *L)
+{
+	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+	const char *encoding = luaL_optstring(L, 2, NULL);
+
+	if (pu->parser)
+		lua_pushboolean(L, lh_mpart_set_content_encoding(pu->parser, encoding));
+	else
+		lua_pushnil(L);
+
+	return 1;
+}
+
+static int
+lh_L_mpart_set_transfer_decoding(lua_State *L)
+{
+	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+	bool enable = lua_isnoneornil(L, 2) || lua_toboolean(L, 2);
+
+	if (pu->parser)
+		lh_mpart_set_transfer_decoding(pu->parser, enable);
+
+	return 0;
+}
+
+static int
+lh_L_mpart_set_progress(lua_State *L)
+{
+	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+	const char *path = luaL_checkstring(L, 2);
+	size_t interval = luaL_optnumber(L, 3, 0);
+	struct lh_progress *pr;
+
+	if (!pu->parser)
+		return 0;
+
+	pr = lh_progress_open(path, interval);
+
+	if (!pr) {
+		lua_pushnil(L);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
+
+	if (pu->progress)
+		lh_progress_close(pu->progress);
+
+	pu->progress = pr;
+	lh_mpart_set_progress(pu->parser, pr);
+
+	lua_pushboolean(L, true);
+	return 1;
+}
+
+static int
+lh_L_mpart_set_tee(lua_State *L)
+{
+	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+	struct lh_tee *t;
+
+	if (!pu->parser)
+		return 0;
+
+	t = lh_L_tee_new(L, 2);
+
+	if (!t) {
+		lua_pushnil(L);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
+
+	if (pu->tee)
+		lh_tee_free(pu->tee);
+
+	pu->tee = t;
+	lh_mpart_set_tee(pu->parser, t);
+
+	lua_pushboolean(L, true);
+	return 1;
+}
+
+static int
+lh_L_mpart_set_form(lua_State *L)
+{
+	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+	int rv;
+
+	if (!pu->parser)
+		return 0;
+
+	rv = lh_L_form_enable(L, &pu->form);
+	lh_mpart_set_form(pu->parser, pu->form);
+
+	return rv;
+}
+
+static int
+lh_L_mpart_set_form_path(lua_State *L)
+{
+	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+	const char *path = luaL_checkstring(L, 2);
+
+	if (pu->form)
+		lua_pushboolean(L, lh_form_set_path(pu->form, path));
+	else
+		lua_pushnil(L);
+
+	return 1;
+}
+
+static int
+lh_L_mpart_set_fields(lua_State *L)
+{
+	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+	int rv;
+
+	if (!pu->parser)
+		return 0;
+
+	rv = lh_L_fields_new(L, &pu->fields);
+	lh_mpart_set_fields(pu->parser, pu->fields);
+
+	return rv;
+}
+
+static int
+lh_L_mpart_form(lua_State *L)
+{
+	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+
+	return lh_L_form_push(L, pu->form, false);
+}
+
+static int
+lh_L_mpart_field(lua_State *L)
+{
+	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+
+	return lh_L_form_field(L, pu->form);
+}
+
+static int
+lh_L_mpart_form_fd(lua_State *L)
+{
+	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+
+	return lh_L_form_push(L, pu->form, true);
+}
+
+static int
+lh_L_mpart_set_untar(lua_State *L)
+{
+	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+	struct lh_L_untar *uu = luaL_checkudata(L, 2, LUCIHTTP_UNTAR_META);
+
+	if (!pu->parser || !uu->untar)
+		return 0;
+
+	if (pu->untar)
+		luaL_unref(L, LUA_REGISTRYINDEX, pu->untar_ref);
+
+	lua_pushvalue(L, 2);
+	pu->untar_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	pu->untar = uu->untar;
+	pu->untar_failed = false;
+
+	return 0;
+}
+
+static int
+lh_L_mpart__gc(lua_State *L)
+{
+	struct lh_L_mpart *pu = luaL_checkudata(L, 1, LUCIHTTP_MPART_META);
+
+	if (pu && pu->parser) {
+		lh_mpart_free(pu->parser);
+		pu->parser = NULL;
+	}
+
+	if (pu && pu->progress) {
+		lh_progress_close(pu->progress);
+		pu->progress = NULL;
+	}
+
+	if (pu && pu->untar) {
+		luaL_unref(L, LUA_REGISTRYINDEX, pu->untar_ref);
+		pu->untar = NULL;
+	}
+
+	if (pu && pu->tee) {
+		lh_tee_free(pu->tee);
+		pu->tee = NULL;
+	}
+
+	if (pu && pu->form) {
+		lh_form_free(pu->form);
+		pu->form = NULL;
+	}
+
+	if (pu && pu->fields) {
+		lh_fieldset_free(pu->fields);
+		pu->fields = NULL;
+	}
+
+	return 0;
+}
+
+
+/*
+ * urlencoded parser binding
+ * -------------------------------------------------------------------------
+ */
+
+struct lh_L_urldec {
+	lua_State *L;
+	int callback;
+	struct lh_urldec *parser;
+	struct lh_tee *tee;
+	struct lh_form *form;
+	struct lh_fieldset *fields;
+};
+
+static bool
+lh_L_urldec_cb(struct lh_urldec *p, enum lh_urldec_callback_type type,
+               const char *buf, size_t len, void *priv)
+{
+	struct lh_L_urldec *pu = priv;
+	bool rv = false;
+
+	if (pu->callback != -1) {
+		/* function itself */
+		lua_rawgeti(pu->L, LUA_REGISTRYINDEX, pu->callback);
+
+		/* arg #1: callback type */
+		lua_pushnumber(pu->L, type);
+
+		/* arg #2: buffer data or nil */
+		if (buf)
+			lua_pushlstring(pu->L, buf, len);
+		else
+			lua_pushnil(pu->L);
+
+		/* arg #3: buffer length */
+		lua_pushnumber(pu->L, len);
+
+		/* call, expect one boolean return */
+		lua_call(pu->L, 3, 1);
+
+		/* fetch result */
+		rv = lua_toboolean(pu->L, -1);
+
+		/* pop result */
+		lua_pop(pu->L, 1);
+	}
+
+	return rv;
+}
+
+
+static int
+lh_L_urldec_new(lua_State *L)
+{
+	struct lh_L_urldec *pu;
+	struct lh_urldec *p;
+	size_t limit;
+
+	p = lh_urldec_new(NULL);
+	limit = luaL_optnumber(L, 2, 0);
+
+	if (!p) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Out of memory");
+		return 2;
+	}
+
+	pu = lua_newuserdata(L, sizeof(*pu));
+
+	if (!pu) {
+		lh_urldec_free(p);
+		return 0;
+	}
+
+	luaL_getmetatable(L, LUCIHTTP_URLDEC_META);
+	lua_setmetatable(L, -2);
+
+	if (limit)
+		lh_urldec_set_size_limit(p, limit);
+
+	lh_urldec_set_callback(p, lh_L_urldec_cb, pu);
+	lh_urldec_set_spans(p, true);
+
+	if (lua_type(L, 1) == LUA_TFUNCTION) {
+		lua_pushvalue(L, 1);
+		pu->callback = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
+	else {
+		pu->callback = -1;
+	}
+
+	pu->L = L;
+	pu->parser = p;
+	pu->tee = NULL;
+	pu->form = NULL;
+	pu->fields = NULL;
+	return 1;
+}
+
+static int
+lh_L_urldec_parse(lua_State *L)
+{
+	size_t len = 0;
+	struct lh_L_urldec *pu = luaL_checkudata(L, 1, LUCIHTTP_URLDEC_META);
+	const char *buf = luaL_optlstring(L, 2, NULL, &len);
+
+	if (pu->parser)
+		lua_pushboolean(L, lh_urldec_parse(pu->parser, buf, len));
+	else
+		lua_pushnil(L);
+
+	return 1;
+}
+
+/*
+ * Parse the data at argument #2 and return a table of { name, value } pairs
+ * holding the tuples completed by it, nil and an error message on failure.
+ */
+
+static int
+lh_L_urldec_parse_tuples(lua_State *L)
+{
+	size_t len = 0;
+	struct lh_L_urldec *pu = luaL_checkudata(L, 1, LUCIHTTP_URLDEC_META);
+	const char *buf = luaL_optlstring(L, 2, NULL, &len), *s;
+	struct lh_urldec_tuple *tuples;
+	size_t i, n = 1;
+
+	if (!pu->parser) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	for (s = buf; s && (s = memchr(s, '&', buf + len - s)) != NULL; s++)
+		n++;
+
+	tuples = calloc(n, sizeof(*tuples));
+
+	if (!tuples) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Out of memory");
+		return 2;
+	}
+
+	n = lh_urldec_parse_tuples(pu->parser, buf, len, tuples, n);
+
+	if (pu->parser->error) {
+		free(tuples);
+		lua_pushnil(L);
+		lua_pushstring(L, pu->parser->error);
+		return 2;
+	}
+
+	lua_createtable(L, n, 0);
+
+	for (i = 0; i < n; i++) {
+		lua_createtable(L, 2, 0);
+		lua_pushlstring(L, tuples[i].name, tuples[i].namelen);
+		lua_rawseti(L, -2, 1);
+		lua_pushlstring(L, tuples[i].value, tuples[i].valuelen);
+		lua_rawseti(L, -2, 2);
+		lua_rawseti(L, -2, i + 1);
+	}
+
+	free(tuples);
+
+	return 1;
+}
+
+static int
+lh_L_urldec_set_body_limit(lua_State *L)
+{
+	struct lh_L_urldec *pu = luaL_checkudata(L, 1, LUCIHTTP_URLDEC_META);
+	size_t limit = luaL_checknumber(L, 2);
+
+	if (pu->parser)
+		lh_urldec_set_body_limit(pu->parser, limit);
+
+	return 0;
+}
+
+static int
+lh_L_urldec_set_inflate_limit(lua_State *L)
+{
+	struct lh_L_urldec *pu = luaL_checkudata(L, 1, LUCIHTTP_URLDEC_META);
+	size_t limit = luaL_checknumber(L, 2);
+
+	if (pu->parser)
+		lh_urldec_set_inflate_limit(pu->parser, limit);
+
+	return 0;
+}
+
+static int
+lh_L_urldec_set_content_length(lua_State *L)
+{
+	struct lh_L_urldec *pu = luaL_checkudata(L, 1, LUCIHTTP_URLDEC_META);
+	size_t len = luaL_checknumber(L, 2);
+
+	if (pu->parser)
+		lua_pushboolean(L, lh_urldec_set_content_length(pu->parser, len));
+	else
+		lua_pushnil(L);
+
+	return 1;
+}
+
+static int
+lh_L_urldec_set_content_encoding(lua_State *L)
+{
+	struct lh_L_urldec *pu = luaL_checkudata(L, 1, LUCIHTTP_URLDEC_META);
+	const char *encoding = luaL_optstring(L, 2, NULL);
+
+	if (pu->parser)
+		lua_pushboolean(L, lh_urldec_set_content_encoding(pu->parser, encoding));
+	else
+		lua_pushnil(L);
+
+	return 1;
+}
+
+static int
+lh_L_urldec_set_tee(lua_State *L)
+{
+	struct lh_L_urldec *pu = luaL_checkudata(L, 1, LUCIHTTP_URLDEC_META);
+	struct lh_tee *t;
 
-	if (pu->callback != -1) {
-		/* function itself */
-		lua_rawgeti(pu->L, LUA_REGISTRYINDEX, pu->callback);
+	if (!pu->parser)
+		return 0;
 
-		/* arg #1: callback type */
-		lua_pushnumber(pu->L, type);
+	t = lh_L_tee_new(L, 2);
 
-		/* arg #2: buffer data or nil */
-		if (buf)
-			lua_pushlstring(pu->L, buf, len);
-		else
-			lua_pushnil(pu->L);
+	if (!t) {
+		lua_pushnil(L);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
 
-		/* arg #3: buffer length */
-		lua_pushnumber(pu->L, len);
+	if (pu->tee)
+		lh_tee_free(pu->tee);
 
-		/* call, expect one boolean return */
-		lua_call(pu->L, 3, 1);
+	pu->tee = t;
+	lh_urldec_set_tee(pu->parser, t);
 
-		/* fetch result */
-		rv = lua_toboolean(pu->L, -1);
+	lua_pushboolean(L, true);
+	return 1;
+}
 
-		/* pop result */
-		lua_pop(pu->L, 1);
-	}
+static int
+lh_L_urldec_set_form(lua_State *L)
+{
+	struct lh_L_urldec *pu = luaL_checkudata(L, 1, LUCIHTTP_URLDEC_META);
+	int rv;
+
+	if (!pu->parser)
+		return 0;
+
+	rv = lh_L_form_enable(L, &pu->form);
+	lh_urldec_set_form(pu->parser, pu->form);
 
 	return rv;
 }
 
-
 static int
-lh_L_urldec_new(lua_State *L)
+lh_L_urldec_set_decode(lua_State *L)
 {
-	struct lh_L_urldec *pu;
-	struct lh_urldec *p;
-	size_t limit;
+	struct lh_L_urldec *pu = luaL_checkudata(L, 1, LUCIHTTP_URLDEC_META);
+	bool decode = lua_isnoneornil(L, 2) || lua_toboolean(L, 2);
 
-	p = lh_urldec_new(NULL);
-	limit = luaL_optnumber(L, 2, 0);
+	if (pu->parser)
+		lh_urldec_set_decode(pu->parser, decode);
 
-	if (!p) {
-		lua_pushnil(L);
-		lua_pushstring(L, "Out of memory");
-		return 2;
-	}
+	return 0;
+}
 
-	pu = lua_newuserdata(L, sizeof(*pu));
+static int
+lh_L_urldec_set_fields(lua_State *L)
+{
+	struct lh_L_urldec *pu = luaL_checkudata(L, 1, LUCIHTTP_URLDEC_META);
+	int rv;
 
-	if (!pu) {
-		lh_urldec_free(p);
+	if (!pu->parser)
 		return 0;
-	}
 
-	luaL_getmetatable(L, LUCIHTTP_URLDEC_META);
-	lua_setmetatable(L, -2);
+	rv = lh_L_fields_new(L, &pu->fields);
+	lh_urldec_set_fields(pu->parser, pu->fields);
 
-	if (limit)
-		lh_urldec_set_size_limit(p, limit);
+	return rv;
+}
 
-	lh_urldec_set_callback(p, lh_L_urldec_cb, pu);
+static int
+lh_L_urldec_form(lua_State *L)
+{
+	struct lh_L_urldec *pu = luaL_checkudata(L, 1, LUCIHTTP_URLDEC_META);
 
-	if (lua_type(L, 1) == LUA_TFUNCTION) {
-		lua_pushvalue(L, 1);
-		pu->callback = luaL_ref(L, LUA_REGISTRYINDEX);
-	}
-	else {
-		pu->callback = -1;
-	}
+	return lh_L_form_push(L, pu->form, false);
+}
 
-	pu->L = L;
-	pu->parser = p;
-	return 1;
+static int
+lh_L_urldec_field(lua_State *L)
+{
+	struct lh_L_urldec *pu = luaL_checkudata(L, 1, LUCIHTTP_URLDEC_META);
+
+	return lh_L_form_field(L, pu->form);
 }
 
 static int
-lh_L_urldec_parse(lua_State *L)
+lh_L_urldec_set_paths(lua_State *L)
 {
-	size_t len = 0;
 	struct lh_L_urldec *pu = luaL_checkudata(L, 1, LUCIHTTP_URLDEC_META);
-	const char *buf = luaL_optlstring(L, 2, NULL, &len);
+	bool paths = lua_isnoneornil(L, 2) || lua_toboolean(L, 2);
 
 	if (pu->parser)
-		lua_pushboolean(L, lh_urldec_parse(pu->parser, buf, len));
-	else
-		lua_pushnil(L);
+		lh_urldec_set_paths(pu->parser, paths);
 
-	return 1;
+	return 0;
+}
+
+static int
+lh_L_urldec_tree(lua_State *L)
+{
+	struct lh_L_urldec *pu = luaL_checkudata(L, 1, LUCIHTTP_URLDEC_META);
+
+	return lh_L_form_tree(L, pu->form);
+}
+
+static int
+lh_L_urldec_form_fd(lua_State *L)
+{
+	struct lh_L_urldec *pu = luaL_checkudata(L, 1, LUCIHTTP_URLDEC_META);
+
+	return lh_L_form_push(L, pu->form, true);
 }
 
 static int
@@ -271,6 +1191,21 @@ lh_L_urldec__gc(lua_State *L)
 		pu->parser = NULL;
 	}
 
+	if (pu && pu->tee) {
+		lh_tee_free(pu->tee);
+		pu->tee = NULL;
+	}
+
+	if (pu && pu->form) {
+		lh_form_free(pu->form);
+		pu->form = NULL;
+	}
+
+	if (pu && pu->fields) {
+		lh_fieldset_free(pu->fields);
+		pu->fields = NULL;
+	}
+
 	return 0;
 }
 
@@ -326,6 +1261,87 @@ lh_L_urldecode(lua_State *L)
 	return 1;
 }
 
+static int
+lh_L_base64_encode(lua_State *L)
+{
+	size_t len;
+	char *encoded;
+	const char *str = luaL_optlstring(L, 1, NULL, &len);
+	unsigned int flags = luaL_optnumber(L, 2, 0);
+
+	if (!str)
+		return 0;
+
+	encoded = lh_base64_encode(str, len, &len, flags);
+
+	if (!encoded) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lua_pushlstring(L, encoded, len);
+	free(encoded);
+	return 1;
+}
+
+static int
+lh_L_base64_decode(lua_State *L)
+{
+	size_t len;
+	char *decoded;
+	const char *str = luaL_optlstring(L, 1, NULL, &len);
+	unsigned int flags = luaL_optnumber(L, 2, 0);
+
+	if (!str)
+		return 0;
+
+	decoded = lh_base64_decode(str, len, &len, flags);
+
+	if (!decoded) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lua_pushlstring(L, decoded, len);
+	free(decoded);
+	return 1;
+}
+
+static int
+lh_L_query_get(lua_State *L)
+{
+	size_t len;
+	ssize_t vlen;
+	char buf[256], *value = buf;
+	const char *query = luaL_checklstring(L, 1, &len);
+	const char *name = luaL_checkstring(L, 2);
+
+	if (!len)
+		return 0;
+
+	vlen = lh_query_get(query, len, name, buf, sizeof(buf));
+
+	if (vlen < 0)
+		return 0;
+
+	/* retry with a sufficiently sized buffer for long values */
+	if ((size_t)vlen >= sizeof(buf)) {
+		value = malloc(vlen + 1);
+
+		if (!value)
+			return 0;
+
+		lh_query_get(query, len, name, value, vlen + 1);
+	}
+
+	lua_pushlstring(L, value, vlen);
+
+	if (value != buf)
+		free(value);
+
+	return 1;
+}
+
 static int
 lh_L_header_attribute(lua_State *L)
 {
@@ -349,29 +1365,240 @@ lh_L_header_attribute(lua_State *L)
 }
 
 
+static char
+lh_L_lower(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? (c | 0x20) : c;
+}
+
+/*
+ * Tokenize a header value once and return a table with the media type and
+ * a table of all parameters keyed by their lower case names. Like with
+ * header_attribute(), the first occurrence of a parameter wins.
+ */
+static int
+lh_L_header_params(lua_State *L)
+{
+	struct lh_header_param stack[16], *params = stack;
+	size_t len, n, i, j, size = 0;
+	const char *hval = luaL_checklstring(L, 1, &len);
+	char *buf, *key;
+
+	n = lh_header_params(hval, len, params, 16);
+
+	if (n > 16) {
+		params = calloc(n, sizeof(*params));
+
+		if (!params)
+			goto oom;
+
+		lh_header_params(hval, len, params, n);
+	}
+
+	/* one scratch buffer holds the lower case name and the decoded value */
+	for (i = 0; i < n; i++)
+		if (params[i].namelen + params[i].valuelen + 2 > size)
+			size = params[i].namelen + params[i].valuelen + 2;
+
+	buf = malloc(size ? size : 1);
+
+	if (!buf)
+		goto oom;
+
+	lua_newtable(L);
+	lua_newtable(L);
+
+	for (i = 0; i < n; i++) {
+		len = lh_header_param_value(&params[i], buf, size);
+
+		if (!params[i].name) {
+			lua_pushlstring(L, buf, len);
+			lua_setfield(L, -3, "type");
+			continue;
+		}
+
+		key = buf + len + 1;
+
+		for (j = 0; j < params[i].namelen; j++)
+			key[j] = lh_L_lower(params[i].name[j]);
+
+		key[j] = 0;
+
+		lua_getfield(L, -1, key);
+
+		if (lua_isnil(L, -1)) {
+			lua_pushlstring(L, buf, len);
+			lua_setfield(L, -3, key);
+		}
+
+		lua_pop(L, 1);
+	}
+
+	lua_setfield(L, -2, "params");
+
+	if (params != stack)
+		free(params);
+
+	free(buf);
+
+	return 1;
+
+oom:
+	if (params != stack)
+		free(params);
+
+	lua_pushnil(L);
+	lua_pushstring(L, "Out of memory");
+
+	return 2;
+}
+
+static int
+lh_L_progress(lua_State *L)
+{
+	const char *path = luaL_checkstring(L, 1);
+	struct lh_progress_info info;
+	struct lh_progress *pr;
+
+	pr = lh_progress_attach(path);
+
+	if (!pr) {
+		lua_pushnil(L);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
+
+	if (!lh_progress_read(pr, &info)) {
+		lh_progress_close(pr);
+		lua_pushnil(L);
+		lua_pushstring(L, "Invalid progress file");
+		return 2;
+	}
+
+	lh_progress_close(pr);
+
+	lua_newtable(L);
+
+	lua_pushnumber(L, info.bytes);
+	lua_setfield(L, -2, "bytes");
+
+	lua_pushnumber(L, info.total);
+	lua_setfield(L, -2, "total");
+
+	lua_pushnumber(L, info.part);
+	lua_setfield(L, -2, "part");
+
+	lua_pushstring(L, info.name);
+	lua_setfield(L, -2, "name");
+
+	lua_pushboolean(L, info.status != LH_PROGRESS_RUNNING);
+	lua_setfield(L, -2, "done");
+
+	lua_pushboolean(L, info.status == LH_PROGRESS_FAILED);
+	lua_setfield(L, -2, "failed");
+
+	return 1;
+}
+
+/*
+ * Set the limit of the process wide memory budget which parsers created
+ * afterwards draw from, return the amount of memory in use and the limit.
+ */
+
+static int
+lh_L_memory_budget(lua_State *L)
+{
+	struct lh_budget *b = lh_budget_default();
+
+	if (!lua_isnoneornil(L, 1)) {
+		if (!b) {
+			b = lh_budget_new(0);
+
+			if (!b) {
+				lua_pushnil(L);
+				lua_pushstring(L, "Out of memory");
+				return 2;
+			}
+
+			lh_budget_set_default(b);
+		}
+
+		lh_budget_set_limit(b, luaL_checknumber(L, 1));
+	}
+
+	lua_pushnumber(L, b ? lh_budget_used(b) : 0);
+	lua_pushnumber(L, b ? b->limit : 0);
+	return 2;
+}
+
+
 /*
  * module tables
  * -------------------------------------------------------------------------
  */
 
 static const luaL_reg R_mpart[] = {
-	{ "parse", lh_L_mpart_parse },
-	{ "__gc",  lh_L_mpart__gc   },
+	{ "parse",                 lh_L_mpart_parse                 },
+	{ "set_chunk_size",        lh_L_mpart_set_chunk_size        },
+	{ "set_body_limit",        lh_L_mpart_set_body_limit        },
+	{ "set_inflate_limit",     lh_L_mpart_set_inflate_limit     },
+	{ "set_content_length",    lh_L_mpart_set_content_length    },
+	{ "set_content_encoding",  lh_L_mpart_set_content_encoding  },
+	{ "set_transfer_decoding", lh_L_mpart_set_transfer_decoding },
+	{ "set_progress",          lh_L_mpart_set_progress          },
+	{ "set_tee",               lh_L_mpart_set_tee               },
+	{ "set_form",              lh_L_mpart_set_form              },
+	{ "set_form_path",         lh_L_mpart_set_form_path         },
+	{ "form",                  lh_L_mpart_form                  },
+	{ "form_fd",               lh_L_mpart_form_fd               },
+	{ "field",                 lh_L_mpart_field                 },
+	{ "set_fields",            lh_L_mpart_set_fields            },
+	{ "set_untar",             lh_L_mpart_set_untar             },
+	{ "__gc",                  lh_L_mpart__gc                   },
 	{ }
 };
 
 static const luaL_reg R_urldec[] = {
-	{ "parse", lh_L_urldec_parse },
-	{ "__gc",  lh_L_urldec__gc   },
+	{ "parse",                lh_L_urldec_parse                },
+	{ "parse_tuples",         lh_L_urldec_parse_tuples         },
+	{ "set_body_limit",       lh_L_urldec_set_body_limit       },
+	{ "set_inflate_limit",    lh_L_urldec_set_inflate_limit    },
+	{ "set_content_length",   lh_L_urldec_set_content_length   },
+	{ "set_content_encoding", lh_L_urldec_set_content_encoding },
+	{ "set_tee",              lh_L_urldec_set_tee              },
+	{ "set_form",             lh_L_urldec_set_form             },
+	{ "set_decode",           lh_L_urldec_set_decode           },
+	{ "form",                 lh_L_urldec_form                 },
+	{ "form_fd",              lh_L_urldec_form_fd              },
+	{ "field",                lh_L_urldec_field                },
+	{ "set_fields",           lh_L_urldec_set_fields           },
+	{ "set_paths",            lh_L_urldec_set_paths            },
+	{ "tree",                 lh_L_urldec_tree                 },
+	{ "__gc",                 lh_L_urldec__gc                  },
+	{ }
+};
+
+static const luaL_reg R_untar[] = {
+	{ "parse",  lh_L_untar_parse  },
+	{ "member", lh_L_untar_member },
+	{ "error",  lh_L_untar_error  },
+	{ "__gc",   lh_L_untar__gc    },
 	{ }
 };
 
 static const luaL_reg R[] = {
 	{ "multipart_parser",  lh_L_mpart_new        },
 	{ "urlencoded_parser", lh_L_urldec_new       },
+	{ "untar",             lh_L_untar_new        },
 	{ "urlencode",         lh_L_urlencode        },
 	{ "urldecode",         lh_L_urldecode        },
+	{ "base64_encode",     lh_L_base64_encode    },
+	{ "base64_decode",     lh_L_base64_decode    },
+	{ "query_get",         lh_L_query_get        },
 	{ "header_attribute",  lh_L_header_attribute },
+	{ "header_params",     lh_L_header_params    },
+	{ "progress",          lh_L_progress         },
+	{ "memory_budget",     lh_L_memory_budget    },
 	{ }
 };
 
@@ -431,6 +1658,31 @@ LUALIB_API int luaopen_lucihttp(lua_State *L) {
 	lua_pushnumber(L, LH_UD_CB_ERROR);
 	lua_setfield(L, -2, "ERROR");
 
+	lua_pushnumber(L, LH_UD_CB_SEGMENT);
+	lua_setfield(L, -2, "SEGMENT");
+
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -1, "__index");
+
+
+	luaL_newmetatable(L, LUCIHTTP_UNTAR_META);
+	luaL_register(L, NULL, R_untar);
+
+	lua_pushnumber(L, LH_UT_CB_MEMBER_BEGIN);
+	lua_setfield(L, -2, "MEMBER_BEGIN");
+
+	lua_pushnumber(L, LH_UT_CB_MEMBER_DATA);
+	lua_setfield(L, -2, "MEMBER_DATA");
+
+	lua_pushnumber(L, LH_UT_CB_MEMBER_END);
+	lua_setfield(L, -2, "MEMBER_END");
+
+	lua_pushnumber(L, LH_UT_CB_EOF);
+	lua_setfield(L, -2, "EOF");
+
+	lua_pushnumber(L, LH_UT_CB_ERROR);
+	lua_setfield(L, -2, "ERROR");
+
 	lua_pushvalue(L, -1);
 	lua_setfield(L, -1, "__index");
 
@@ -459,6 +1711,12 @@ LUALIB_API int luaopen_lucihttp(lua_State *L) {
 	lua_pushnumber(L, LH_URLDECODE_PLUS);
 	lua_setfield(L, -2, "DECODE_PLUS");
 
+	lua_pushnumber(L, LH_BASE64_URL);
+	lua_setfield(L, -2, "BASE64_URL");
+
+	lua_pushnumber(L, LH_BASE64_NO_PAD);
+	lua_setfield(L, -2, "BASE64_NO_PAD");
+
 	lua_pushvalue(L, -1);
 	lua_setfield(L, -1, "__index");
 
@@ -19,11 +19,20 @@
 #define _GNU_SOURCE
 
 #include <lucihttp/multipart-parser.h>
+#include <lucihttp/ring-buffer.h>
+#include <lucihttp/progress.h>
+#include <lucihttp/tee.h>
+#include <lucihttp/inflate.h>
+#include <lucihttp/form.h>
+#include <lucihttp/budget.h>
+#include <lucihttp/fieldset.h>
 #include <lucihttp/utils.h>
 
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <errno.h>
 
 
 static const char *lh_mpart_state_descriptions[] = {
@@ -52,7 +61,8 @@ static const char *lh_mpart_token_names[] = {
 	"data",
 	"boundary 1",
 	"boundary 2",
-	"boundary 3"
+	"boundary 3",
+	"decoded data"
 };
 
 
@@ -109,40 +119,99 @@ static bool
 _lh_mpart_invoke(struct lh_mpart *p, enum lh_mpart_callback_type type,
                  const char *typename, const char *buf, size_t len)
 {
+	bool rv = true;
+
 	if (p->trace) {
 		fprintf(p->trace, "Callback %d (%s) ", type, typename);
 		lh_mpart_dump(p->trace, "data", buf, len);
 	}
 
+	/* never pass on data truncated by an exhausted budget */
+	if ((p->flags & LH_MP_F_BUDGET) && type != LH_MP_CB_ERROR)
+		return false;
+
+	if (p->form && type == LH_MP_CB_PART_INIT)
+		lh_form_part_begin(p->form);
+	else if (p->form && type == LH_MP_CB_PART_DATA)
+		lh_form_part_data(p->form, p->flags & LH_MP_F_BUFFERING, buf, len);
+
 	if (p->cb)
-		return p->cb(p, type, buf, len, p->priv);
+		rv = p->cb(p, type, buf, len, p->priv);
 
-	return true;
+	/* let the PART_END callback record the storage path first */
+	if (p->form && type == LH_MP_CB_PART_END)
+		lh_form_part_end(p->form, p->flags & LH_MP_F_BUFFERING);
+
+	if (p->form && p->form->exhausted)
+		p->flags |= LH_MP_F_BUDGET;
+
+	return rv;
 }
 
 #define lh_mpart_invoke(p, type, buf, len) \
 	_lh_mpart_invoke(p, LH_MP_CB_##type, #type, buf, len)
 
 static bool
-lh_mpart_set_token(struct lh_mpart *p, enum lh_mpart_token_type type,
-                   bool clear, const char *buf, size_t len)
+lh_mpart_charge(struct lh_mpart *p, size_t len)
+{
+	if (p->budget && !lh_budget_acquire(p->budget, len)) {
+		p->flags |= LH_MP_F_BUDGET;
+
+		return false;
+	}
+
+	p->reserved += len;
+
+	return true;
+}
+
+static void
+lh_mpart_uncharge(struct lh_mpart *p, size_t len)
+{
+	if (p->budget)
+		lh_budget_release(p->budget, len);
+
+	p->reserved -= len;
+}
+
+static bool
+lh_mpart_reserve_token(struct lh_mpart *p, enum lh_mpart_token_type type,
+                       size_t len)
 {
 	struct lh_mpart_token *tok = &p->token[type];
 	char *tmp;
 
-	if (clear)
-		tok->len = 0;
+	if (len + 1 > tok->size) {
+		if (!lh_mpart_charge(p, len + 1 - tok->size))
+			return false;
 
-	if (len + tok->len + 1 > tok->size) {
-		tmp = realloc(tok->value, len + tok->len + 1);
+		tmp = realloc(tok->value, len + 1);
+
+		if (!tmp) {
+			lh_mpart_uncharge(p, len + 1 - tok->size);
 
-		if (!tmp)
 			return false;
+		}
 
 		tok->value = tmp;
-		tok->size = len + tok->len + 1;
+		tok->size = len + 1;
 	}
 
+	return true;
+}
+
+static bool
+lh_mpart_set_token(struct lh_mpart *p, enum lh_mpart_token_type type,
+                   bool clear, const char *buf, size_t len)
+{
+	struct lh_mpart_token *tok = &p->token[type];
+
+	if (clear)
+		tok->len = 0;
+
+	if (!lh_mpart_reserve_token(p, type, len + tok->len))
+		return false;
+
 	if (len) {
 		memcpy(tok->value + tok->len, buf, len);
 		tok->value[tok->len + len] = 0;
@@ -173,6 +242,21 @@ lh_mpart_get_token(struct lh_mpart *p, enum lh_mpart_token_type type,
 	return NULL;
 }
 
+static bool
+lh_mpart_flush_data(struct lh_mpart *p)
+{
+	size_t len;
+	char *data = lh_mpart_get_token(p, LH_MP_T_DATA, &len);
+
+	if (!data)
+		return true;
+
+	lh_mpart_invoke(p, PART_DATA, data, len);
+	lh_mpart_set_token(p, LH_MP_T_DATA, true, NULL, 0);
+
+	return true;
+}
+
 static char *
 lh_mpart_push_boundary(struct lh_mpart *p, const char *boundary_string,
                        size_t boundary_len)
@@ -187,10 +271,16 @@ lh_mpart_push_boundary(struct lh_mpart *p, const char *boundary_string,
 	lookbehind_size = 2 + 2 + boundary_len + 2 + 2;
 
 	if (lookbehind_size > p->lookbehind_size) {
+		if (!lh_mpart_charge(p, lookbehind_size - p->lookbehind_size))
+			return NULL;
+
 		lookbehind = realloc(p->lookbehind, lookbehind_size);
 
-		if (!lookbehind)
+		if (!lookbehind) {
+			lh_mpart_uncharge(p, lookbehind_size - p->lookbehind_size);
+
 			return NULL;
+		}
 
 		p->lookbehind = lookbehind;
 		p->lookbehind_size = lookbehind_size;
@@ -254,6 +344,13 @@ lh_mpart_error(struct lh_mpart *p, size_t off, const char *fmt, ...)
 
 	lh_mpart_set_state(p, LH_MP_S_ERROR);
 
+	if (p->progress)
+		lh_progress_finish(p->progress,
+		                   p->inflate ? p->received : p->total + off, false);
+
+	if (p->tee)
+		lh_tee_flush(p->tee);
+
 	return false;
 }
 
@@ -276,6 +373,8 @@ lh_mpart_init(struct lh_mpart *p, FILE *trace)
 	p->nesting = -1;
 	p->trace = trace;
 	p->size_limit = LH_MP_T_DEFAULT_SIZE_LIMIT;
+	p->inflate_limit = LH_MP_DEFAULT_INFLATE_LIMIT;
+	p->budget = lh_budget_default();
 
 	lh_mpart_set_state(p, LH_MP_S_START);
 
@@ -296,6 +395,216 @@ lh_mpart_set_size_limit(struct lh_mpart *p, size_t limit)
 		p->size_limit = limit;
 }
 
+/*
+ * Coalesce unbuffered part data into chunks of at least the given size before
+ * invoking the PART_DATA callback. Pending data is flushed when the part ends.
+ * A size of zero disables coalescing and passes data through as it arrives.
+ */
+
+void
+lh_mpart_set_chunk_size(struct lh_mpart *p, size_t size)
+{
+	p->chunk_size = size;
+}
+
+/*
+ * Publish the parsing progress through the given progress file. The parser
+ * counts parts, records the name of each part with buffered headers and marks
+ * the progress as done or failed when reaching the end of the body or an
+ * error. The progress handle is not owned by the parser.
+ */
+
+void
+lh_mpart_set_progress(struct lh_mpart *p, struct lh_progress *pr)
+{
+	p->progress = pr;
+}
+
+/*
+ * Mirror all input data to the given tee, e.g. to keep a replayable copy of
+ * the raw request body. The tee is flushed when reaching the end of the
+ * input or an error. The tee handle is not owned by the parser.
+ */
+
+void
+lh_mpart_set_tee(struct lh_mpart *p, struct lh_tee *t)
+{
+	p->tee = t;
+}
+
+/*
+ * Collect the buffered fields and the size and storage path of other parts
+ * into the given form snapshot. Names are recorded for parts with buffered
+ * headers, the snapshot is complete once the EOF callback is invoked. The
+ * snapshot is drawn from the memory budget of the parser, if it cannot
+ * cover the memory already held by the form, the next parse step fails.
+ * The form handle is not owned by the parser.
+ */
+
+void
+lh_mpart_set_form(struct lh_mpart *p, struct lh_form *f)
+{
+	p->form = f;
+
+	if (f && !lh_form_set_budget(f, p->budget))
+		p->flags |= LH_MP_F_BUDGET;
+}
+
+/*
+ * Draw the token buffers of the parser and the attached form snapshot from
+ * the given memory budget instead of the process wide default one, NULL
+ * disables the accounting. Memory already held by the parser and the form
+ * is moved over to the new budget. Once the budget is exhausted, the parser
+ * fails with an error and sets the LH_MP_F_BUDGET flag. The budget is not
+ * owned by the parser.
+ *
+ * Returns false if the new budget cannot cover the memory already held.
+ */
+
+bool
+lh_mpart_set_budget(struct lh_mpart *p, struct lh_budget *b)
+{
+	struct lh_budget *old = p->budget;
+
+	if (b == old)
+		return true;
+
+	if (b && !lh_budget_acquire(b, p->reserved))
+		return false;
+
+	if (p->form && !lh_form_set_budget(p->form, b)) {
+		if (b)
+			lh_budget_release(b, p->reserved);
+
+		return false;
+	}
+
+	if (old)
+		lh_budget_release(old, p->reserved);
+
+	p->budget = b;
+
+	return true;
+}
+
+/*
+ * Only deliver parts with buffered headers whose Content-Disposition name
+ * is part of the given field set. The data of other parts is skipped without
+ * being buffered, size checked or passed to the PART_BEGIN, PART_DATA and
+ * PART_END callbacks. NULL accepts all names again. The field set is not
+ * owned by the parser.
+ */
+
+void
+lh_mpart_set_fields(struct lh_mpart *p, struct lh_fieldset *s)
+{
+	p->fields = s;
+}
+
+/*
+ * Limit the total size of the multipart body. Bodies declaring a larger
+ * length through lh_mpart_set_content_length() are rejected up front.
+ * A limit of zero disables the check.
+ */
+
+void
+lh_mpart_set_body_limit(struct lh_mpart *p, size_t limit)
+{
+	p->body_limit = limit;
+}
+
+/*
+ * Limit the amount of data decompressed from a gzip or deflate encoded body,
+ * independently of the body limit which applies to the encoded data. Bodies
+ * inflating beyond it are rejected with an error. The limit defaults to
+ * LH_MP_DEFAULT_INFLATE_LIMIT bytes, zero disables the check.
+ */
+
+void
+lh_mpart_set_inflate_limit(struct lh_mpart *p, size_t limit)
+{
+	p->inflate_limit = limit;
+}
+
+/*
+ * Declare the expected total length of the multipart body, usually taken
+ * from the CONTENT_LENGTH environment variable.
+ *
+ * The parser uses the length to presize its internal buffers, raises an
+ * error as soon as the input exceeds the declared length and reports a
+ * truncated body as soon as the declared amount of bytes is consumed without
+ * reaching the end of the multipart body.
+ *
+ * Returns false and puts the parser into error state if the length exceeds
+ * the configured body limit.
+ */
+
+bool
+lh_mpart_set_content_length(struct lh_mpart *p, size_t len)
+{
+	size_t reserve;
+
+	if (p->body_limit && len > p->body_limit)
+		return lh_mpart_error(p, 0, "the declared body length of %lu bytes "
+		                            "exceeds the maximum allowed size",
+		                      (unsigned long)len);
+
+	reserve = (p->chunk_size > p->size_limit) ? p->chunk_size : p->size_limit;
+
+	lh_mpart_reserve_token(p, LH_MP_T_DATA, (len < reserve) ? len : reserve);
+
+	/* presizing is best effort, an exhausted budget is not an error yet */
+	p->flags &= ~LH_MP_F_BUDGET;
+
+	p->content_length = len;
+	p->flags |= LH_MP_F_LENGTH;
+
+	return true;
+}
+
+/*
+ * Set the content encoding of the body. Bodies encoded with gzip or deflate
+ * are decompressed on the fly before being parsed, the amount of
+ * decompressed data is subject to the configured inflate limit. Passing NULL
+ * or "identity" disables the decompression.
+ *
+ * Returns false if the encoding is not supported.
+ */
+
+bool
+lh_mpart_set_content_encoding(struct lh_mpart *p, const char *encoding)
+{
+	if (!encoding || !strcasecmp(encoding, "identity")) {
+		if (p->inflate)
+			lh_inflate_free(p->inflate);
+
+		p->inflate = NULL;
+
+		return true;
+	}
+
+	if (!lh_inflate_supported(encoding))
+		return false;
+
+	if (!p->inflate)
+		p->inflate = lh_inflate_new(0);
+
+	return !!p->inflate;
+}
+
+/*
+ * Decode the data of parts declaring a base64 Content-Transfer-Encoding
+ * before passing it to the PART_DATA callback. Invalid base64 data fails
+ * the parser with an error. Decoding is disabled by default, so that
+ * the part data is delivered as sent.
+ */
+
+void
+lh_mpart_set_transfer_decoding(struct lh_mpart *p, bool enable)
+{
+	p->transfer_decoding = enable;
+}
+
 char *
 lh_mpart_parse_boundary(struct lh_mpart *p, const char *value, size_t *len)
 {
@@ -319,12 +628,328 @@ lh_mpart_parse_boundary(struct lh_mpart *p, const char *value, size_t *len)
 	return rv;
 }
 
+static bool
+lh_mpart_store_data(struct lh_mpart *p, size_t off, const char *buf,
+                    size_t len)
+{
+	size_t l;
+
+	if (p->flags & LH_MP_F_BUFFERING) {
+		lh_mpart_get_token(p, LH_MP_T_DATA, &l);
+
+		if (l + len > p->size_limit)
+			return lh_mpart_error(p, off, "the value exceeds the "
+			                              "maximum allow size");
+
+		if (!lh_mpart_set_token(p, LH_MP_T_DATA, false, buf, len))
+			goto oom;
+	}
+	else if (p->chunk_size) {
+		if (!lh_mpart_set_token(p, LH_MP_T_DATA, false, buf, len))
+			goto oom;
+
+		lh_mpart_get_token(p, LH_MP_T_DATA, &l);
+
+		if (l >= p->chunk_size)
+			return lh_mpart_flush_data(p);
+	}
+	else {
+		lh_mpart_invoke(p, PART_DATA, buf, len);
+	}
+
+	return true;
+
+oom:
+	/* an exhausted budget is reported by the parse loop */
+	if (p->flags & LH_MP_F_BUDGET)
+		return true;
+
+	return lh_mpart_error(p, off, "out of memory");
+}
+
+/*
+ * Pass the raw data of a part on, decoding it first if the part declared
+ * a base64 Content-Transfer-Encoding. The decoded bytes are staged in a
+ * token of their own which is reused for each piece of data.
+ */
+static bool
+lh_mpart_append_data(struct lh_mpart *p, size_t off, const char *buf,
+                     size_t len)
+{
+	ssize_t n;
+
+	if (p->flags & LH_MP_F_SKIP)
+		return true;
+
+	if (!(p->flags & LH_MP_F_BASE64))
+		return lh_mpart_store_data(p, off, buf, len);
+
+	if (!lh_mpart_reserve_token(p, LH_MP_T_DECODED,
+	                            LH_BASE64_DECODED_SIZE(len))) {
+		if (p->flags & LH_MP_F_BUDGET)
+			return true;
+
+		return lh_mpart_error(p, off, "out of memory");
+	}
+
+	n = lh_base64_decode_update(&p->base64, buf, len,
+	                            p->token[LH_MP_T_DECODED].value);
+
+	if (n < 0)
+		return lh_mpart_error(p, off, "the part data is not valid base64");
+
+	return lh_mpart_store_data(p, off, p->token[LH_MP_T_DECODED].value, n);
+}
+
+/*
+ * Decode the bytes of an unpadded final base64 group at the end of a part.
+ */
+static bool
+lh_mpart_finish_data(struct lh_mpart *p, size_t off)
+{
+	char tail[2];
+	ssize_t n;
+
+	if (!(p->flags & LH_MP_F_BASE64))
+		return true;
+
+	p->flags &= ~LH_MP_F_BASE64;
+	n = lh_base64_decode_final(&p->base64, tail);
+
+	if (n < 0)
+		return lh_mpart_error(p, off, "the part data is not valid base64");
+
+	return lh_mpart_store_data(p, off, tail, n);
+}
+
+static void
+lh_mpart_init_part(struct lh_mpart *p)
+{
+	if (lh_mpart_invoke(p, PART_INIT, NULL, 0))
+		p->flags |= LH_MP_F_BUFFERING;
+	else
+		p->flags &= ~LH_MP_F_BUFFERING;
+
+	/* with a field set, parts are unwanted until their name matches */
+	if (p->fields)
+		p->flags |= LH_MP_F_SKIP;
+	else
+		p->flags &= ~LH_MP_F_SKIP;
+
+	p->flags &= ~LH_MP_F_BASE64;
+
+	if (p->progress)
+		lh_progress_next_part(p->progress);
+}
+
+/*
+ * Handle the Content-Disposition header of a part. The field name is only
+ * looked up and decoded once for both the progress file and the field set.
+ */
+static void
+lh_mpart_disposition(struct lh_mpart *p, const char *hvalue, size_t len)
+{
+	char buf[128], *name = buf;
+	ssize_t l;
+
+	if (p->form)
+		lh_form_part_disposition(p->form, hvalue, len);
+
+	if (!p->progress && !p->fields)
+		return;
+
+	/* field names usually fit on the stack, allocate only for long ones */
+	l = lh_header_attribute_into(hvalue, len, "name", buf, sizeof(buf));
+
+	if (l < 0)
+		return;
+
+	if ((size_t)l >= sizeof(buf)) {
+		name = lh_header_attribute(hvalue, len, "name", NULL);
+
+		if (!name)
+			return;
+	}
+
+	if (p->progress)
+		lh_progress_set_name(p->progress, name, l);
+
+	if (p->fields && lh_fieldset_match(p->fields, name, l))
+		p->flags &= ~LH_MP_F_SKIP;
+
+	if (name != buf)
+		free(name);
+}
+
+/*
+ * Handle the Content-Transfer-Encoding header of a part if transfer decoding
+ * is enabled. Only base64 needs work, the identity encodings are passed
+ * through as-is.
+ */
+static void
+lh_mpart_transfer_encoding(struct lh_mpart *p, const char *hvalue, size_t len)
+{
+	if (!p->transfer_decoding)
+		return;
+
+	while (len && (*hvalue == ' ' || *hvalue == '\t')) {
+		hvalue++;
+		len--;
+	}
+
+	while (len && (hvalue[len - 1] == ' ' || hvalue[len - 1] == '\t'))
+		len--;
+
+	if (len == 6 && !strncasecmp(hvalue, "base64", 6)) {
+		lh_base64_init(&p->base64, 0);
+		p->flags |= LH_MP_F_BASE64;
+	}
+	else {
+		p->flags &= ~LH_MP_F_BASE64;
+	}
+}
+
+static void
+lh_mpart_emit_header(struct lh_mpart *p)
+{
+	size_t namelen, valuelen;
+	char *hname, *hvalue;
+
+	hname = lh_mpart_get_token(p, LH_MP_T_HEADER_NAME, &namelen);
+	hvalue = lh_mpart_get_token(p, LH_MP_T_HEADER_VALUE, &valuelen);
+
+	if (hname && hvalue && !strcasecmp(hname, "Content-Type") &&
+	    lh_mpart_parse_boundary(p, hvalue, NULL))
+		p->flags |= LH_MP_F_IS_NESTED;
+
+	if (hname && hvalue && !strcasecmp(hname, "Content-Disposition"))
+		lh_mpart_disposition(p, hvalue, valuelen);
+
+	if (hname && hvalue && !strcasecmp(hname, "Content-Transfer-Encoding"))
+		lh_mpart_transfer_encoding(p, hvalue, valuelen);
+
+	if (hname && (p->flags & LH_MP_F_BUFFERING)) {
+		lh_mpart_invoke(p, HEADER_NAME, hname, namelen);
+		lh_mpart_invoke(p, HEADER_VALUE, hvalue, valuelen);
+	}
+
+	lh_mpart_set_token(p, LH_MP_T_HEADER_NAME, true, NULL, 0);
+	lh_mpart_set_token(p, LH_MP_T_HEADER_VALUE, true, NULL, 0);
+}
+
+static const char *
+lh_mpart_skip_space(const char *s, const char *e)
+{
+	while (s < e && (*s == ' ' || *s == '\t'))
+		s++;
+
+	return s;
+}
+
+/*
+ * Fast path for the common case of a complete part header block within the
+ * current buffer. Validates the block up to the terminating empty line first,
+ * then emits all headers in one go without going through the byte wise state
+ * machine. Returns the number of consumed bytes or 0 if the block is
+ * incomplete or anything unusual is found, in which case the caller falls
+ * back to the generic state machine which handles and reports these cases.
+ */
+
+static size_t
+lh_mpart_parse_headers(struct lh_mpart *p, const char *buf, size_t off,
+                       size_t len)
+{
+	bool buffering = (p->flags & LH_MP_F_BUFFERING);
+	const char *s = buf + off, *e = buf + len;
+	const char *line, *eol, *colon, *value;
+	size_t valuelen = 0;
+
+	for (line = s; ; line = eol + 2) {
+		eol = memchr(line, '\r', e - line);
+
+		if (!eol || eol + 1 >= e || eol[1] != '\n')
+			return 0;
+
+		if (eol == line)
+			break;
+
+		if (*line == ' ' || *line == '\t') {
+			if (line == s)
+				return 0;
+
+			valuelen += 1 + (eol - lh_mpart_skip_space(line, eol));
+		}
+		else {
+			colon = memchr(line, ':', eol - line);
+
+			if (!colon)
+				return 0;
+
+			if (buffering && colon - line > p->size_limit)
+				return 0;
+
+			valuelen = eol - lh_mpart_skip_space(colon + 1, eol);
+		}
+
+		if (buffering && valuelen > p->size_limit)
+			return 0;
+	}
+
+	e = eol;
+
+	for (line = s; line < e; line = eol + 2) {
+		eol = memchr(line, '\r', e - line);
+
+		if (*line == ' ' || *line == '\t') {
+			value = lh_mpart_skip_space(line, eol);
+
+			if (buffering) {
+				lh_mpart_set_token(p, LH_MP_T_HEADER_VALUE, false, " ", 1);
+				lh_mpart_set_token(p, LH_MP_T_HEADER_VALUE, false,
+				                   value, eol - value);
+			}
+			else {
+				lh_mpart_invoke(p, HEADER_VALUE, value, eol - value);
+			}
+
+			continue;
+		}
+
+		colon = memchr(line, ':', eol - line);
+		value = lh_mpart_skip_space(colon + 1, eol);
+
+		if (buffering) {
+			lh_mpart_emit_header(p);
+			lh_mpart_set_token(p, LH_MP_T_HEADER_NAME, true,
+			                   line, colon - line);
+			lh_mpart_set_token(p, LH_MP_T_HEADER_VALUE, true,
+			                   value, eol - value);
+		}
+		else {
+			lh_mpart_invoke(p, HEADER_NAME, line, colon - line);
+			lh_mpart_invoke(p, HEADER_VALUE, value, eol - value);
+		}
+	}
+
+	lh_mpart_emit_header(p);
+
+	if (p->flags & LH_MP_F_IS_NESTED) {
+		p->flags &= ~LH_MP_F_IS_NESTED;
+		lh_mpart_set_state(p, LH_MP_S_START);
+	}
+	else {
+		lh_mpart_set_state(p, LH_MP_S_PART_START);
+	}
+
+	return (e + 2) - s;
+}
+
 static bool
 lh_mpart_step(struct lh_mpart *p, const char *buf, size_t off, int c,
               bool buffer_end)
 {
 	size_t boundary_len = 0, l, namelen, valuelen;
-	char *boundary, *hname, *hvalue, *s;
+	char *boundary, *hvalue;
 
 	boundary = lh_mpart_get_boundary(p, &boundary_len);
 
@@ -358,11 +983,7 @@ lh_mpart_step(struct lh_mpart *p, const char *buf, size_t off, int c,
 
 			p->index = 0;
 
-			if (lh_mpart_invoke(p, PART_INIT, NULL, 0))
-				p->flags |= LH_MP_F_BUFFERING;
-			else
-				p->flags &= ~LH_MP_F_BUFFERING;
-
+			lh_mpart_init_part(p);
 			lh_mpart_set_state(p, LH_MP_S_HEADER_START);
 		}
 		else {
@@ -389,26 +1010,7 @@ lh_mpart_step(struct lh_mpart *p, const char *buf, size_t off, int c,
 			break;
 		}
 
-		hname = lh_mpart_get_token(p, LH_MP_T_HEADER_NAME, &namelen);
-		hvalue = lh_mpart_get_token(p, LH_MP_T_HEADER_VALUE, &valuelen);
-
-		if (hname && hvalue && !strcasecmp(hname, "Content-Type")) {
-			s = lh_mpart_parse_boundary(p, hvalue, &l);
-
-			if (s) {
-				boundary = s;
-				boundary_len = l;
-				p->flags |= LH_MP_F_IS_NESTED;
-			}
-		}
-
-		if (hname && (p->flags & LH_MP_F_BUFFERING)) {
-			lh_mpart_invoke(p, HEADER_NAME, hname, namelen);
-			lh_mpart_invoke(p, HEADER_VALUE, hvalue, valuelen);
-		}
-
-		lh_mpart_set_token(p, LH_MP_T_HEADER_NAME, true, NULL, 0);
-		lh_mpart_set_token(p, LH_MP_T_HEADER_VALUE, true, NULL, 0);
+		lh_mpart_emit_header(p);
 		lh_mpart_set_state(p, LH_MP_S_HEADER);
 
 		p->flags &= ~LH_MP_F_PAST_NAME;
@@ -486,6 +1088,9 @@ lh_mpart_step(struct lh_mpart *p, const char *buf, size_t off, int c,
 
 					lh_mpart_set_token(p, LH_MP_T_HEADER_VALUE, false,
 					                   " ", 1);
+
+					/* only join once, not at every buffer end */
+					p->flags &= ~LH_MP_F_MULTILINE;
 				}
 
 				if (l + valuelen > p->size_limit)
@@ -515,7 +1120,13 @@ lh_mpart_step(struct lh_mpart *p, const char *buf, size_t off, int c,
 		break;
 
 	case LH_MP_S_PART_START:
-		if (lh_mpart_invoke(p, PART_BEGIN, NULL, 0))
+		/* the name of parts with streamed headers is unknown */
+		if (!(p->flags & LH_MP_F_BUFFERING))
+			p->flags &= ~LH_MP_F_SKIP;
+
+		if (p->flags & LH_MP_F_SKIP)
+			p->flags &= ~LH_MP_F_BUFFERING;
+		else if (lh_mpart_invoke(p, PART_BEGIN, NULL, 0))
 			p->flags |= LH_MP_F_BUFFERING;
 		else
 			p->flags &= ~LH_MP_F_BUFFERING;
@@ -533,21 +1144,8 @@ lh_mpart_step(struct lh_mpart *p, const char *buf, size_t off, int c,
 			if (p->flags & LH_MP_F_IN_PART) {
 				valuelen = (off - p->offset) + (c != '\r');
 
-				if (p->flags & LH_MP_F_BUFFERING) {
-					lh_mpart_get_token(p, LH_MP_T_DATA, &l);
-
-					if (l + valuelen > p->size_limit)
-						return lh_mpart_error(p, off,
-						                      "the value exceeds the "
-						                      "maximum allow size");
-
-					lh_mpart_set_token(p, LH_MP_T_DATA, false,
-					                   buf + p->offset, valuelen);
-				}
-				else {
-					lh_mpart_invoke(p, PART_DATA,
-					                buf + p->offset, valuelen);
-				}
+				if (!lh_mpart_append_data(p, off, buf + p->offset, valuelen))
+					return false;
 			}
 
 			if (c == '\r') {
@@ -569,22 +1167,9 @@ lh_mpart_step(struct lh_mpart *p, const char *buf, size_t off, int c,
 		else {
 			valuelen = 1 + (c != '\r');
 
-			if (p->flags & LH_MP_F_IN_PART) {
-				if (p->flags & LH_MP_F_BUFFERING) {
-					lh_mpart_get_token(p, LH_MP_T_DATA, &l);
-
-					if (l + valuelen > p->size_limit)
-						return lh_mpart_error(p, off,
-						                      "the value exceeds the "
-						                      "maximum allow size");
-
-					lh_mpart_set_token(p, LH_MP_T_DATA, false,
-					                   p->lookbehind, valuelen);
-				}
-				else {
-					lh_mpart_invoke(p, PART_DATA, p->lookbehind, valuelen);
-				}
-			}
+			if ((p->flags & LH_MP_F_IN_PART) &&
+			    !lh_mpart_append_data(p, off, p->lookbehind, valuelen))
+				return false;
 
 			if (c != '\r') {
 				p->offset = off + 1;
@@ -601,23 +1186,9 @@ lh_mpart_step(struct lh_mpart *p, const char *buf, size_t off, int c,
 				p->index++;
 			}
 
-			if (p->flags & LH_MP_F_IN_PART) {
-				if (p->flags & LH_MP_F_BUFFERING) {
-					lh_mpart_get_token(p, LH_MP_T_DATA, &l);
-
-					if (l + p->index + 2 > p->size_limit)
-						return lh_mpart_error(p, off,
-						                      "the value exceeds the "
-						                      "maximum allow size");
-
-					lh_mpart_set_token(p, LH_MP_T_DATA, false,
-					                   p->lookbehind, p->index + 2);
-				}
-				else {
-					lh_mpart_invoke(p, PART_DATA, p->lookbehind,
-					                              p->index + 2);
-				}
-			}
+			if ((p->flags & LH_MP_F_IN_PART) &&
+			    !lh_mpart_append_data(p, off, p->lookbehind, p->index + 2))
+				return false;
 
 			if (c == '\r') {
 				p->offset = off;
@@ -634,6 +1205,17 @@ lh_mpart_step(struct lh_mpart *p, const char *buf, size_t off, int c,
 			p->index++;
 
 			if ((p->index - 2) == boundary_len) {
+				if (!(p->flags & LH_MP_F_SKIP) &&
+				    !lh_mpart_finish_data(p, off))
+					return false;
+
+				if (p->flags & LH_MP_F_SKIP) {
+					p->flags &= ~LH_MP_F_SKIP;
+					p->flags &= ~LH_MP_F_IN_PART;
+					lh_mpart_set_state(p, LH_MP_S_PART_BOUNDARY_END);
+					break;
+				}
+
 				if (p->flags & LH_MP_F_BUFFERING) {
 					hvalue = lh_mpart_get_token(p, LH_MP_T_DATA,
 					                            &valuelen);
@@ -643,6 +1225,9 @@ lh_mpart_step(struct lh_mpart *p, const char *buf, size_t off, int c,
 					else
 						lh_mpart_invoke(p, PART_DATA, "", 0);
 				}
+				else if (p->chunk_size) {
+					lh_mpart_flush_data(p);
+				}
 
 				lh_mpart_invoke(p, PART_END, NULL, 0);
 				lh_mpart_set_state(p, LH_MP_S_PART_BOUNDARY_END);
@@ -688,11 +1273,7 @@ lh_mpart_step(struct lh_mpart *p, const char *buf, size_t off, int c,
 
 	case LH_MP_S_PART_END:
 		if (c == '\n') {
-			if (lh_mpart_invoke(p, PART_INIT, NULL, 0))
-				p->flags |= LH_MP_F_BUFFERING;
-			else
-				p->flags &= ~LH_MP_F_BUFFERING;
-
+			lh_mpart_init_part(p);
 			lh_mpart_set_state(p, LH_MP_S_HEADER_START);
 		}
 		else {
@@ -717,6 +1298,11 @@ lh_mpart_step(struct lh_mpart *p, const char *buf, size_t off, int c,
 
 			p->index++;
 			lh_mpart_invoke(p, EOF, NULL, 0);
+
+			if (p->progress)
+				lh_progress_finish(p->progress, p->inflate ? p->received
+				                                           : p->total + off + 1,
+				                   true);
 		}
 		else if (c > EOF) {
 			return lh_mpart_error(p, off, "expected EOF, but got "
@@ -733,28 +1319,173 @@ lh_mpart_step(struct lh_mpart *p, const char *buf, size_t off, int c,
 	return true;
 }
 
-bool
-lh_mpart_parse(struct lh_mpart *p, const char *buf, size_t len)
+static bool
+lh_mpart_parse_data(struct lh_mpart *p, const char *buf, size_t len)
 {
-	size_t i;
+	size_t i, n;
 
 	p->offset = 0;
 
-	if (p->trace)
-		lh_mpart_dump(p->trace, "Parsing buffer", buf, len);
+	for (i = 0; i < len; i++) {
+		/* try to consume an entire header block at once */
+		if (p->state == LH_MP_S_HEADER_START &&
+		    !(p->flags & LH_MP_F_PAST_NAME))
+			n = lh_mpart_parse_headers(p, buf, i, len);
+		else
+			n = 0;
 
-	for (i = 0; i < len; i++)
-		if (!lh_mpart_step(p, buf, i, (unsigned char)buf[i], i + 1 == len))
+		if (n)
+			i += n - 1;
+		else if (!lh_mpart_step(p, buf, i, (unsigned char)buf[i],
+		                        i + 1 == len))
 			return false;
 
+		if (p->flags & LH_MP_F_BUDGET)
+			return lh_mpart_error(p, i, "the memory budget is exhausted");
+	}
+
 	if (!buf && !lh_mpart_step(p, NULL, 0, EOF, true))
 		return false;
 
+	if (p->flags & LH_MP_F_BUDGET)
+		return lh_mpart_error(p, i, "the memory budget is exhausted");
+
 	p->total += i;
 
 	return true;
 }
 
+static bool
+lh_mpart_inflate_cb(const char *buf, size_t len, void *priv)
+{
+	return lh_mpart_parse_data(priv, buf, len);
+}
+
+static bool
+lh_mpart_parse_inflate(struct lh_mpart *p, const char *buf, size_t len)
+{
+	lh_inflate_set_limit(p->inflate, p->inflate_limit);
+
+	if (!lh_inflate_parse(p->inflate, buf, len, lh_mpart_inflate_cb, p)) {
+		if (p->inflate->error)
+			return lh_mpart_error(p, 0, "%s", p->inflate->error);
+
+		return false;
+	}
+
+	return buf ? true : lh_mpart_parse_data(p, NULL, 0);
+}
+
+bool
+lh_mpart_parse(struct lh_mpart *p, const char *buf, size_t len)
+{
+	if (p->trace)
+		lh_mpart_dump(p->trace, "Parsing buffer", buf, len);
+
+	if (p->tee && !(buf ? lh_tee_write(p->tee, buf, len)
+	                    : lh_tee_flush(p->tee)))
+		return lh_mpart_error(p, 0, "unable to write the body copy: %s",
+		                      strerror(errno));
+
+	if ((p->flags & LH_MP_F_LENGTH) && p->state != LH_MP_S_ERROR) {
+		if (len > p->content_length - p->received)
+			return lh_mpart_error(p, p->content_length - p->received,
+			                      "the body exceeds the declared length "
+			                      "of %lu bytes",
+			                      (unsigned long)p->content_length);
+
+		if (!buf && p->received < p->content_length)
+			return lh_mpart_error(p, 0, "the body is truncated, got %lu of "
+			                            "%lu declared bytes",
+			                      (unsigned long)p->received,
+			                      (unsigned long)p->content_length);
+	}
+
+	p->received += len;
+
+	if (p->inflate) {
+		if (!lh_mpart_parse_inflate(p, buf, len))
+			return false;
+	}
+	else if (!lh_mpart_parse_data(p, buf, len)) {
+		return false;
+	}
+
+	if (p->progress)
+		lh_progress_update(p->progress, p->received, p->content_length);
+
+	if ((p->flags & LH_MP_F_LENGTH) && len &&
+	    p->received == p->content_length &&
+	    (p->state != LH_MP_S_END || p->index < 2))
+		return lh_mpart_error(p, 0, "the body is truncated at the declared "
+		                            "length of %lu bytes",
+		                      (unsigned long)p->content_length);
+
+	return true;
+}
+
+static size_t
+lh_mpart_partial_delimiter(struct lh_mpart *p, const char *buf, size_t len)
+{
+	const char *dashes = "\r\n--";
+	size_t blen, i, n;
+	char *boundary;
+
+	boundary = lh_mpart_get_boundary(p, &blen);
+
+	if (!boundary)
+		return 0;
+
+	for (i = (len > blen + 3) ? len - (blen + 3) : 0; i < len; i++) {
+		if (buf[i] != '\r')
+			continue;
+
+		for (n = 0; i + n < len; n++)
+			if (buf[i + n] != ((n < 4) ? dashes[n] : boundary[n - 4]))
+				break;
+
+		if (i + n == len)
+			return n;
+	}
+
+	return 0;
+}
+
+/*
+ * Parse the readable contents of the given ring buffer and consume them.
+ *
+ * Unless eof is set, a trailing incomplete "\r\n--boundary" delimiter is left
+ * in the ring, so that it is seen in one piece by the next invocation instead
+ * of being split into lookbehind fragments. When eof is set, all remaining
+ * data is parsed and the parser is notified about the end of the input.
+ */
+
+bool
+lh_mpart_parse_ring(struct lh_mpart *p, struct lh_ring *r, bool eof)
+{
+	size_t len, keep = 0;
+	const char *buf;
+
+	buf = lh_ring_read_ptr(r, &len);
+
+	if (!eof)
+		keep = lh_mpart_partial_delimiter(p, buf, len);
+
+	/* never stall on a completely filled ring */
+	if (keep == len && len == r->size)
+		keep = 0;
+
+	if (len > keep && !lh_mpart_parse(p, buf, len - keep))
+		return false;
+
+	lh_ring_consume(r, len - keep);
+
+	if (eof)
+		return lh_mpart_parse(p, NULL, 0);
+
+	return true;
+}
+
 void
 lh_mpart_free(struct lh_mpart *p)
 {
@@ -766,9 +1497,15 @@ lh_mpart_free(struct lh_mpart *p)
 	if (p->lookbehind)
 		free(p->lookbehind);
 
+	if (p->inflate)
+		lh_inflate_free(p->inflate);
+
 	for (i = 0; i < __LH_MP_T_COUNT; i++)
 		if (p->token[i].value)
 			free(p->token[i].value);
 
+	if (p->budget)
+		lh_budget_release(p->budget, p->reserved);
+
 	free(p);
 }
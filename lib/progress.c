@@ -0,0 +1,273 @@
+/*
+ * lucihttp - HTTP utility library - upload progress component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <lucihttp/progress.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#define store(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELAXED)
+#define load(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+
+static struct lh_progress *
+lh_progress_map(int fd, bool writable)
+{
+	struct lh_progress *pr;
+	void *shm;
+
+	pr = calloc(1, sizeof(*pr));
+
+	if (!pr)
+		return NULL;
+
+	shm = mmap(NULL, sizeof(*pr->shm),
+	           writable ? PROT_READ|PROT_WRITE : PROT_READ,
+	           MAP_SHARED, fd, 0);
+
+	if (shm == MAP_FAILED) {
+		free(pr);
+
+		return NULL;
+	}
+
+	pr->shm = shm;
+	pr->writable = writable;
+
+	return pr;
+}
+
+/*
+ * Create the given progress file and map it for writing.
+ *
+ * The file is set up under a temporary name and renamed into place once it
+ * is fully sized, so that readers never map a truncated file. An existing
+ * progress file is replaced, readers still attached to it keep seeing the
+ * old counters.
+ *
+ * The counters in the file are updated whenever at least the given interval
+ * of bytes has been consumed since the last update. An interval of zero
+ * selects the default of 64KB.
+ *
+ * Returns NULL and sets errno if the file cannot be created or mapped.
+ */
+
+struct lh_progress *
+lh_progress_open(const char *path, size_t interval)
+{
+	struct lh_progress *pr = NULL;
+	char *tmp;
+	int fd, err;
+
+	if (asprintf(&tmp, "%s.XXXXXX", path) == -1)
+		return NULL;
+
+	fd = mkostemp(tmp, O_CLOEXEC);
+
+	if (fd == -1)
+		goto err;
+
+	if (fchmod(fd, 0644) == -1 || ftruncate(fd, sizeof(*pr->shm)) == -1)
+		goto err_fd;
+
+	pr = lh_progress_map(fd, true);
+
+	if (!pr)
+		goto err_fd;
+
+	pr->interval = interval ? interval : LH_PROGRESS_DEFAULT_INTERVAL;
+
+	store(&pr->shm->magic, LH_PROGRESS_MAGIC);
+
+	if (rename(tmp, path) == -1)
+		goto err_fd;
+
+	close(fd);
+	free(tmp);
+
+	return pr;
+
+err_fd:
+	err = errno;
+
+	if (pr)
+		lh_progress_close(pr);
+
+	close(fd);
+	unlink(tmp);
+	errno = err;
+
+err:
+	free(tmp);
+
+	return NULL;
+}
+
+/*
+ * Map an existing progress file read-only. Once attached, the progress can
+ * be polled with lh_progress_read() without any further system calls.
+ *
+ * Returns NULL and sets errno if the file cannot be opened or mapped, or to
+ * EINVAL if it is too short to be a progress file.
+ */
+
+struct lh_progress *
+lh_progress_attach(const char *path)
+{
+	struct lh_progress *pr = NULL;
+	struct stat st;
+	int fd, err;
+
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+
+	if (fd == -1)
+		return NULL;
+
+	if (fstat(fd, &st) == -1)
+		goto out;
+
+	if (!S_ISREG(st.st_mode) || st.st_size < (off_t)sizeof(*pr->shm)) {
+		errno = EINVAL;
+		goto out;
+	}
+
+	pr = lh_progress_map(fd, false);
+
+out:
+	err = errno;
+	close(fd);
+	errno = err;
+
+	return pr;
+}
+
+void
+lh_progress_update(struct lh_progress *pr, size_t bytes, size_t total)
+{
+	if (!pr->writable || bytes - pr->last < pr->interval)
+		return;
+
+	store(&pr->shm->bytes, bytes);
+	store(&pr->shm->total, total);
+
+	pr->last = bytes;
+}
+
+void
+lh_progress_next_part(struct lh_progress *pr)
+{
+	if (!pr->writable)
+		return;
+
+	store(&pr->shm->part, load(&pr->shm->part) + 1);
+
+	lh_progress_set_name(pr, NULL, 0);
+}
+
+/*
+ * The part name cannot be updated atomically, so guard it with a sequence
+ * counter which is odd while the name is being written. Readers retry until
+ * they observe the same even sequence before and after copying the name.
+ */
+
+void
+lh_progress_set_name(struct lh_progress *pr, const char *name, size_t len)
+{
+	uint32_t seq;
+
+	if (!pr->writable)
+		return;
+
+	if (len >= sizeof(pr->shm->name))
+		len = sizeof(pr->shm->name) - 1;
+
+	seq = load(&pr->shm->seq);
+
+	store(&pr->shm->seq, seq + 1);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	if (len)
+		memcpy(pr->shm->name, name, len);
+
+	pr->shm->name[len] = 0;
+
+	__atomic_store_n(&pr->shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void
+lh_progress_finish(struct lh_progress *pr, size_t bytes, bool success)
+{
+	if (!pr->writable)
+		return;
+
+	store(&pr->shm->bytes, bytes);
+	store(&pr->shm->status,
+	      success ? LH_PROGRESS_DONE : LH_PROGRESS_FAILED);
+
+	pr->last = bytes;
+}
+
+/*
+ * Take a consistent snapshot of the progress information.
+ *
+ * Returns false if the mapped file is not a valid progress file.
+ */
+
+bool
+lh_progress_read(struct lh_progress *pr, struct lh_progress_info *info)
+{
+	uint32_t seq;
+
+	if (load(&pr->shm->magic) != LH_PROGRESS_MAGIC)
+		return false;
+
+	do {
+		seq = __atomic_load_n(&pr->shm->seq, __ATOMIC_ACQUIRE);
+
+		if (seq & 1)
+			continue;
+
+		memcpy(info->name, pr->shm->name, sizeof(info->name));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) || seq != load(&pr->shm->seq));
+
+	info->name[sizeof(info->name) - 1] = 0;
+	info->bytes = load(&pr->shm->bytes);
+	info->total = load(&pr->shm->total);
+	info->part = load(&pr->shm->part);
+	info->status = load(&pr->shm->status);
+
+	return true;
+}
+
+void
+lh_progress_close(struct lh_progress *pr)
+{
+	if (pr->shm)
+		munmap(pr->shm, sizeof(*pr->shm));
+
+	free(pr);
+}
@@ -0,0 +1,199 @@
+/*
+ * lucihttp - HTTP utility library - mirrored ring buffer component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <lucihttp/ring-buffer.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+
+/*
+ * Allocate a ring buffer of at least the given size, rounded up to a multiple
+ * of the page size.
+ *
+ * The backing memory is mapped twice back to back, so that any window of up
+ * to size bytes starting within the first mapping is contiguous in memory,
+ * regardless of whether it wraps around the end of the buffer.
+ *
+ * Returns NULL and sets errno if the memory cannot be mapped, or to EINVAL if
+ * the size is too large to be mapped twice.
+ */
+
+struct lh_ring *
+lh_ring_new(size_t size)
+{
+	size_t pagesize = sysconf(_SC_PAGESIZE);
+	struct lh_ring *r;
+	char *base;
+	int fd, err;
+
+	if (!size)
+		size = pagesize;
+
+	/* both the page rounding and the doubled reservation must not wrap */
+	if (size > SIZE_MAX / 2 - pagesize) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	size = (size + pagesize - 1) & ~(pagesize - 1);
+
+	r = calloc(1, sizeof(*r));
+
+	if (!r)
+		return NULL;
+
+	fd = memfd_create("lucihttp-ring", MFD_CLOEXEC);
+
+	if (fd == -1)
+		goto err;
+
+	if (ftruncate(fd, size) == -1)
+		goto err_fd;
+
+	/* reserve twice the size of address space, then overlay both halves */
+	base = mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+
+	if (base == MAP_FAILED)
+		goto err_fd;
+
+	if (mmap(base, size, PROT_READ|PROT_WRITE,
+	         MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED ||
+	    mmap(base + size, size, PROT_READ|PROT_WRITE,
+	         MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED) {
+		err = errno;
+		munmap(base, 2 * size);
+		errno = err;
+		goto err_fd;
+	}
+
+	close(fd);
+
+	r->base = base;
+	r->size = size;
+
+	return r;
+
+err_fd:
+	err = errno;
+	close(fd);
+	errno = err;
+
+err:
+	free(r);
+
+	return NULL;
+}
+
+/*
+ * Return a pointer to the contiguous free space of the ring and store its
+ * length in the given length pointer. Data written there becomes readable
+ * after calling lh_ring_commit().
+ */
+
+char *
+lh_ring_write_ptr(struct lh_ring *r, size_t *len)
+{
+	*len = r->size - (r->tail - r->head);
+
+	return r->base + (r->tail % r->size);
+}
+
+void
+lh_ring_commit(struct lh_ring *r, size_t len)
+{
+	if (len > r->size - (r->tail - r->head))
+		len = r->size - (r->tail - r->head);
+
+	r->tail += len;
+}
+
+/*
+ * Return a pointer to the contiguous readable data of the ring and store its
+ * length in the given length pointer. The data stays in the ring until it is
+ * released with lh_ring_consume().
+ */
+
+const char *
+lh_ring_read_ptr(struct lh_ring *r, size_t *len)
+{
+	*len = r->tail - r->head;
+
+	return r->base + (r->head % r->size);
+}
+
+void
+lh_ring_consume(struct lh_ring *r, size_t len)
+{
+	if (len > r->tail - r->head)
+		len = r->tail - r->head;
+
+	r->head += len;
+
+	/* rebase counters once the buffer drained to keep offsets small */
+	if (r->head == r->tail)
+		r->head = r->tail = 0;
+}
+
+/*
+ * Read as much data as fits from the given file descriptor directly into the
+ * free space of the ring.
+ *
+ * Returns the number of bytes read, 0 on end of file, or -1 on error with
+ * errno set accordingly. If the ring is full, nothing is read and -1 is
+ * returned with errno set to ENOBUFS, the caller has to consume data first.
+ */
+
+ssize_t
+lh_ring_read_fd(struct lh_ring *r, int fd)
+{
+	size_t len;
+	ssize_t rv;
+	char *ptr;
+
+	ptr = lh_ring_write_ptr(r, &len);
+
+	if (!len) {
+		errno = ENOBUFS;
+
+		return -1;
+	}
+
+	do {
+		rv = read(fd, ptr, len);
+	} while (rv == -1 && errno == EINTR);
+
+	if (rv > 0)
+		lh_ring_commit(r, rv);
+
+	return rv;
+}
+
+void
+lh_ring_free(struct lh_ring *r)
+{
+	if (r->base)
+		munmap(r->base, 2 * r->size);
+
+	free(r);
+}
@@ -0,0 +1,292 @@
+/*
+ * lucihttp - HTTP utility library - raw body tee component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <lucihttp/tee.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+
+/*
+ * Mirror all data passed to the parser to the given file descriptor. If
+ * close is set, the descriptor is owned by the tee and closed when freeing
+ * it.
+ *
+ * Returns NULL and sets errno if the tee cannot be allocated.
+ */
+
+struct lh_tee *
+lh_tee_new(int fd, bool close)
+{
+	struct lh_tee *t;
+
+	t = calloc(1, sizeof(*t));
+
+	if (!t)
+		return NULL;
+
+	t->buf = malloc(LH_TEE_BUFFER_SIZE);
+
+	if (!t->buf) {
+		free(t);
+
+		return NULL;
+	}
+
+	t->fd = fd;
+	t->close = close;
+	t->pipe[0] = -1;
+	t->pipe[1] = -1;
+
+	return t;
+}
+
+/*
+ * Create or truncate the given file and mirror all parsed data into it.
+ *
+ * Returns NULL and sets errno if the file cannot be created.
+ */
+
+struct lh_tee *
+lh_tee_open(const char *path)
+{
+	struct lh_tee *t;
+	int fd, err;
+
+	fd = open(path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0600);
+
+	if (fd == -1)
+		return NULL;
+
+	t = lh_tee_new(fd, true);
+
+	if (!t) {
+		err = errno;
+		close(fd);
+		errno = err;
+	}
+
+	return t;
+}
+
+static bool
+lh_tee_write_fd(int fd, const char *buf, size_t len)
+{
+	ssize_t rv;
+
+	while (len > 0) {
+		rv = write(fd, buf, len);
+
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		buf += rv;
+		len -= rv;
+	}
+
+	return true;
+}
+
+/*
+ * Write out all buffered data.
+ *
+ * Returns false and sets errno if the data cannot be written.
+ */
+
+bool
+lh_tee_flush(struct lh_tee *t)
+{
+	size_t len = t->len;
+
+	t->len = 0;
+
+	return lh_tee_write_fd(t->fd, t->buf, len);
+}
+
+/*
+ * Mirror the given input data. Data which already has been copied in-kernel
+ * by lh_tee_read() is skipped.
+ *
+ * Returns false and sets errno if the data cannot be written.
+ */
+
+bool
+lh_tee_write(struct lh_tee *t, const char *buf, size_t len)
+{
+	size_t n = (len < t->pending) ? len : t->pending;
+
+	t->pending -= n;
+	buf += n;
+	len -= n;
+
+	if (t->len + len > LH_TEE_BUFFER_SIZE && !lh_tee_flush(t))
+		return false;
+
+	if (len >= LH_TEE_BUFFER_SIZE)
+		return lh_tee_write_fd(t->fd, buf, len);
+
+	memcpy(t->buf + t->len, buf, len);
+	t->len += len;
+
+	return true;
+}
+
+static bool
+lh_tee_is_pipe(int fd)
+{
+	struct stat s;
+
+	return (fstat(fd, &s) == 0 && S_ISFIFO(s.st_mode));
+}
+
+static void
+lh_tee_close_pipe(struct lh_tee *t)
+{
+	int err = errno;
+
+	if (t->pipe[0] != -1) {
+		close(t->pipe[0]);
+		close(t->pipe[1]);
+	}
+
+	t->pipe[0] = -1;
+	t->pipe[1] = -1;
+
+	errno = err;
+}
+
+/*
+ * Duplicate up to len bytes from the input pipe to the tee descriptor without
+ * consuming them. If the tee descriptor itself is not a pipe, the data is
+ * duplicated into an intermediate pipe and spliced from there.
+ *
+ * Returns the number of bytes duplicated, 0 if tee() is not applicable to the
+ * descriptors or -1 on error.
+ */
+
+static ssize_t
+lh_tee_splice(struct lh_tee *t, int in_fd, size_t len)
+{
+	int out_fd = t->fd;
+	ssize_t n, m, rv;
+
+	if (!lh_tee_is_pipe(out_fd)) {
+		if (t->pipe[1] == -1 && pipe2(t->pipe, O_CLOEXEC) == -1)
+			return 0;
+
+		out_fd = t->pipe[1];
+	}
+
+	do {
+		n = tee(in_fd, out_fd, len, 0);
+	} while (n == -1 && errno == EINTR);
+
+	if (n == -1)
+		return (errno == EINVAL) ? 0 : -1;
+
+	for (rv = 0; out_fd != t->fd && rv < n; ) {
+		m = splice(t->pipe[0], NULL, t->fd, NULL, n - rv, SPLICE_F_MOVE);
+
+		if (m == -1) {
+			if (errno == EINTR)
+				continue;
+
+			/* discard the data left in the intermediate pipe, it would
+			 * precede the next duplicated data otherwise */
+			lh_tee_close_pipe(t);
+
+			return -1;
+		}
+
+		rv += m;
+	}
+
+	return n;
+}
+
+/*
+ * Read up to len bytes from the given input descriptor into the buffer for
+ * subsequent parsing. When reading from a pipe, the data is mirrored in-kernel
+ * using tee() and splice() and later skipped by lh_tee_write(), otherwise it
+ * is copied once the parser consumes it.
+ *
+ * The data read must be passed to the parser in order and in full before the
+ * next invocation, or the tee output will get out of sync.
+ *
+ * Returns the number of bytes read, 0 on end of file or -1 on error with
+ * errno set accordingly.
+ */
+
+ssize_t
+lh_tee_read(struct lh_tee *t, int in_fd, char *buf, size_t len)
+{
+	ssize_t n, rv;
+
+	if (!t->pending && lh_tee_is_pipe(in_fd)) {
+		if (t->len && !lh_tee_flush(t))
+			return -1;
+
+		n = lh_tee_splice(t, in_fd, len);
+
+		if (n == -1)
+			return -1;
+
+		if (n > 0) {
+			t->pending = n;
+			len = n;
+		}
+	}
+	else if (t->pending && len > t->pending) {
+		len = t->pending;
+	}
+
+	do {
+		rv = read(in_fd, buf, len);
+	} while (rv == -1 && errno == EINTR);
+
+	return rv;
+}
+
+void
+lh_tee_free(struct lh_tee *t)
+{
+	int err = errno;
+
+	if (t->len)
+		lh_tee_flush(t);
+
+	lh_tee_close_pipe(t);
+
+	if (t->close)
+		close(t->fd);
+
+	free(t->buf);
+	free(t);
+
+	errno = err;
+}
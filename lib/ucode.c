@@ -19,14 +19,21 @@
 #include <lucihttp/utils.h>
 #include <lucihttp/multipart-parser.h>
 #include <lucihttp/urlencoded-parser.h>
+#include <lucihttp/progress.h>
+#include <lucihttp/tee.h>
+#include <lucihttp/untar.h>
+#include <lucihttp/form.h>
+#include <lucihttp/budget.h>
+#include <lucihttp/fieldset.h>
 
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 
 #include <ucode/module.h>
 
 
-static uc_resource_type_t *mpart_type, *urldec_type;
+static uc_resource_type_t *mpart_type, *urldec_type, *untar_type;
 
 static inline uc_value_t *
 uc_raise(uc_vm_t *vm, const char *msg)
@@ -36,6 +43,408 @@ uc_raise(uc_vm_t *vm, const char *msg)
 	return NULL;
 }
 
+/*
+ * Create a tee from the given argument, either an already opened file
+ * descriptor number or a path name of a file to create.
+ */
+
+static struct lh_tee *
+lh_uc_tee_new(uc_vm_t *vm, uc_value_t *arg)
+{
+	struct lh_tee *t;
+	int64_t fd;
+
+	switch (ucv_type(arg)) {
+	case UC_INTEGER:
+		fd = ucv_int64_get(arg);
+
+		if (fd < 0 || fd > INT32_MAX) {
+			uc_raise(vm, "Invalid file descriptor argument");
+
+			return NULL;
+		}
+
+		t = lh_tee_new(fd, false);
+		break;
+
+	case UC_STRING:
+		t = lh_tee_open(ucv_string_get(arg));
+		break;
+
+	default:
+		uc_raise(vm, "Invalid tee argument");
+
+		return NULL;
+	}
+
+	if (!t)
+		uc_raise(vm, strerror(errno));
+
+	return t;
+}
+
+/*
+ * Enable the form snapshot of a parser, return the snapshot as string or
+ * a sealed memory file descriptor of it.
+ */
+
+static struct lh_form *
+lh_uc_form_enable(uc_vm_t *vm, struct lh_form **f)
+{
+	if (!*f)
+		*f = lh_form_new();
+
+	if (!*f)
+		uc_raise(vm, "Out of memory");
+
+	return *f;
+}
+
+static uc_value_t *
+lh_uc_form_get(uc_vm_t *vm, struct lh_form *f, bool as_fd)
+{
+	const char *data;
+	size_t len;
+	int fd;
+
+	if (!f)
+		return NULL;
+
+	if (as_fd) {
+		fd = lh_form_memfd(f);
+
+		if (fd == -1)
+			return uc_raise(vm, strerror(errno));
+
+		return ucv_int64_new(fd);
+	}
+
+	data = lh_form_finish(f, &len);
+
+	if (!data)
+		return uc_raise(vm, strerror(errno));
+
+	return ucv_string_new_length(data, len);
+}
+
+/*
+ * Look up the form field with the given name, return its value or, if
+ * requested, an array of the values of all fields with the name.
+ */
+
+static uc_value_t *
+lh_uc_form_field(uc_vm_t *vm, size_t nargs, struct lh_form *f)
+{
+	uc_value_t *name = uc_fn_arg(0);
+	uc_value_t *all = uc_fn_arg(1);
+	struct lh_form_field field;
+	uc_value_t *rv;
+	bool found;
+
+	if (ucv_type(name) != UC_STRING)
+		return uc_raise(vm, "Invalid name argument");
+
+	if (!f)
+		return NULL;
+
+	found = lh_form_lookup(f, ucv_string_get(name), ucv_string_length(name),
+	                       &field);
+
+	if (!ucv_is_truish(all))
+		return found ? ucv_string_new_length(field.value, field.valuelen)
+		             : NULL;
+
+	rv = ucv_array_new(vm);
+
+	for (; found; found = lh_form_get_next(f, &field))
+		ucv_array_push(rv, ucv_string_new_length(field.value, field.valuelen));
+
+	return rv;
+}
+
+/*
+ * Build nested objects and arrays from the bracket paths of the form field
+ * names, so that "a[b][]=1" yields { a: { b: [ "1" ] } }. Fields are applied
+ * in order, a later field replaces a conflicting earlier value.
+ */
+
+static uc_value_t *
+lh_uc_form_tree(uc_vm_t *vm, struct lh_form *f)
+{
+	struct lh_form_field field = { 0 };
+	uc_value_t *rv, *node, *next, *val;
+	bool first, haskey = false;
+	size_t off, seglen;
+	const char *seg;
+	char *key;
+
+	if (!f)
+		return NULL;
+
+	rv = ucv_object_new(vm);
+
+	while (lh_form_next(f, &field)) {
+		key = malloc(field.namelen + 1);
+
+		if (!key) {
+			ucv_put(rv);
+
+			return uc_raise(vm, "Out of memory");
+		}
+
+		off = 0;
+		node = rv;
+		first = true;
+
+		while (lh_urldec_path_next(field.name, field.namelen, &off,
+		                           &seg, &seglen)) {
+			/* descend at the pending key or append, creating an array
+			 * for appends and an object for keys as needed */
+			if (!first) {
+				next = haskey ? ucv_object_get(node, key, NULL) : NULL;
+
+				if (ucv_type(next) != (seg ? UC_OBJECT : UC_ARRAY)) {
+					next = seg ? ucv_object_new(vm) : ucv_array_new(vm);
+
+					if (haskey)
+						ucv_object_add(node, key, next);
+					else
+						ucv_array_push(node, next);
+				}
+
+				node = next;
+			}
+
+			if (seg) {
+				memcpy(key, seg, seglen);
+				key[seglen] = 0;
+			}
+
+			haskey = !!seg;
+			first = false;
+		}
+
+		if (!first) {
+			val = ucv_string_new_length(field.value, field.valuelen);
+
+			if (haskey)
+				ucv_object_add(node, key, val);
+			else
+				ucv_array_push(node, val);
+		}
+
+		free(key);
+	}
+
+	return rv;
+}
+
+/*
+ * Compile the given array of field names into a field set, null removes
+ * the field set.
+ */
+
+static bool
+lh_uc_fields_new(uc_vm_t *vm, uc_value_t *list, struct lh_fieldset **s)
+{
+	const char **names;
+	size_t i, n;
+
+	if (list && ucv_type(list) != UC_ARRAY) {
+		uc_raise(vm, "Invalid field list argument");
+
+		return false;
+	}
+
+	n = ucv_array_length(list);
+	names = calloc(n ? n : 1, sizeof(*names));
+
+	if (!names) {
+		uc_raise(vm, "Out of memory");
+
+		return false;
+	}
+
+	for (i = 0; i < n; i++) {
+		names[i] = ucv_string_get(ucv_array_get(list, i));
+
+		if (!names[i]) {
+			free(names);
+			uc_raise(vm, "Invalid field name");
+
+			return false;
+		}
+	}
+
+	if (*s)
+		lh_fieldset_free(*s);
+
+	*s = list ? lh_fieldset_new(names, n) : NULL;
+
+	free(names);
+
+	if (list && !*s) {
+		uc_raise(vm, "Out of memory");
+
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * tar extractor binding
+ * -------------------------------------------------------------------------
+ */
+
+struct lh_uc_untar {
+	struct lh_untar *untar;
+	uc_vm_t *vm;
+	uc_value_t *callback;
+	bool exception;
+};
+
+static bool
+lh_uc_untar_cb(struct lh_untar *u, enum lh_untar_callback_type type,
+               const char *buf, size_t len, void *priv)
+{
+	struct lh_uc_untar *uu = priv;
+	uc_value_t *res;
+	bool rv = false;
+
+	if (!uu->exception) {
+		/* function itself */
+		uc_vm_stack_push(uu->vm, ucv_get(uu->callback));
+
+		/* arg #1: callback type */
+		uc_vm_stack_push(uu->vm, ucv_uint64_new(type));
+
+		/* arg #2: buffer data or nil */
+		uc_vm_stack_push(uu->vm, buf ? ucv_string_new_length(buf, len) : NULL);
+
+		/* arg #3: buffer length */
+		uc_vm_stack_push(uu->vm, ucv_uint64_new(len));
+
+		if (uc_vm_call(uu->vm, false, 3)) {
+			uu->exception = true;
+
+			return false;
+		}
+
+		/* pop return value from stack */
+		res = uc_vm_stack_pop(uu->vm);
+		rv = ucv_is_truish(res);
+
+		/* free return value */
+		ucv_put(res);
+	}
+
+	return rv;
+}
+
+static uc_value_t *
+lh_uc_untar_new(uc_vm_t *vm, size_t nargs)
+{
+	uc_value_t *dir = uc_fn_arg(0);
+	uc_value_t *callback = uc_fn_arg(1);
+	struct lh_uc_untar *uu;
+
+	if (dir && ucv_type(dir) != UC_STRING)
+		return uc_raise(vm, "Invalid directory argument");
+
+	if (callback && !ucv_is_callable(callback))
+		return uc_raise(vm, "Invalid callback argument");
+
+	uu = calloc(1, sizeof(*uu));
+
+	if (!uu)
+		return uc_raise(vm, "Out of memory");
+
+	uu->untar = lh_untar_new(NULL);
+
+	if (!uu->untar) {
+		free(uu);
+
+		return uc_raise(vm, "Out of memory");
+	}
+
+	if (dir && !lh_untar_set_directory(uu->untar, ucv_string_get(dir))) {
+		lh_untar_free(uu->untar);
+		free(uu);
+
+		return uc_raise(vm, strerror(errno));
+	}
+
+	uu->vm = vm;
+	uu->callback = ucv_get(callback);
+
+	if (callback)
+		lh_untar_set_callback(uu->untar, lh_uc_untar_cb, uu);
+
+	return uc_resource_new(untar_type, uu);
+}
+
+static uc_value_t *
+lh_uc_untar_parse(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_untar **uu = uc_fn_this("lucihttp.untar");
+	uc_value_t *buf = uc_fn_arg(0);
+
+	if (buf && ucv_type(buf) != UC_STRING)
+		return uc_raise(vm, "Invalid input string");
+
+	return ucv_boolean_new(lh_untar_parse((*uu)->untar,
+		ucv_string_get(buf), ucv_string_length(buf)));
+}
+
+static uc_value_t *
+lh_uc_untar_member(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_untar **uu = uc_fn_this("lucihttp.untar");
+	static const char *types[] = {
+		"file", "directory", "symlink", "hardlink", "other"
+	};
+	struct lh_untar_member *m = &(*uu)->untar->member;
+	uc_value_t *rv;
+
+	if (!m->name)
+		return NULL;
+
+	rv = ucv_object_new(vm);
+
+	ucv_object_add(rv, "name", ucv_string_new(m->name));
+	ucv_object_add(rv, "type", ucv_string_new(types[m->type]));
+	ucv_object_add(rv, "size", ucv_uint64_new(m->size));
+	ucv_object_add(rv, "mode", ucv_uint64_new(m->mode));
+	ucv_object_add(rv, "mtime", ucv_int64_new(m->mtime));
+
+	if (m->type == LH_UT_M_SYMLINK || m->type == LH_UT_M_HARDLINK)
+		ucv_object_add(rv, "linkname", ucv_string_new(m->linkname));
+
+	return rv;
+}
+
+static uc_value_t *
+lh_uc_untar_error(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_untar **uu = uc_fn_this("lucihttp.untar");
+
+	if (!(*uu)->untar->error)
+		return NULL;
+
+	return ucv_string_new((*uu)->untar->error);
+}
+
+static void
+lh_uc_untar__gc(void *ud)
+{
+	struct lh_uc_untar *uu = ud;
+
+	ucv_put(uu->callback);
+	lh_untar_free(uu->untar);
+	free(uu);
+}
+
 /*
  * multipart parser binding
  * -------------------------------------------------------------------------
@@ -43,6 +452,13 @@ uc_raise(uc_vm_t *vm, const char *msg)
 
 struct lh_uc_mpart {
 	struct lh_mpart parser;
+	struct lh_progress *progress;
+	struct lh_tee *tee;
+	struct lh_form *form;
+	struct lh_fieldset *fields;
+	struct lh_untar *untar;
+	uc_value_t *untarval;
+	bool untar_failed;
 	uc_vm_t *vm;
 	uc_value_t *callback;
 	bool exception;
@@ -56,6 +472,27 @@ lh_uc_mpart_cb(struct lh_mpart *p, enum lh_mpart_callback_type type,
 	uc_value_t *res;
 	bool rv = false;
 
+	/* route the part data to an attached tar extractor, a failure of it
+	 * is reported by the next parse() call */
+	if (pu->untar) {
+		if (type == LH_MP_CB_PART_DATA) {
+			if (!lh_untar_parse(pu->untar, buf, len))
+				pu->untar_failed = true;
+
+			return true;
+		}
+
+		if (type == LH_MP_CB_PART_END || type == LH_MP_CB_ERROR) {
+			if (type == LH_MP_CB_PART_END &&
+			    !lh_untar_parse(pu->untar, NULL, 0))
+				pu->untar_failed = true;
+
+			ucv_put(pu->untarval);
+			pu->untarval = NULL;
+			pu->untar = NULL;
+		}
+	}
+
 	if (pu->callback && !pu->exception) {
 		/* function itself */
 		uc_vm_stack_push(pu->vm, ucv_get(pu->callback));
@@ -144,123 +581,590 @@ lh_uc_mpart_parse(uc_vm_t *vm, size_t nargs)
 	if (buf && ucv_type(buf) != UC_STRING)
 		return uc_raise(vm, "Invalid input string");
 
+	/* an attached tar extractor failing on the part data fails the parse */
 	return ucv_boolean_new(lh_mpart_parse(&(*pu)->parser,
-		ucv_string_get(buf), ucv_string_length(buf)));
+		ucv_string_get(buf), ucv_string_length(buf)) &&
+		!(*pu)->untar_failed);
 }
 
-static void
-lh_uc_mpart__gc(void *ud)
+static uc_value_t *
+lh_uc_mpart_set_chunk_size(uc_vm_t *vm, size_t nargs)
 {
-	struct lh_uc_mpart *pu = ud;
+	struct lh_uc_mpart **pu = uc_fn_this("lucihttp.parser.multipart");
+	uc_value_t *sizearg = uc_fn_arg(0);
+	size_t size;
 
-	ucv_put(pu->callback);
-	lh_mpart_free(&pu->parser);
-}
+	size = ucv_uint64_get(sizearg);
 
+	if (errno)
+		return uc_raise(vm, "Invalid size argument");
 
-/*
- * urlencoded parser binding
- * -------------------------------------------------------------------------
- */
+	lh_mpart_set_chunk_size(&(*pu)->parser, size);
 
-struct lh_uc_urldec {
-	struct lh_urldec parser;
-	uc_vm_t *vm;
-	uc_value_t *callback;
-	bool exception;
-};
+	return NULL;
+}
 
-static bool
-lh_uc_urldec_cb(struct lh_urldec *p, enum lh_urldec_callback_type type,
-               const char *buf, size_t len, void *priv)
+static uc_value_t *
+lh_uc_mpart_set_body_limit(uc_vm_t *vm, size_t nargs)
 {
-	struct lh_uc_urldec *pu = priv;
-	bool rv = false;
-	uc_value_t *res;
+	struct lh_uc_mpart **pu = uc_fn_this("lucihttp.parser.multipart");
+	uc_value_t *limitarg = uc_fn_arg(0);
+	size_t limit;
 
-	if (pu->callback && !pu->exception) {
-		/* function itself */
-		uc_vm_stack_push(pu->vm, ucv_get(pu->callback));
+	limit = ucv_uint64_get(limitarg);
 
-		/* arg #1: callback type */
-		uc_vm_stack_push(pu->vm, ucv_uint64_new(type));
+	if (errno)
+		return uc_raise(vm, "Invalid limit argument");
 
-		/* arg #2: buffer data or nil */
-		uc_vm_stack_push(pu->vm, buf ? ucv_string_new_length(buf, len) : NULL);
+	lh_mpart_set_body_limit(&(*pu)->parser, limit);
+
+	return NULL;
+}
+
+static uc_value_t *
+lh_uc_mpart_set_inflate_limit(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_mpart **pu = uc_fn_this("lucihttp.parser.multipart");
+	uc_value_t *limitarg = uc_fn_arg(0);
+	size_t limit;
+
+	limit = ucv_uint64_get(limitarg);
+
+	if (errno)
+		return uc_raise(vm, "Invalid limit argument");
+
+	lh_mpart_set_inflate_limit(&(*pu)->parser, limit);
+
+	return NULL;
+}
+
+static uc_value_t *
+lh_uc_mpart_set_content_length(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_mpart **pu = uc_fn_this("lucihttp.parser.multipart");
+	uc_value_t *lenarg = uc_fn_arg(0);
+	size_t len;
+
+	len = ucv_uint64_get(lenarg);
+
+	if (errno)
+		return uc_raise(vm, "Invalid length argument");
+
+	return ucv_boolean_new(lh_mpart_set_content_length(&(*pu)->parser, len));
+}
+
+static uc_value_t *
+lh_uc_mpart_set_content_encoding(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_mpart **pu = uc_fn_this("lucihttp.parser.multipart");
+	uc_value_t *encoding = uc_fn_arg(0);
+
+	if (encoding && ucv_type(encoding) != UC_STRING)
+		return uc_raise(vm, "Invalid encoding argument");
+
+	return ucv_boolean_new(lh_mpart_set_content_encoding(&(*pu)->parser,
+		ucv_string_get(encoding)));
+}
+
+static uc_value_t *
+lh_uc_mpart_set_transfer_decoding(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_mpart **pu = uc_fn_this("lucihttp.parser.multipart");
+	uc_value_t *enable = uc_fn_arg(0);
+
+	lh_mpart_set_transfer_decoding(&(*pu)->parser,
+		!enable || ucv_is_truish(enable));
+
+	return NULL;
+}
+
+static uc_value_t *
+lh_uc_mpart_set_progress(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_mpart **pu = uc_fn_this("lucihttp.parser.multipart");
+	uc_value_t *path = uc_fn_arg(0);
+	uc_value_t *intervalarg = uc_fn_arg(1);
+	struct lh_progress *pr;
+	size_t interval = 0;
+
+	if (ucv_type(path) != UC_STRING)
+		return uc_raise(vm, "Invalid path argument");
+
+	if (intervalarg) {
+		interval = ucv_uint64_get(intervalarg);
+
+		if (errno)
+			return uc_raise(vm, "Invalid interval argument");
+	}
+
+	pr = lh_progress_open(ucv_string_get(path), interval);
+
+	if (!pr)
+		return uc_raise(vm, strerror(errno));
+
+	if ((*pu)->progress)
+		lh_progress_close((*pu)->progress);
+
+	(*pu)->progress = pr;
+	lh_mpart_set_progress(&(*pu)->parser, pr);
+
+	return ucv_boolean_new(true);
+}
+
+static uc_value_t *
+lh_uc_mpart_set_tee(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_mpart **pu = uc_fn_this("lucihttp.parser.multipart");
+	struct lh_tee *t;
+
+	t = lh_uc_tee_new(vm, uc_fn_arg(0));
+
+	if (!t)
+		return NULL;
+
+	if ((*pu)->tee)
+		lh_tee_free((*pu)->tee);
+
+	(*pu)->tee = t;
+	lh_mpart_set_tee(&(*pu)->parser, t);
+
+	return ucv_boolean_new(true);
+}
+
+static uc_value_t *
+lh_uc_mpart_set_form(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_mpart **pu = uc_fn_this("lucihttp.parser.multipart");
+
+	if (!lh_uc_form_enable(vm, &(*pu)->form))
+		return NULL;
+
+	lh_mpart_set_form(&(*pu)->parser, (*pu)->form);
+
+	return ucv_boolean_new(true);
+}
+
+static uc_value_t *
+lh_uc_mpart_set_form_path(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_mpart **pu = uc_fn_this("lucihttp.parser.multipart");
+	uc_value_t *path = uc_fn_arg(0);
+
+	if (ucv_type(path) != UC_STRING)
+		return uc_raise(vm, "Invalid path argument");
+
+	if (!(*pu)->form)
+		return NULL;
+
+	return ucv_boolean_new(lh_form_set_path((*pu)->form,
+		ucv_string_get(path)));
+}
+
+static uc_value_t *
+lh_uc_mpart_set_fields(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_mpart **pu = uc_fn_this("lucihttp.parser.multipart");
+
+	if (!lh_uc_fields_new(vm, uc_fn_arg(0), &(*pu)->fields))
+		return NULL;
+
+	lh_mpart_set_fields(&(*pu)->parser, (*pu)->fields);
+
+	return ucv_boolean_new(true);
+}
+
+static uc_value_t *
+lh_uc_mpart_form(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_mpart **pu = uc_fn_this("lucihttp.parser.multipart");
+
+	return lh_uc_form_get(vm, (*pu)->form, false);
+}
+
+static uc_value_t *
+lh_uc_mpart_field(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_mpart **pu = uc_fn_this("lucihttp.parser.multipart");
+
+	return lh_uc_form_field(vm, nargs, (*pu)->form);
+}
+
+static uc_value_t *
+lh_uc_mpart_form_fd(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_mpart **pu = uc_fn_this("lucihttp.parser.multipart");
+
+	return lh_uc_form_get(vm, (*pu)->form, true);
+}
+
+static uc_value_t *
+lh_uc_mpart_set_untar(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_mpart **pu = uc_fn_this("lucihttp.parser.multipart");
+	uc_value_t *untar = uc_fn_arg(0);
+	struct lh_uc_untar **uu;
+
+	uu = (struct lh_uc_untar **)ucv_resource_dataptr(untar, "lucihttp.untar");
+
+	if (!uu || !*uu)
+		return uc_raise(vm, "Invalid untar argument");
+
+	ucv_put((*pu)->untarval);
+
+	(*pu)->untarval = ucv_get(untar);
+	(*pu)->untar = (*uu)->untar;
+	(*pu)->untar_failed = false;
+
+	return NULL;
+}
+
+static void
+lh_uc_mpart__gc(void *ud)
+{
+	struct lh_uc_mpart *pu = ud;
+
+	ucv_put(pu->callback);
+	ucv_put(pu->untarval);
+
+	if (pu->progress)
+		lh_progress_close(pu->progress);
+
+	if (pu->tee)
+		lh_tee_free(pu->tee);
+
+	if (pu->form)
+		lh_form_free(pu->form);
+
+	if (pu->fields)
+		lh_fieldset_free(pu->fields);
+
+	lh_mpart_free(&pu->parser);
+}
+
+
+/*
+ * urlencoded parser binding
+ * -------------------------------------------------------------------------
+ */
+
+struct lh_uc_urldec {
+	struct lh_urldec parser;
+	struct lh_tee *tee;
+	struct lh_form *form;
+	struct lh_fieldset *fields;
+	uc_vm_t *vm;
+	uc_value_t *callback;
+	bool exception;
+};
+
+static bool
+lh_uc_urldec_cb(struct lh_urldec *p, enum lh_urldec_callback_type type,
+               const char *buf, size_t len, void *priv)
+{
+	struct lh_uc_urldec *pu = priv;
+	bool rv = false;
+	uc_value_t *res;
+
+	if (pu->callback && !pu->exception) {
+		/* function itself */
+		uc_vm_stack_push(pu->vm, ucv_get(pu->callback));
+
+		/* arg #1: callback type */
+		uc_vm_stack_push(pu->vm, ucv_uint64_new(type));
+
+		/* arg #2: buffer data or nil */
+		uc_vm_stack_push(pu->vm, buf ? ucv_string_new_length(buf, len) : NULL);
+
+		/* arg #3: buffer length */
+		uc_vm_stack_push(pu->vm, ucv_uint64_new(len));
+
+		if (uc_vm_call(pu->vm, false, 3)) {
+			pu->exception = true;
+
+			return false;
+		}
+
+		/* pop return value from stack */
+		res = uc_vm_stack_pop(pu->vm);
+		rv = ucv_is_truish(res);
+
+		/* free return value */
+		ucv_put(res);
+	}
+
+	return rv;
+}
+
+
+static uc_value_t *
+lh_uc_urldec_new(uc_vm_t *vm, size_t nargs)
+{
+	uc_value_t *callback = uc_fn_arg(0);
+	uc_value_t *limitarg = uc_fn_arg(1);
+	struct lh_uc_urldec *pu;
+	size_t limit;
+
+	pu = calloc(1, sizeof(*pu));
+
+	if (!pu)
+		return uc_raise(vm, "Out of memory");
+
+	lh_urldec_init(&pu->parser, NULL);
+
+	if (callback && !ucv_is_callable(callback)) {
+		lh_urldec_free(&pu->parser);
+
+		return uc_raise(vm, "Invalid callback argument");
+	}
+
+	if (limitarg) {
+		limit = ucv_uint64_get(limitarg);
+
+		if (errno) {
+			lh_urldec_free(&pu->parser);
+
+			return uc_raise(vm, "Invalid limit argument");
+		}
+
+		lh_urldec_set_size_limit(&pu->parser, limit);
+	}
+
+	pu->vm = vm;
+	pu->callback = ucv_get(callback);
+
+	lh_urldec_set_callback(&pu->parser, lh_uc_urldec_cb, pu);
+	lh_urldec_set_spans(&pu->parser, true);
+
+	return uc_resource_new(urldec_type, pu);
+}
+
+static uc_value_t *
+lh_uc_urldec_parse(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_urldec **pu = uc_fn_this("lucihttp.parser.urlencoded");
+	uc_value_t *buf = uc_fn_arg(0);
+
+	if (buf && ucv_type(buf) != UC_STRING)
+		return uc_raise(vm, "Invalid input string");
+
+	return ucv_boolean_new(lh_urldec_parse(&(*pu)->parser,
+		ucv_string_get(buf), ucv_string_length(buf)));
+}
+
+/*
+ * Parse the given data and return an array of [ name, value ] pairs holding
+ * the tuples completed by it, false on failure.
+ */
+
+static uc_value_t *
+lh_uc_urldec_parse_tuples(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_urldec **pu = uc_fn_this("lucihttp.parser.urlencoded");
+	uc_value_t *buf = uc_fn_arg(0), *rv, *pair;
+	struct lh_urldec_tuple *tuples;
+	const char *data, *s;
+	size_t i, len, n = 1;
+
+	if (buf && ucv_type(buf) != UC_STRING)
+		return uc_raise(vm, "Invalid input string");
+
+	data = ucv_string_get(buf);
+	len = ucv_string_length(buf);
+
+	for (s = data; s && (s = memchr(s, '&', data + len - s)) != NULL; s++)
+		n++;
+
+	tuples = calloc(n, sizeof(*tuples));
+
+	if (!tuples)
+		return uc_raise(vm, "Out of memory");
+
+	n = lh_urldec_parse_tuples(&(*pu)->parser, data, len, tuples, n);
+
+	if ((*pu)->parser.error) {
+		free(tuples);
+
+		return ucv_boolean_new(false);
+	}
+
+	rv = ucv_array_new(vm);
+
+	for (i = 0; i < n; i++) {
+		pair = ucv_array_new(vm);
+
+		ucv_array_push(pair,
+			ucv_string_new_length(tuples[i].name, tuples[i].namelen));
+		ucv_array_push(pair,
+			ucv_string_new_length(tuples[i].value, tuples[i].valuelen));
+
+		ucv_array_push(rv, pair);
+	}
+
+	free(tuples);
+
+	return rv;
+}
+
+static uc_value_t *
+lh_uc_urldec_set_body_limit(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_urldec **pu = uc_fn_this("lucihttp.parser.urlencoded");
+	uc_value_t *limitarg = uc_fn_arg(0);
+	size_t limit;
+
+	limit = ucv_uint64_get(limitarg);
+
+	if (errno)
+		return uc_raise(vm, "Invalid limit argument");
+
+	lh_urldec_set_body_limit(&(*pu)->parser, limit);
+
+	return NULL;
+}
+
+static uc_value_t *
+lh_uc_urldec_set_inflate_limit(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_urldec **pu = uc_fn_this("lucihttp.parser.urlencoded");
+	uc_value_t *limitarg = uc_fn_arg(0);
+	size_t limit;
+
+	limit = ucv_uint64_get(limitarg);
+
+	if (errno)
+		return uc_raise(vm, "Invalid limit argument");
+
+	lh_urldec_set_inflate_limit(&(*pu)->parser, limit);
+
+	return NULL;
+}
+
+static uc_value_t *
+lh_uc_urldec_set_content_length(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_urldec **pu = uc_fn_this("lucihttp.parser.urlencoded");
+	uc_value_t *lenarg = uc_fn_arg(0);
+	size_t len;
+
+	len = ucv_uint64_get(lenarg);
+
+	if (errno)
+		return uc_raise(vm, "Invalid length argument");
+
+	return ucv_boolean_new(lh_urldec_set_content_length(&(*pu)->parser, len));
+}
+
+static uc_value_t *
+lh_uc_urldec_set_content_encoding(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_urldec **pu = uc_fn_this("lucihttp.parser.urlencoded");
+	uc_value_t *encoding = uc_fn_arg(0);
+
+	if (encoding && ucv_type(encoding) != UC_STRING)
+		return uc_raise(vm, "Invalid encoding argument");
+
+	return ucv_boolean_new(lh_urldec_set_content_encoding(&(*pu)->parser,
+		ucv_string_get(encoding)));
+}
+
+static uc_value_t *
+lh_uc_urldec_set_tee(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_urldec **pu = uc_fn_this("lucihttp.parser.urlencoded");
+	struct lh_tee *t;
+
+	t = lh_uc_tee_new(vm, uc_fn_arg(0));
+
+	if (!t)
+		return NULL;
+
+	if ((*pu)->tee)
+		lh_tee_free((*pu)->tee);
+
+	(*pu)->tee = t;
+	lh_urldec_set_tee(&(*pu)->parser, t);
+
+	return ucv_boolean_new(true);
+}
+
+static uc_value_t *
+lh_uc_urldec_set_form(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_urldec **pu = uc_fn_this("lucihttp.parser.urlencoded");
 
-		/* arg #3: buffer length */
-		uc_vm_stack_push(pu->vm, ucv_uint64_new(len));
+	if (!lh_uc_form_enable(vm, &(*pu)->form))
+		return NULL;
 
-		if (uc_vm_call(pu->vm, false, 3)) {
-			pu->exception = true;
+	lh_urldec_set_form(&(*pu)->parser, (*pu)->form);
 
-			return false;
-		}
+	return ucv_boolean_new(true);
+}
 
-		/* pop return value from stack */
-		res = uc_vm_stack_pop(pu->vm);
-		rv = ucv_is_truish(res);
+static uc_value_t *
+lh_uc_urldec_set_decode(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_urldec **pu = uc_fn_this("lucihttp.parser.urlencoded");
+	uc_value_t *decode = uc_fn_arg(0);
 
-		/* free return value */
-		ucv_put(res);
-	}
+	lh_urldec_set_decode(&(*pu)->parser, decode ? ucv_is_truish(decode) : true);
 
-	return rv;
+	return NULL;
 }
 
-
 static uc_value_t *
-lh_uc_urldec_new(uc_vm_t *vm, size_t nargs)
+lh_uc_urldec_set_fields(uc_vm_t *vm, size_t nargs)
 {
-	uc_value_t *callback = uc_fn_arg(0);
-	uc_value_t *limitarg = uc_fn_arg(1);
-	struct lh_uc_urldec *pu;
-	size_t limit;
+	struct lh_uc_urldec **pu = uc_fn_this("lucihttp.parser.urlencoded");
 
-	pu = calloc(1, sizeof(*pu));
+	if (!lh_uc_fields_new(vm, uc_fn_arg(0), &(*pu)->fields))
+		return NULL;
 
-	if (!pu)
-		return uc_raise(vm, "Out of memory");
+	lh_urldec_set_fields(&(*pu)->parser, (*pu)->fields);
 
-	lh_urldec_init(&pu->parser, NULL);
+	return ucv_boolean_new(true);
+}
 
-	if (callback && !ucv_is_callable(callback)) {
-		lh_urldec_free(&pu->parser);
+static uc_value_t *
+lh_uc_urldec_form(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_urldec **pu = uc_fn_this("lucihttp.parser.urlencoded");
 
-		return uc_raise(vm, "Invalid callback argument");
-	}
+	return lh_uc_form_get(vm, (*pu)->form, false);
+}
 
-	if (limitarg) {
-		limit = ucv_uint64_get(limitarg);
+static uc_value_t *
+lh_uc_urldec_field(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_urldec **pu = uc_fn_this("lucihttp.parser.urlencoded");
 
-		if (errno) {
-			lh_urldec_free(&pu->parser);
+	return lh_uc_form_field(vm, nargs, (*pu)->form);
+}
 
-			return uc_raise(vm, "Invalid limit argument");
-		}
+static uc_value_t *
+lh_uc_urldec_set_paths(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_urldec **pu = uc_fn_this("lucihttp.parser.urlencoded");
+	uc_value_t *paths = uc_fn_arg(0);
 
-		lh_urldec_set_size_limit(&pu->parser, limit);
-	}
+	lh_urldec_set_paths(&(*pu)->parser, paths ? ucv_is_truish(paths) : true);
 
-	pu->vm = vm;
-	pu->callback = ucv_get(callback);
+	return NULL;
+}
 
-	lh_urldec_set_callback(&pu->parser, lh_uc_urldec_cb, pu);
+static uc_value_t *
+lh_uc_urldec_tree(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_uc_urldec **pu = uc_fn_this("lucihttp.parser.urlencoded");
 
-	return uc_resource_new(urldec_type, pu);
+	return lh_uc_form_tree(vm, (*pu)->form);
 }
 
 static uc_value_t *
-lh_uc_urldec_parse(uc_vm_t *vm, size_t nargs)
+lh_uc_urldec_form_fd(uc_vm_t *vm, size_t nargs)
 {
 	struct lh_uc_urldec **pu = uc_fn_this("lucihttp.parser.urlencoded");
-	uc_value_t *buf = uc_fn_arg(0);
 
-	if (buf && ucv_type(buf) != UC_STRING)
-		return uc_raise(vm, "Invalid input string");
-
-	return ucv_boolean_new(lh_urldec_parse(&(*pu)->parser,
-		ucv_string_get(buf), ucv_string_length(buf)));
+	return lh_uc_form_get(vm, (*pu)->form, true);
 }
 
 static void
@@ -269,6 +1173,16 @@ lh_uc_urldec__gc(void *ud)
 	struct lh_uc_urldec *pu = ud;
 
 	ucv_put(pu->callback);
+
+	if (pu->tee)
+		lh_tee_free(pu->tee);
+
+	if (pu->form)
+		lh_form_free(pu->form);
+
+	if (pu->fields)
+		lh_fieldset_free(pu->fields);
+
 	lh_urldec_free(&pu->parser);
 }
 
@@ -346,6 +1260,120 @@ lh_uc_urldecode(uc_vm_t *vm, size_t nargs)
 	return rv;
 }
 
+static uc_value_t *
+lh_uc_base64_encode(uc_vm_t *vm, size_t nargs)
+{
+	uc_value_t *input = uc_fn_arg(0);
+	uc_value_t *flags = uc_fn_arg(1);
+	uc_value_t *rv;
+	unsigned int f;
+	char *encoded;
+	size_t len;
+
+	if (!input)
+		return NULL;
+
+	if (ucv_type(input) != UC_STRING)
+		return uc_raise(vm, "Invalid input string");
+
+	f = flags ? (unsigned int)ucv_uint64_get(flags) : 0;
+
+	if (errno)
+		return uc_raise(vm, "Invalid flags argument");
+
+	encoded = lh_base64_encode(
+		ucv_string_get(input), ucv_string_length(input), &len, f);
+
+	if (!encoded)
+		return NULL;
+
+	rv = ucv_string_new_length(encoded, len);
+
+	free(encoded);
+
+	return rv;
+}
+
+static uc_value_t *
+lh_uc_base64_decode(uc_vm_t *vm, size_t nargs)
+{
+	uc_value_t *input = uc_fn_arg(0);
+	uc_value_t *flags = uc_fn_arg(1);
+	uc_value_t *rv;
+	unsigned int f;
+	char *decoded;
+	size_t len;
+
+	if (!input)
+		return NULL;
+
+	if (ucv_type(input) != UC_STRING)
+		return uc_raise(vm, "Invalid input string");
+
+	f = flags ? (unsigned int)ucv_uint64_get(flags) : 0;
+
+	if (errno)
+		return uc_raise(vm, "Invalid flags argument");
+
+	decoded = lh_base64_decode(
+		ucv_string_get(input), ucv_string_length(input), &len, f);
+
+	if (!decoded)
+		return NULL;
+
+	rv = ucv_string_new_length(decoded, len);
+
+	free(decoded);
+
+	return rv;
+}
+
+static uc_value_t *
+lh_uc_query_get(uc_vm_t *vm, size_t nargs)
+{
+	uc_value_t *input = uc_fn_arg(0);
+	uc_value_t *name = uc_fn_arg(1);
+	char buf[256], *value = buf;
+	uc_value_t *rv;
+	ssize_t vlen;
+
+	if (!input)
+		return NULL;
+
+	if (ucv_type(input) != UC_STRING)
+		return uc_raise(vm, "Invalid input string");
+
+	if (ucv_type(name) != UC_STRING)
+		return uc_raise(vm, "Invalid name argument");
+
+	if (!ucv_string_length(input))
+		return NULL;
+
+	vlen = lh_query_get(ucv_string_get(input), ucv_string_length(input),
+	                    ucv_string_get(name), buf, sizeof(buf));
+
+	if (vlen < 0)
+		return NULL;
+
+	/* retry with a sufficiently sized buffer for long values */
+	if ((size_t)vlen >= sizeof(buf)) {
+		value = malloc(vlen + 1);
+
+		if (!value)
+			return uc_raise(vm, "Out of memory");
+
+		lh_query_get(ucv_string_get(input), ucv_string_length(input),
+		             ucv_string_get(name), value, vlen + 1);
+	}
+
+	rv = ucv_string_new_length(value, vlen);
+
+	if (value != buf)
+		free(value);
+
+	return rv;
+}
+
 static uc_value_t *
 lh_uc_header_attribute(uc_vm_t *vm, size_t nargs)
 {
@@ -379,25 +1407,230 @@ lh_uc_header_attribute(uc_vm_t *vm, size_t nargs)
 }
 
 
+static char
+lh_uc_lower(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? (c | 0x20) : c;
+}
+
+/*
+ * Tokenize a header value once and return an object with the media type
+ * and an object of all parameters keyed by their lower case names. Like
+ * with header_attribute(), the first occurrence of a parameter wins.
+ */
+static uc_value_t *
+lh_uc_header_params(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_header_param stack[16], *params = stack;
+	uc_value_t *input = uc_fn_arg(0);
+	uc_value_t *rv, *obj;
+	size_t len, n, i, j, size = 0;
+	char *buf, *key;
+
+	if (!input)
+		return NULL;
+
+	if (ucv_type(input) != UC_STRING)
+		return uc_raise(vm, "Invalid input string");
+
+	n = lh_header_params(ucv_string_get(input), ucv_string_length(input),
+	                     params, 16);
+
+	if (n > 16) {
+		params = calloc(n, sizeof(*params));
+
+		if (!params)
+			return uc_raise(vm, "Out of memory");
+
+		lh_header_params(ucv_string_get(input), ucv_string_length(input),
+		                 params, n);
+	}
+
+	/* one scratch buffer holds the lower case name and the decoded value */
+	for (i = 0; i < n; i++)
+		if (params[i].namelen + params[i].valuelen + 2 > size)
+			size = params[i].namelen + params[i].valuelen + 2;
+
+	buf = malloc(size ? size : 1);
+
+	if (!buf) {
+		if (params != stack)
+			free(params);
+
+		return uc_raise(vm, "Out of memory");
+	}
+
+	rv = ucv_object_new(vm);
+	obj = ucv_object_new(vm);
+
+	for (i = 0; i < n; i++) {
+		len = lh_header_param_value(&params[i], buf, size);
+
+		if (!params[i].name) {
+			ucv_object_add(rv, "type", ucv_string_new_length(buf, len));
+			continue;
+		}
+
+		key = buf + len + 1;
+
+		for (j = 0; j < params[i].namelen; j++)
+			key[j] = lh_uc_lower(params[i].name[j]);
+
+		key[j] = 0;
+
+		if (!ucv_object_get(obj, key, NULL))
+			ucv_object_add(obj, key, ucv_string_new_length(buf, len));
+	}
+
+	ucv_object_add(rv, "params", obj);
+
+	if (params != stack)
+		free(params);
+
+	free(buf);
+
+	return rv;
+}
+
+static uc_value_t *
+lh_uc_progress(uc_vm_t *vm, size_t nargs)
+{
+	uc_value_t *path = uc_fn_arg(0);
+	struct lh_progress_info info;
+	struct lh_progress *pr;
+	uc_value_t *rv;
+
+	if (ucv_type(path) != UC_STRING)
+		return uc_raise(vm, "Invalid path argument");
+
+	pr = lh_progress_attach(ucv_string_get(path));
+
+	if (!pr)
+		return NULL;
+
+	if (!lh_progress_read(pr, &info)) {
+		lh_progress_close(pr);
+
+		return NULL;
+	}
+
+	lh_progress_close(pr);
+
+	rv = ucv_object_new(vm);
+
+	ucv_object_add(rv, "bytes", ucv_uint64_new(info.bytes));
+	ucv_object_add(rv, "total", ucv_uint64_new(info.total));
+	ucv_object_add(rv, "part", ucv_uint64_new(info.part));
+	ucv_object_add(rv, "name", ucv_string_new(info.name));
+	ucv_object_add(rv, "done",
+		ucv_boolean_new(info.status != LH_PROGRESS_RUNNING));
+	ucv_object_add(rv, "failed",
+		ucv_boolean_new(info.status == LH_PROGRESS_FAILED));
+
+	return rv;
+}
+
+/*
+ * Set the limit of the process wide memory budget which parsers created
+ * afterwards draw from, return the amount of memory in use and the limit.
+ */
+
+static uc_value_t *
+lh_uc_memory_budget(uc_vm_t *vm, size_t nargs)
+{
+	struct lh_budget *b = lh_budget_default();
+	uc_value_t *limitarg = uc_fn_arg(0);
+	uc_value_t *rv;
+	size_t limit;
+
+	if (limitarg) {
+		limit = ucv_uint64_get(limitarg);
+
+		if (errno)
+			return uc_raise(vm, "Invalid limit argument");
+
+		if (!b) {
+			b = lh_budget_new(0);
+
+			if (!b)
+				return uc_raise(vm, "Out of memory");
+
+			lh_budget_set_default(b);
+		}
+
+		lh_budget_set_limit(b, limit);
+	}
+
+	rv = ucv_object_new(vm);
+
+	ucv_object_add(rv, "used", ucv_uint64_new(b ? lh_budget_used(b) : 0));
+	ucv_object_add(rv, "limit", ucv_uint64_new(b ? b->limit : 0));
+
+	return rv;
+}
+
+
 /*
  * module tables
  * -------------------------------------------------------------------------
  */
 
 static const uc_function_list_t mpart_fns[] = {
-	{ "parse", lh_uc_mpart_parse }
+	{ "parse",                 lh_uc_mpart_parse                 },
+	{ "set_chunk_size",        lh_uc_mpart_set_chunk_size        },
+	{ "set_body_limit",        lh_uc_mpart_set_body_limit        },
+	{ "set_inflate_limit",     lh_uc_mpart_set_inflate_limit     },
+	{ "set_content_length",    lh_uc_mpart_set_content_length    },
+	{ "set_content_encoding",  lh_uc_mpart_set_content_encoding  },
+	{ "set_transfer_decoding", lh_uc_mpart_set_transfer_decoding },
+	{ "set_progress",          lh_uc_mpart_set_progress          },
+	{ "set_tee",               lh_uc_mpart_set_tee               },
+	{ "set_form",              lh_uc_mpart_set_form              },
+	{ "set_form_path",         lh_uc_mpart_set_form_path         },
+	{ "form",                  lh_uc_mpart_form                  },
+	{ "form_fd",               lh_uc_mpart_form_fd               },
+	{ "field",                 lh_uc_mpart_field                 },
+	{ "set_fields",            lh_uc_mpart_set_fields            },
+	{ "set_untar",             lh_uc_mpart_set_untar             }
 };
 
 static const uc_function_list_t urldec_fns[] = {
-	{ "parse", lh_uc_urldec_parse }
+	{ "parse",                lh_uc_urldec_parse                },
+	{ "parse_tuples",         lh_uc_urldec_parse_tuples         },
+	{ "set_body_limit",       lh_uc_urldec_set_body_limit       },
+	{ "set_inflate_limit",    lh_uc_urldec_set_inflate_limit    },
+	{ "set_content_length",   lh_uc_urldec_set_content_length   },
+	{ "set_content_encoding", lh_uc_urldec_set_content_encoding },
+	{ "set_tee",              lh_uc_urldec_set_tee              },
+	{ "set_form",             lh_uc_urldec_set_form             },
+	{ "set_decode",           lh_uc_urldec_set_decode           },
+	{ "form",                 lh_uc_urldec_form                 },
+	{ "form_fd",              lh_uc_urldec_form_fd              },
+	{ "field",                lh_uc_urldec_field                },
+	{ "set_fields",           lh_uc_urldec_set_fields           },
+	{ "set_paths",            lh_uc_urldec_set_paths            },
+	{ "tree",                 lh_uc_urldec_tree                 }
+};
+
+static const uc_function_list_t untar_fns[] = {
+	{ "parse",  lh_uc_untar_parse  },
+	{ "member", lh_uc_untar_member },
+	{ "error",  lh_uc_untar_error  }
 };
 
 static const uc_function_list_t global_fns[] = {
 	{ "multipart_parser",  lh_uc_mpart_new        },
 	{ "urlencoded_parser", lh_uc_urldec_new       },
+	{ "untar",             lh_uc_untar_new        },
 	{ "urlencode",         lh_uc_urlencode        },
 	{ "urldecode",         lh_uc_urldecode        },
-	{ "header_attribute",  lh_uc_header_attribute }
+	{ "base64_encode",     lh_uc_base64_encode    },
+	{ "base64_decode",     lh_uc_base64_decode    },
+	{ "query_get",         lh_uc_query_get        },
+	{ "header_attribute",  lh_uc_header_attribute },
+	{ "header_params",     lh_uc_header_params    },
+	{ "progress",          lh_uc_progress         },
+	{ "memory_budget",     lh_uc_memory_budget    }
 };
 
 
@@ -405,8 +1638,10 @@ static const uc_function_list_t global_fns[] = {
 	ucv_object_add(obj, #key, ucv_uint64_new(defkey))
 
 #define add_const_global(obj, key) add_const(obj, key, LH_URL ## key)
+#define add_const_base64(obj, key) add_const(obj, key, LH_ ## key)
 #define add_const_mpart(obj, key) add_const(obj, key, LH_MP_CB_ ## key)
 #define add_const_urldec(obj, key) add_const(obj, key, LH_UD_CB_ ## key)
+#define add_const_untar(obj, key) add_const(obj, key, LH_UT_CB_ ## key)
 
 void uc_module_init(uc_vm_t *vm, uc_value_t *scope)
 {
@@ -419,6 +1654,8 @@ void uc_module_init(uc_vm_t *vm, uc_value_t *scope)
 	add_const_global(scope, DECODE_IF_NEEDED);
 	add_const_global(scope, DECODE_KEEP_PLUS);
 	add_const_global(scope, DECODE_PLUS);
+	add_const_base64(scope, BASE64_URL);
+	add_const_base64(scope, BASE64_NO_PAD);
 
 
 	mpart_type = uc_type_declare(vm, "lucihttp.parser.multipart", mpart_fns, lh_uc_mpart__gc);
@@ -442,4 +1679,14 @@ void uc_module_init(uc_vm_t *vm, uc_value_t *scope)
 	add_const_urldec(urldec_type->proto, VALUE);
 	add_const_urldec(urldec_type->proto, EOF);
 	add_const_urldec(urldec_type->proto, ERROR);
+	add_const_urldec(urldec_type->proto, SEGMENT);
+
+
+	untar_type = uc_type_declare(vm, "lucihttp.untar", untar_fns, lh_uc_untar__gc);
+
+	add_const_untar(untar_type->proto, MEMBER_BEGIN);
+	add_const_untar(untar_type->proto, MEMBER_DATA);
+	add_const_untar(untar_type->proto, MEMBER_END);
+	add_const_untar(untar_type->proto, EOF);
+	add_const_untar(untar_type->proto, ERROR);
 }
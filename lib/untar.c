@@ -0,0 +1,764 @@
+/*
+ * lucihttp - HTTP utility library - streaming tar extraction component
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <lucihttp/untar.h>
+#include <lucihttp/inflate.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+
+static const char *lh_untar_state_descriptions[] = {
+	"start of archive",
+	"reading member header",
+	"reading extended header",
+	"reading member data",
+	"reading member padding",
+	"end of archive",
+	"extractor error state"
+};
+
+
+static void
+lh_untar_set_state(struct lh_untar *u, enum lh_untar_state stateval)
+{
+	if (u->trace)
+		fprintf(u->trace, "State %d (%s) -> %d (%s)\n",
+		        u->state, lh_untar_state_descriptions[u->state],
+		        stateval, lh_untar_state_descriptions[stateval]);
+
+	u->state = stateval;
+}
+
+static bool
+_lh_untar_invoke(struct lh_untar *u, enum lh_untar_callback_type type,
+                 const char *typename, const char *buf, size_t len)
+{
+	if (u->trace)
+		fprintf(u->trace, "Callback %d (%s) %zu bytes\n",
+		        type, typename, len);
+
+	if (u->cb)
+		return u->cb(u, type, buf, len, u->priv);
+
+	return true;
+}
+
+#define lh_untar_invoke(u, type, buf, len) \
+	_lh_untar_invoke(u, LH_UT_CB_##type, #type, buf, len)
+
+static bool
+lh_untar_error(struct lh_untar *u, const char *fmt, ...)
+{
+	va_list ap;
+	char *msg;
+	int rv;
+
+	va_start(ap, fmt);
+	rv = vasprintf(&msg, fmt, ap);
+	va_end(ap);
+
+	if (rv != -1) {
+		rv = asprintf(&u->error, "At %s, archive offset %lu, %s",
+		              lh_untar_state_descriptions[u->state],
+		              (unsigned long)u->total, msg);
+		free(msg);
+	}
+
+	lh_untar_invoke(u, ERROR, (rv == -1) ? "Out of memory" : u->error,
+	                          (rv == -1) ? 13 : rv);
+
+	lh_untar_set_state(u, LH_UT_S_ERROR);
+
+	return false;
+}
+
+struct lh_untar *
+lh_untar_new(FILE *trace)
+{
+	struct lh_untar *u;
+
+	u = calloc(1, sizeof(*u));
+
+	if (!u)
+		return NULL;
+
+	u->trace = trace;
+	u->dirfd = -1;
+	u->fd = -1;
+
+	return u;
+}
+
+void
+lh_untar_set_callback(struct lh_untar *u, lh_untar_callback cb, void *priv)
+{
+	u->cb = cb;
+	u->priv = priv;
+}
+
+/*
+ * Extract the archive members below the given directory. Members with
+ * absolute names or names containing ".." components are rejected, and
+ * symbolic links are never followed while resolving member paths.
+ *
+ * Members for which the MEMBER_BEGIN callback returns false are skipped.
+ *
+ * Returns false and sets errno if the directory cannot be opened.
+ */
+
+bool
+lh_untar_set_directory(struct lh_untar *u, const char *path)
+{
+	int fd;
+
+	fd = open(path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+
+	if (fd == -1)
+		return false;
+
+	if (u->dirfd != -1)
+		close(u->dirfd);
+
+	u->dirfd = fd;
+
+	return true;
+}
+
+static uint64_t
+lh_untar_number(const char *field, size_t len)
+{
+	uint64_t n = 0;
+	size_t i = 0;
+
+	/* GNU base-256 encoding for values exceeding the octal field size */
+	if (field[0] & 0x80) {
+		n = field[0] & 0x3f;
+
+		for (i = 1; i < len; i++)
+			n = (n << 8) | (unsigned char)field[i];
+
+		return n;
+	}
+
+	while (i < len && field[i] == ' ')
+		i++;
+
+	while (i < len && field[i] >= '0' && field[i] <= '7')
+		n = (n << 3) | (field[i++] - '0');
+
+	return n;
+}
+
+static char *
+lh_untar_field(const char *field, size_t len)
+{
+	return strndup(field, strnlen(field, len));
+}
+
+/*
+ * Normalize the given member name in place by removing "." components,
+ * duplicate and trailing slashes. Returns false if the name is absolute
+ * or refers to a parent directory.
+ */
+
+static bool
+lh_untar_sanitize(char *name)
+{
+	char *s = name, *d = name, *e;
+	size_t len;
+
+	if (*name == '/')
+		return false;
+
+	while (*s) {
+		e = strchrnul(s, '/');
+		len = e - s;
+
+		if (len == 2 && s[0] == '.' && s[1] == '.')
+			return false;
+
+		if (len && !(len == 1 && s[0] == '.')) {
+			if (d > name)
+				*d++ = '/';
+
+			memmove(d, s, len);
+			d += len;
+		}
+
+		s = *e ? e + 1 : e;
+	}
+
+	*d = 0;
+
+	return true;
+}
+
+/*
+ * Open the directory containing the given sanitized path relative to the
+ * target directory, optionally creating missing intermediate directories.
+ * Each component is opened without following symbolic links.
+ */
+
+static int
+lh_untar_open_parent(struct lh_untar *u, char *path, bool create,
+                     const char **base)
+{
+	int fd = u->dirfd, nfd;
+	char *s = path, *e;
+
+	while ((e = strchr(s, '/')) != NULL) {
+		*e = 0;
+
+		if (create && mkdirat(fd, s, 0755) == -1 && errno != EEXIST)
+			nfd = -1;
+		else
+			nfd = openat(fd, s, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+
+		*e = '/';
+
+		if (fd != u->dirfd)
+			close(fd);
+
+		if (nfd == -1)
+			return -1;
+
+		fd = nfd;
+		s = e + 1;
+	}
+
+	*base = s;
+
+	return fd;
+}
+
+static void
+lh_untar_close_parent(struct lh_untar *u, int fd)
+{
+	int err = errno;
+
+	if (fd != -1 && fd != u->dirfd)
+		close(fd);
+
+	errno = err;
+}
+
+static bool
+lh_untar_create(struct lh_untar *u)
+{
+	struct lh_untar_member *m = &u->member;
+	const char *base, *lbase;
+	int fd, lfd, rv = -1;
+
+	fd = lh_untar_open_parent(u, m->name, true, &base);
+
+	if (fd == -1)
+		goto err;
+
+	switch (m->type) {
+	case LH_UT_M_DIRECTORY:
+		rv = mkdirat(fd, base, (m->mode & 0777) | 0700);
+
+		if (rv == -1 && errno == EEXIST)
+			rv = 0;
+
+		break;
+
+	case LH_UT_M_FILE:
+		/* replace existing files, symbolic and hard links instead of
+		 * writing through them, never restore setuid and setgid bits */
+		if (unlinkat(fd, base, 0) == -1 && errno != ENOENT)
+			break;
+
+		u->fd = openat(fd, base, O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW|O_CLOEXEC,
+		               m->mode & 0777);
+
+		rv = u->fd;
+		break;
+
+	case LH_UT_M_SYMLINK:
+		unlinkat(fd, base, 0);
+		rv = symlinkat(m->linkname, fd, base);
+		break;
+
+	case LH_UT_M_HARDLINK:
+		lfd = lh_untar_open_parent(u, m->linkname, false, &lbase);
+
+		if (lfd != -1) {
+			unlinkat(fd, base, 0);
+			rv = linkat(lfd, lbase, fd, base, 0);
+			lh_untar_close_parent(u, lfd);
+		}
+
+		break;
+
+	default:
+		rv = 0;
+		break;
+	}
+
+	lh_untar_close_parent(u, fd);
+
+	if (rv != -1)
+		return true;
+
+err:
+	return lh_untar_error(u, "unable to create member '%s': %s",
+	                      m->name, strerror(errno));
+}
+
+static bool
+lh_untar_end_member(struct lh_untar *u)
+{
+	struct timespec ts[2] = {
+		{ .tv_sec = u->member.mtime },
+		{ .tv_sec = u->member.mtime }
+	};
+	int rv = 0;
+
+	if (u->fd != -1) {
+		futimens(u->fd, ts);
+		rv = close(u->fd);
+		u->fd = -1;
+	}
+
+	if (rv == -1)
+		return lh_untar_error(u, "unable to write member '%s': %s",
+		                      u->member.name, strerror(errno));
+
+	if (!(u->flags & LH_UT_F_SKIP))
+		lh_untar_invoke(u, MEMBER_END, NULL, 0);
+
+	u->remain = (LH_UT_BLOCK_SIZE - (u->member.size % LH_UT_BLOCK_SIZE)) %
+	            LH_UT_BLOCK_SIZE;
+
+	lh_untar_set_state(u, LH_UT_S_PADDING);
+
+	return true;
+}
+
+static bool
+lh_untar_begin_member(struct lh_untar *u)
+{
+	struct lh_untar_member *m = &u->member;
+	const char *h = u->block;
+	uint64_t sum, chk;
+	bool ustar;
+	size_t i;
+
+	chk = lh_untar_number(h + 148, 8);
+
+	for (sum = 0, i = 0; i < LH_UT_BLOCK_SIZE; i++)
+		sum += (i >= 148 && i < 156) ? ' ' : (unsigned char)h[i];
+
+	if (sum != chk)
+		return lh_untar_error(u, "invalid member header checksum");
+
+	u->remain = lh_untar_number(h + 124, 12);
+	ustar = !memcmp(h + 257, "ustar", 5);
+
+	switch (h[156]) {
+	case 'L':
+	case 'K':
+	case 'x':
+		if (u->remain > LH_UT_META_SIZE_LIMIT)
+			return lh_untar_error(u, "the extended header exceeds the "
+			                         "maximum allowed size");
+
+		u->meta_type = h[156];
+		u->metalen = 0;
+
+		if (!u->meta && !(u->meta = malloc(LH_UT_META_SIZE_LIMIT + 1)))
+			return lh_untar_error(u, "out of memory");
+
+		lh_untar_set_state(u, LH_UT_S_META);
+
+		return true;
+
+	case 'g':
+		/* skip global extended headers */
+		u->remain = (u->remain + LH_UT_BLOCK_SIZE - 1) &
+		            ~(uint64_t)(LH_UT_BLOCK_SIZE - 1);
+
+		lh_untar_set_state(u, LH_UT_S_PADDING);
+
+		return true;
+
+	case '0':
+	case '7':
+	case '\0':
+		m->type = LH_UT_M_FILE;
+		break;
+
+	case '1':
+		m->type = LH_UT_M_HARDLINK;
+		break;
+
+	case '2':
+		m->type = LH_UT_M_SYMLINK;
+		break;
+
+	case '5':
+		m->type = LH_UT_M_DIRECTORY;
+		break;
+
+	default:
+		m->type = LH_UT_M_OTHER;
+		break;
+	}
+
+	if (!(u->flags & LH_UT_F_LONGNAME)) {
+		free(m->name);
+
+		if (ustar && h[345]) {
+			if (asprintf(&m->name, "%.*s/%.*s",
+			             (int)strnlen(h + 345, 155), h + 345,
+			             (int)strnlen(h, 100), h) == -1)
+				m->name = NULL;
+		}
+		else
+			m->name = lh_untar_field(h, 100);
+	}
+
+	if (!(u->flags & LH_UT_F_LONGLINK)) {
+		free(m->linkname);
+		m->linkname = lh_untar_field(h + 157, 100);
+	}
+
+	u->flags &= ~(LH_UT_F_LONGNAME|LH_UT_F_LONGLINK|LH_UT_F_SKIP);
+
+	if (!m->name || !m->linkname)
+		return lh_untar_error(u, "out of memory");
+
+	m->mode = lh_untar_number(h + 100, 8);
+	m->mtime = lh_untar_number(h + 136, 12);
+	m->size = (m->type == LH_UT_M_FILE) ? u->remain : 0;
+
+	if (!lh_untar_sanitize(m->name) ||
+	    (m->type == LH_UT_M_HARDLINK && !lh_untar_sanitize(m->linkname)))
+		return lh_untar_error(u, "refusing to extract unsafe member '%s'",
+		                      m->name);
+
+	/* skip the archive root entry */
+	if (!*m->name || !lh_untar_invoke(u, MEMBER_BEGIN, m->name,
+	                                  strlen(m->name)))
+		u->flags |= LH_UT_F_SKIP;
+	else if (u->dirfd != -1 && !lh_untar_create(u))
+		return false;
+
+	if (m->type == LH_UT_M_FILE) {
+		if (!u->remain)
+			return lh_untar_end_member(u);
+
+		lh_untar_set_state(u, LH_UT_S_DATA);
+
+		return true;
+	}
+
+	if (!(u->flags & LH_UT_F_SKIP))
+		lh_untar_invoke(u, MEMBER_END, NULL, 0);
+
+	u->remain = (u->remain + LH_UT_BLOCK_SIZE - 1) &
+	            ~(uint64_t)(LH_UT_BLOCK_SIZE - 1);
+
+	lh_untar_set_state(u, LH_UT_S_PADDING);
+
+	return true;
+}
+
+static bool
+lh_untar_write(struct lh_untar *u, const char *buf, size_t len)
+{
+	ssize_t rv;
+
+	if (u->fd != -1) {
+		while (len > 0) {
+			rv = write(u->fd, buf, len);
+
+			if (rv == -1) {
+				if (errno == EINTR)
+					continue;
+
+				return lh_untar_error(u, "unable to write member '%s': %s",
+				                      u->member.name, strerror(errno));
+			}
+
+			buf += rv;
+			len -= rv;
+		}
+	}
+	else if (!(u->flags & LH_UT_F_SKIP)) {
+		lh_untar_invoke(u, MEMBER_DATA, buf, len);
+	}
+
+	return true;
+}
+
+/*
+ * Parse the records of a pax extended header, only the path and linkpath
+ * keywords are honoured.
+ */
+
+static void
+lh_untar_parse_pax(struct lh_untar *u)
+{
+	char *s = u->meta, *e = u->meta + u->metalen, *kw, *val, *end;
+	unsigned long len;
+
+	while (s < e) {
+		len = strtoul(s, &kw, 10);
+
+		if (!len || len > (unsigned long)(e - s) || *kw++ != ' ')
+			break;
+
+		end = s + len - 1;
+
+		/* the record must extend past its own length prefix */
+		if (end <= kw || *end != '\n')
+			break;
+
+		val = memchr(kw, '=', end - kw);
+
+		if (!val)
+			break;
+
+		*val++ = 0;
+
+		if (!strcmp(kw, "path")) {
+			free(u->member.name);
+			u->member.name = strndup(val, end - val);
+			u->flags |= LH_UT_F_LONGNAME;
+		}
+		else if (!strcmp(kw, "linkpath")) {
+			free(u->member.linkname);
+			u->member.linkname = strndup(val, end - val);
+			u->flags |= LH_UT_F_LONGLINK;
+		}
+
+		s = end + 1;
+	}
+}
+
+static void
+lh_untar_end_meta(struct lh_untar *u)
+{
+	u->meta[u->metalen] = 0;
+
+	switch (u->meta_type) {
+	case 'L':
+		free(u->member.name);
+		u->member.name = strdup(u->meta);
+		u->flags |= LH_UT_F_LONGNAME;
+		break;
+
+	case 'K':
+		free(u->member.linkname);
+		u->member.linkname = strdup(u->meta);
+		u->flags |= LH_UT_F_LONGLINK;
+		break;
+
+	case 'x':
+		lh_untar_parse_pax(u);
+		break;
+	}
+
+	u->remain = (LH_UT_BLOCK_SIZE - (u->metalen % LH_UT_BLOCK_SIZE)) %
+	            LH_UT_BLOCK_SIZE;
+
+	lh_untar_set_state(u, LH_UT_S_PADDING);
+}
+
+static bool
+lh_untar_consume(struct lh_untar *u, const char *buf, size_t len)
+{
+	size_t n;
+
+	while (len > 0) {
+		switch (u->state) {
+		case LH_UT_S_START:
+		case LH_UT_S_HEADER:
+			n = LH_UT_BLOCK_SIZE - u->blocklen;
+			n = (len < n) ? len : n;
+
+			memcpy(u->block + u->blocklen, buf, n);
+			u->blocklen += n;
+			u->total += n;
+
+			if (u->blocklen < LH_UT_BLOCK_SIZE)
+				break;
+
+			u->blocklen = 0;
+
+			/* two consecutive zero blocks mark the end of the archive */
+			if (!u->block[0] &&
+			    !memcmp(u->block, u->block + 1, LH_UT_BLOCK_SIZE - 1)) {
+				if (u->flags & LH_UT_F_ZEROBLOCK)
+					lh_untar_set_state(u, LH_UT_S_END);
+
+				u->flags |= LH_UT_F_ZEROBLOCK;
+				break;
+			}
+
+			u->flags &= ~LH_UT_F_ZEROBLOCK;
+
+			if (!lh_untar_begin_member(u))
+				return false;
+
+			break;
+
+		case LH_UT_S_META:
+			n = (len < u->remain) ? len : u->remain;
+
+			memcpy(u->meta + u->metalen, buf, n);
+			u->metalen += n;
+			u->remain -= n;
+			u->total += n;
+
+			if (!u->remain)
+				lh_untar_end_meta(u);
+
+			break;
+
+		case LH_UT_S_DATA:
+			n = (len < u->remain) ? len : u->remain;
+
+			if (n && !lh_untar_write(u, buf, n))
+				return false;
+
+			u->remain -= n;
+			u->total += n;
+
+			if (!u->remain && !lh_untar_end_member(u))
+				return false;
+
+			break;
+
+		case LH_UT_S_PADDING:
+			n = (len < u->remain) ? len : u->remain;
+			u->remain -= n;
+			u->total += n;
+			break;
+
+		case LH_UT_S_END:
+			/* ignore trailing data after the end of archive marker */
+			n = len;
+			u->total += n;
+			break;
+
+		default:
+			return lh_untar_error(u, "extractor is in unrecoverable "
+			                         "error state");
+		}
+
+		if (u->state == LH_UT_S_PADDING && !u->remain)
+			lh_untar_set_state(u, LH_UT_S_HEADER);
+
+		buf += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+static bool
+lh_untar_inflate_cb(const char *buf, size_t len, void *priv)
+{
+	return lh_untar_consume(priv, buf, len);
+}
+
+/*
+ * Feed the given archive data to the extractor. Gzip compressed archives
+ * are detected and inflated on the fly; the memory used is bounded and
+ * independent of the size of the archive.
+ *
+ * Passing a NULL buffer signals the end of the archive.
+ */
+
+bool
+lh_untar_parse(struct lh_untar *u, const char *buf, size_t len)
+{
+	if (u->state == LH_UT_S_ERROR)
+		return lh_untar_error(u, "extractor is in unrecoverable error state");
+
+	if (!buf) {
+		if (u->inflate &&
+		    !lh_inflate_parse(u->inflate, NULL, 0, lh_untar_inflate_cb, u))
+			return lh_untar_error(u, "%s", u->inflate->error);
+
+		if (u->state != LH_UT_S_END &&
+		    (u->state != LH_UT_S_HEADER || u->blocklen))
+			return lh_untar_error(u, "the archive is truncated");
+
+		lh_untar_invoke(u, EOF, NULL, 0);
+
+		return true;
+	}
+
+	if (!len)
+		return true;
+
+	if (u->state == LH_UT_S_START) {
+		if ((unsigned char)buf[0] == 0x1f) {
+			u->inflate = lh_inflate_new(0);
+
+			if (!u->inflate)
+				return lh_untar_error(u, "out of memory");
+		}
+
+		lh_untar_set_state(u, LH_UT_S_HEADER);
+	}
+
+	if (!u->inflate)
+		return lh_untar_consume(u, buf, len);
+
+	if (!lh_inflate_parse(u->inflate, buf, len, lh_untar_inflate_cb, u)) {
+		if (u->inflate->error)
+			return lh_untar_error(u, "invalid compressed data: %s",
+			                      u->inflate->error);
+
+		return false;
+	}
+
+	return true;
+}
+
+void
+lh_untar_free(struct lh_untar *u)
+{
+	if (u->inflate)
+		lh_inflate_free(u->inflate);
+
+	if (u->fd != -1)
+		close(u->fd);
+
+	if (u->dirfd != -1)
+		close(u->dirfd);
+
+	free(u->member.name);
+	free(u->member.linkname);
+	free(u->meta);
+	free(u->error);
+	free(u);
+}
@@ -19,10 +19,27 @@
 #define _GNU_SOURCE
 
 #include <lucihttp/urlencoded-parser.h>
+#include <lucihttp/tee.h>
+#include <lucihttp/inflate.h>
+#include <lucihttp/form.h>
+#include <lucihttp/budget.h>
+#include <lucihttp/fieldset.h>
+#include <lucihttp/utils.h>
+
+#include "hex.h"
 
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <errno.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#endif
 
 
 static const char *lh_urldec_state_descriptions[] = {
@@ -71,6 +88,10 @@ _lh_urldec_invoke(struct lh_urldec *p, enum lh_urldec_callback_type type,
 		lh_urldec_dump(p->trace, "data", buf, len);
 	}
 
+	/* never pass on data truncated by an exhausted budget */
+	if ((p->flags & LH_UD_F_BUDGET) && type != LH_UD_CB_ERROR)
+		return false;
+
 	if (p->cb)
 		return p->cb(p, type, buf, len, p->priv);
 
@@ -81,25 +102,66 @@ _lh_urldec_invoke(struct lh_urldec *p, enum lh_urldec_callback_type type,
 	_lh_urldec_invoke(p, LH_UD_CB_##type, #type, buf, len)
 
 static bool
-lh_urldec_set_token(struct lh_urldec *p, enum lh_urldec_token_type type,
-                    bool clear, const char *buf, size_t len)
+lh_urldec_charge(struct lh_urldec *p, size_t len)
+{
+	if (p->budget && !lh_budget_acquire(p->budget, len)) {
+		p->flags |= LH_UD_F_BUDGET;
+
+		return false;
+	}
+
+	p->reserved += len;
+
+	return true;
+}
+
+static void
+lh_urldec_uncharge(struct lh_urldec *p, size_t len)
+{
+	if (p->budget)
+		lh_budget_release(p->budget, len);
+
+	p->reserved -= len;
+}
+
+static bool
+lh_urldec_reserve_token(struct lh_urldec *p, enum lh_urldec_token_type type,
+                        size_t len)
 {
 	struct lh_urldec_token *tok = &p->token[type];
 	char *tmp;
 
-	if (clear)
-		tok->len = 0;
+	if (len + 1 > tok->size) {
+		if (!lh_urldec_charge(p, len + 1 - tok->size))
+			return false;
+
+		tmp = realloc(tok->value, len + 1);
 
-	if (len + tok->len + 1 > tok->size) {
-		tmp = realloc(tok->value, len + tok->len + 1);
+		if (!tmp) {
+			lh_urldec_uncharge(p, len + 1 - tok->size);
 
-		if (!tmp)
 			return false;
+		}
 
 		tok->value = tmp;
-		tok->size = len + tok->len + 1;
+		tok->size = len + 1;
 	}
 
+	return true;
+}
+
+static bool
+lh_urldec_set_token(struct lh_urldec *p, enum lh_urldec_token_type type,
+                    bool clear, const char *buf, size_t len)
+{
+	struct lh_urldec_token *tok = &p->token[type];
+
+	if (clear)
+		tok->len = 0;
+
+	if (!lh_urldec_reserve_token(p, type, len + tok->len))
+		return false;
+
 	if (len) {
 		memcpy(tok->value + tok->len, buf, len);
 		tok->value[tok->len + len] = 0;
@@ -109,6 +171,85 @@ lh_urldec_set_token(struct lh_urldec *p, enum lh_urldec_token_type type,
 	return true;
 }
 
+static char *
+lh_urldec_decode_byte(struct lh_urldec *p, char *out, char c)
+{
+	char pending[3];
+	size_t i, n;
+
+	if (p->escape_len) {
+		p->escape[p->escape_len++] = c;
+
+		/* not an escape sequence, keep the percent sign and reparse the
+		 * bytes following it */
+		if (hex_to_dec(c) < 0) {
+			n = p->escape_len;
+			memcpy(pending, p->escape, n);
+			p->escape_len = 0;
+
+			*out++ = '%';
+
+			for (i = 1; i < n; i++)
+				out = lh_urldec_decode_byte(p, out, pending[i]);
+		}
+		else if (p->escape_len == 3) {
+			*out++ = (char)(16 * hex_to_dec(p->escape[1]) +
+			                hex_to_dec(p->escape[2]));
+
+			p->escape_len = 0;
+		}
+	}
+	else if (c == '%') {
+		p->escape[p->escape_len++] = c;
+	}
+	else if (c == '+') {
+		*out++ = ' ';
+	}
+	else {
+		*out++ = c;
+	}
+
+	return out;
+}
+
+/*
+ * Percent decode the given data and append it to the token. An incomplete
+ * escape sequence at the end of the data is held back until the next call,
+ * it is appended literally if the data is final.
+ */
+static bool
+lh_urldec_decode_token(struct lh_urldec *p, enum lh_urldec_token_type type,
+                       const char *buf, size_t len, bool final)
+{
+	struct lh_urldec_token *tok = &p->token[type];
+	char *out;
+	size_t i;
+
+	if (!lh_urldec_reserve_token(p, type, tok->len + len + p->escape_len))
+		return false;
+
+	out = tok->value + tok->len;
+
+	for (i = 0; i < len; i++) {
+		if (!p->escape_len && buf[i] != '%' && buf[i] != '+')
+			*out++ = buf[i];
+		else
+			out = lh_urldec_decode_byte(p, out, buf[i]);
+	}
+
+	if (final) {
+		for (i = 0; i < p->escape_len; i++)
+			*out++ = p->escape[i];
+
+		p->escape_len = 0;
+	}
+
+	tok->len = out - tok->value;
+	tok->value[tok->len] = 0;
+
+	return true;
+}
+
 static char *
 lh_urldec_get_token(struct lh_urldec *p, enum lh_urldec_token_type type,
                     size_t *len)
@@ -147,9 +288,61 @@ lh_urldec_error(struct lh_urldec *p, size_t off, const char *fmt, ...)
 
 	lh_urldec_set_state(p, LH_UD_S_ERROR);
 
+	if (p->tee)
+		lh_tee_flush(p->tee);
+
 	return false;
 }
 
+/* report a failed token allocation, distinguishing an exhausted budget */
+static bool
+lh_urldec_nomem(struct lh_urldec *p, size_t off)
+{
+	if (p->flags & LH_UD_F_BUDGET)
+		return lh_urldec_error(p, off, "the memory budget is exhausted");
+
+	return lh_urldec_error(p, off, "out of memory");
+}
+
+/*
+ * Append the given name or value data to the token, percent decoding it
+ * if requested. Fails the parse if the token exceeds the size limit or its
+ * memory cannot be allocated.
+ */
+static bool
+lh_urldec_append_token(struct lh_urldec *p, enum lh_urldec_token_type type,
+                       size_t off, const char *buf, size_t len, bool final)
+{
+	struct lh_urldec_token *tok = &p->token[type];
+	bool ok;
+
+	if (p->flags & LH_UD_F_DECODE) {
+		/* escapes shrink the data to no less than a third */
+		if (tok->len + len / 3 > p->size_limit)
+			goto toolong;
+
+		ok = lh_urldec_decode_token(p, type, buf, len, final);
+
+		if (ok && tok->len + p->escape_len > p->size_limit)
+			goto toolong;
+	}
+	else {
+		if (tok->len + len > p->size_limit)
+			goto toolong;
+
+		ok = lh_urldec_set_token(p, type, false, buf, len);
+	}
+
+	if (ok)
+		return true;
+
+	return lh_urldec_nomem(p, off);
+
+toolong:
+	return lh_urldec_error(p, off, "the %s exceeds the maximum allowed size",
+	                       (type == LH_UD_T_NAME) ? "key" : "value");
+}
+
 struct lh_urldec *
 lh_urldec_new(FILE *trace)
 {
@@ -168,6 +361,8 @@ lh_urldec_init(struct lh_urldec *p, FILE *trace)
 
 	p->trace = trace;
 	p->size_limit = LH_UD_T_DEFAULT_SIZE_LIMIT;
+	p->inflate_limit = LH_UD_DEFAULT_INFLATE_LIMIT;
+	p->budget = lh_budget_default();
 
 	lh_urldec_set_state(p, LH_UD_S_NAME_START);
 
@@ -188,27 +383,438 @@ lh_urldec_set_size_limit(struct lh_urldec *p, size_t limit)
 		p->size_limit = limit;
 }
 
+/*
+ * Limit the total size of the urlencoded body. Bodies declaring a larger
+ * length through lh_urldec_set_content_length() are rejected up front.
+ * A limit of zero disables the check.
+ */
+
+void
+lh_urldec_set_body_limit(struct lh_urldec *p, size_t limit)
+{
+	p->body_limit = limit;
+}
+
+/*
+ * Limit the amount of data decompressed from a gzip or deflate encoded body,
+ * independently of the body limit which applies to the encoded data. Bodies
+ * inflating beyond it are rejected with an error. The limit defaults to
+ * LH_UD_DEFAULT_INFLATE_LIMIT bytes, zero disables the check.
+ */
+
+void
+lh_urldec_set_inflate_limit(struct lh_urldec *p, size_t limit)
+{
+	p->inflate_limit = limit;
+}
+
+/*
+ * Declare the expected total length of the urlencoded body, usually taken
+ * from the CONTENT_LENGTH environment variable.
+ *
+ * The parser uses the length to presize its internal buffers, raises an
+ * error as soon as the input exceeds the declared length and finishes the
+ * last tuple as soon as the declared amount of bytes has been consumed.
+ * Reaching the end of input before that is reported as truncation.
+ *
+ * Returns false and puts the parser into error state if the length exceeds
+ * the configured body limit.
+ */
+
+bool
+lh_urldec_set_content_length(struct lh_urldec *p, size_t len)
+{
+	size_t reserve = (len < p->size_limit) ? len : p->size_limit;
+
+	if (p->body_limit && len > p->body_limit)
+		return lh_urldec_error(p, 0, "the declared body length of %lu bytes "
+		                             "exceeds the maximum allowed size",
+		                       (unsigned long)len);
+
+	/* in span mode the token buffers are only needed for split tuples */
+	if (!(p->flags & LH_UD_F_SPANS)) {
+		lh_urldec_reserve_token(p, LH_UD_T_NAME, reserve);
+		lh_urldec_reserve_token(p, LH_UD_T_VALUE, reserve);
+	}
+
+	/* presizing is best effort, an exhausted budget is not an error yet */
+	p->flags &= ~LH_UD_F_BUDGET;
+
+	p->content_length = len;
+	p->flags |= LH_UD_F_LENGTH;
+
+	return true;
+}
+
+/*
+ * Mirror all input data to the given tee, e.g. to keep a replayable copy of
+ * the raw request body. The tee is flushed when reaching the end of the
+ * input or an error. The tee handle is not owned by the parser.
+ */
+
+void
+lh_urldec_set_tee(struct lh_urldec *p, struct lh_tee *t)
+{
+	p->tee = t;
+}
+
+/*
+ * Collect the percent decoded names and values of all buffered tuples into
+ * the given form snapshot. The parser does not invoke an EOF callback, the
+ * snapshot is complete once the final lh_urldec_parse() call with a NULL
+ * buffer returned, or once the last byte of a body with a declared length
+ * has been parsed. The snapshot is drawn from the memory budget of the
+ * parser, if it cannot cover the memory already held by the form, the next
+ * parse step fails. The form handle is not owned by the parser.
+ */
+
+void
+lh_urldec_set_form(struct lh_urldec *p, struct lh_form *f)
+{
+	p->form = f;
+
+	if (f && !lh_form_set_budget(f, p->budget))
+		p->flags |= LH_UD_F_BUDGET;
+}
+
+/*
+ * Let the parser percent decode names and values while tokenizing them, so
+ * that the NAME and VALUE callbacks receive decoded data and the form
+ * snapshot does not need to decode the fields again. Escape sequences split
+ * across input buffers are handled, size limits apply to the decoded
+ * length. Must be set before parsing any data.
+ */
+
+void
+lh_urldec_set_decode(struct lh_urldec *p, bool decode)
+{
+	if (decode)
+		p->flags |= LH_UD_F_DECODE;
+	else
+		p->flags &= ~LH_UD_F_DECODE;
+}
+
+/*
+ * Pass names and values of buffered tuples to the NAME and VALUE callbacks
+ * as pointers into the input buffer instead of copying them into the token
+ * buffers first. Only tuples split across input buffers are still copied,
+ * so parsing a query string held in a single buffer does not allocate when
+ * its length is declared through lh_urldec_set_content_length() beforehand.
+ * Has no effect while percent decoding is enabled.
+ */
+
+void
+lh_urldec_set_spans(struct lh_urldec *p, bool spans)
+{
+	if (spans)
+		p->flags |= LH_UD_F_SPANS;
+	else
+		p->flags &= ~LH_UD_F_SPANS;
+}
+
+/*
+ * Only deliver buffered tuples whose percent decoded name is part of the
+ * given field set. The values of other tuples are skipped without being
+ * buffered, size checked or passed to any callback, only the TUPLE callback
+ * announcing them is still invoked. Streamed tuples are not affected. NULL
+ * accepts all names again. The field set is not owned by the parser.
+ */
+
+void
+lh_urldec_set_fields(struct lh_urldec *p, struct lh_fieldset *s)
+{
+	p->fields = s;
+}
+
+/*
+ * Split the percent decoded names of buffered tuples into bracket path
+ * segments, so that "opts[a][b]" is reported as "opts", "a" and "b" and
+ * "dns[]" as "dns" followed by an append segment. The segments are passed
+ * to the SEGMENT callback after the NAME callback of each tuple, append
+ * segments are signalled by a NULL buffer. Streamed tuples are not split.
+ */
+
+void
+lh_urldec_set_paths(struct lh_urldec *p, bool paths)
+{
+	if (paths)
+		p->flags |= LH_UD_F_PATHS;
+	else
+		p->flags &= ~LH_UD_F_PATHS;
+}
+
+/*
+ * Draw the token buffers of the parser and the attached form snapshot from
+ * the given memory budget instead of the process wide default one, NULL
+ * disables the accounting. Memory already held by the parser and the form
+ * is moved over to the new budget. Once the budget is exhausted, the parser
+ * fails with an error and sets the LH_UD_F_BUDGET flag. The budget is not
+ * owned by the parser.
+ *
+ * Returns false if the new budget cannot cover the memory already held.
+ */
+
+bool
+lh_urldec_set_budget(struct lh_urldec *p, struct lh_budget *b)
+{
+	struct lh_budget *old = p->budget;
+
+	if (b == old)
+		return true;
+
+	if (b && !lh_budget_acquire(b, p->reserved))
+		return false;
+
+	if (p->form && !lh_form_set_budget(p->form, b)) {
+		if (b)
+			lh_budget_release(b, p->reserved);
+
+		return false;
+	}
+
+	if (old)
+		lh_budget_release(old, p->reserved);
+
+	p->budget = b;
+
+	return true;
+}
+
+/*
+ * Set the content encoding of the body. Bodies encoded with gzip or deflate
+ * are decompressed on the fly before being parsed, the amount of
+ * decompressed data is subject to the configured inflate limit. Passing NULL
+ * or "identity" disables the decompression.
+ *
+ * Returns false if the encoding is not supported.
+ */
+
+bool
+lh_urldec_set_content_encoding(struct lh_urldec *p, const char *encoding)
+{
+	if (!encoding || !strcasecmp(encoding, "identity")) {
+		if (p->inflate)
+			lh_inflate_free(p->inflate);
+
+		p->inflate = NULL;
+
+		return true;
+	}
+
+	if (!lh_inflate_supported(encoding))
+		return false;
+
+	if (!p->inflate)
+		p->inflate = lh_inflate_new(0);
+
+	return !!p->inflate;
+}
+
 #define EOB (-2)
 
+static bool
+lh_urldec_is_path(const char *name, size_t len)
+{
+	const char *e = name + len, *s = memchr(name, '[', len);
+
+	if (!s || s == name || memchr(name, ']', s - name))
+		return false;
+
+	while (s < e) {
+		if (*s++ != '[')
+			return false;
+
+		while (s < e && *s != '[' && *s != ']')
+			s++;
+
+		if (s++ == e || s[-1] != ']')
+			return false;
+	}
+
+	return true;
+}
+
+static void
+lh_urldec_emit_path(struct lh_urldec *p, const char *key, size_t keylen)
+{
+	size_t off = 0, seglen;
+	const char *seg;
+	char *dkey = NULL;
+
+	if (!(p->flags & LH_UD_F_DECODE)) {
+		dkey = lh_urldecode(key, keylen, &keylen, LH_URLDECODE_PLUS);
+
+		if (!dkey)
+			return;
+
+		key = dkey;
+	}
+
+	while (lh_urldec_path_next(key, keylen, &off, &seg, &seglen))
+		lh_urldec_invoke(p, SEGMENT, seg, seglen);
+
+	free(dkey);
+}
+
+static const char *
+lh_urldec_batch_copy(struct lh_urldec *p, const char *buf, size_t len)
+{
+	char *s;
+
+	if (!len)
+		return "";
+
+	/* spans into the caller supplied input remain valid */
+	if ((p->flags & LH_UD_F_IN_SPAN) && !p->inflate)
+		return buf;
+
+	s = p->arena + p->arena_len;
+	memcpy(s, buf, len);
+	p->arena_len += len;
+
+	return s;
+}
+
+static bool
+lh_urldec_batch_add(struct lh_urldec *p, const char *key, size_t keylen,
+                    const char *val, size_t vallen)
+{
+	struct lh_urldec_tuple *t;
+
+	if (p->batch_count == p->batch_max) {
+		p->flags |= LH_UD_F_OVERFLOW;
+
+		return false;
+	}
+
+	t = &p->batch[p->batch_count++];
+	t->name = lh_urldec_batch_copy(p, key, keylen);
+	t->namelen = keylen;
+	t->value = lh_urldec_batch_copy(p, val, vallen);
+	t->valuelen = vallen;
+
+	return true;
+}
+
+static void
+lh_urldec_emit_tuple(struct lh_urldec *p, const char *key, size_t keylen,
+                     const char *val, size_t vallen)
+{
+	if (!keylen)
+		key = NULL;
+
+	if (!vallen)
+		val = NULL;
+
+	if (p->flags & LH_UD_F_BATCH) {
+		if (!lh_urldec_batch_add(p, key, keylen, val, vallen))
+			return;
+	}
+	else {
+		lh_urldec_invoke(p, NAME, key, keylen);
+
+		if (key && (p->flags & LH_UD_F_PATHS))
+			lh_urldec_emit_path(p, key, keylen);
+
+		lh_urldec_invoke(p, VALUE, val, vallen);
+	}
+
+	if (!p->form)
+		return;
+
+	if (p->flags & LH_UD_F_DECODE)
+		lh_form_add(p->form, LH_FORM_FIELD, key ? key : "", keylen,
+		            val ? val : "", vallen, vallen);
+	else
+		lh_form_add_encoded(p->form, LH_FORM_FIELD, key, keylen,
+		                    val, vallen);
+
+	if (p->form->exhausted)
+		p->flags |= LH_UD_F_BUDGET;
+}
+
+/*
+ * Match the complete name of the current tuple against the registered
+ * field set, percent decoding it first if needed.
+ */
+static bool
+lh_urldec_wanted(struct lh_urldec *p, const char *name, size_t len)
+{
+	char buf[128], *dname;
+	ssize_t dlen;
+	bool rv;
+
+	if (!p->fields)
+		return true;
+
+	if ((p->flags & LH_UD_F_DECODE) ||
+	    (!memchr(name, '%', len) && !memchr(name, '+', len)))
+		return lh_fieldset_match(p->fields, name, len);
+
+	/* field names usually fit on the stack, allocate only for long ones */
+	dlen = lh_urldecode_into(name, len, buf, sizeof(buf), LH_URLDECODE_PLUS);
+
+	if ((size_t)dlen < sizeof(buf))
+		return lh_fieldset_match(p->fields, buf, dlen);
+
+	dname = lh_urldecode(name, len, NULL, LH_URLDECODE_PLUS);
+	rv = dname && lh_fieldset_match(p->fields, dname, dlen);
+
+	free(dname);
+
+	return rv;
+}
+
+static void
+lh_urldec_emit_chunk(struct lh_urldec *p, enum lh_urldec_token_type type,
+                     const char *buf, size_t len, bool final)
+{
+	if (p->flags & LH_UD_F_DECODE) {
+		p->token[type].len = 0;
+
+		if (!lh_urldec_decode_token(p, type, buf, len, final))
+			return;
+
+		buf = p->token[type].value;
+		len = p->token[type].len;
+	}
+
+	if (type == LH_UD_T_NAME)
+		lh_urldec_invoke(p, NAME, buf, len);
+	else
+		lh_urldec_invoke(p, VALUE, buf, len);
+}
+
 static bool
 lh_urldec_step(struct lh_urldec *p, const char *buf, size_t off, int c)
 {
-	size_t l, keylen, vallen;
+	size_t keylen, vallen;
 	char *key, *val;
 
 	switch (p->state) {
 	case LH_UD_S_NAME_START:
 		p->offset = off;
+		p->escape_len = 0;
+		p->flags &= ~LH_UD_F_SKIP;
 		p->flags &= ~LH_UD_F_GOT_NAME;
 		p->flags &= ~LH_UD_F_GOT_VALUE;
 
-		if (lh_urldec_invoke(p, TUPLE, NULL, 0))
+		if ((p->flags & LH_UD_F_BATCH) || lh_urldec_invoke(p, TUPLE, NULL, 0))
 			p->flags |= LH_UD_F_BUFFERING;
 		else
-			p->flags &= LH_UD_F_BUFFERING;
+			p->flags &= ~LH_UD_F_BUFFERING;
+
+		/* tuples starting within the current buffer are passed on as
+		 * pointers into it unless they turn out to be split */
+		if ((p->flags & (LH_UD_F_SPANS|LH_UD_F_BATCH)) &&
+		    (p->flags & (LH_UD_F_BUFFERING|LH_UD_F_DECODE)) ==
+		    LH_UD_F_BUFFERING)
+			p->flags |= LH_UD_F_IN_SPAN;
+		else
+			p->flags &= ~LH_UD_F_IN_SPAN;
 
-		lh_urldec_set_token(p, LH_UD_T_NAME, true, NULL, 0);
-		lh_urldec_set_token(p, LH_UD_T_VALUE, true, NULL, 0);
+		p->token[LH_UD_T_NAME].len = 0;
+		p->token[LH_UD_T_VALUE].len = 0;
 		lh_urldec_set_state(p, LH_UD_S_NAME);
 
 		/* fall through */
@@ -217,26 +823,36 @@ lh_urldec_step(struct lh_urldec *p, const char *buf, size_t off, int c)
 		if (c == '=' || c == '&' || c <= EOF) {
 			keylen = (off - p->offset);
 
-			if (p->flags & LH_UD_F_BUFFERING) {
-				lh_urldec_get_token(p, LH_UD_T_NAME, &l);
-
-				if (l + keylen > p->size_limit)
+			if ((p->flags & LH_UD_F_IN_SPAN) && c != EOB) {
+				if (keylen > p->size_limit)
 					return lh_urldec_error(p, off, "the key exceeds the "
 					                               "maximum allowed size");
 
-				lh_urldec_set_token(p, LH_UD_T_NAME, false,
-				                    buf + p->offset, keylen);
-
-				if ((c == '&' || c == EOF) && (p->flags & LH_UD_F_GOT_NAME)) {
-					key = lh_urldec_get_token(p, LH_UD_T_NAME, &keylen);
-					val = lh_urldec_get_token(p, LH_UD_T_VALUE, &vallen);
+				p->span_offset = p->offset;
+				p->span_len = keylen;
 
-					lh_urldec_invoke(p, NAME, key, keylen);
-					lh_urldec_invoke(p, VALUE, val, vallen);
-				}
+				if (!lh_urldec_wanted(p, buf + p->offset, keylen))
+					p->flags |= LH_UD_F_SKIP;
+				else if ((c == '&' || c == EOF) &&
+				         (p->flags & LH_UD_F_GOT_NAME))
+					lh_urldec_emit_tuple(p, buf + p->offset, keylen, NULL, 0);
+			}
+			else if (p->flags & LH_UD_F_BUFFERING) {
+				if (!lh_urldec_append_token(p, LH_UD_T_NAME, off,
+				                            buf + p->offset, keylen, c != EOB))
+					return false;
+
+				key = lh_urldec_get_token(p, LH_UD_T_NAME, &keylen);
+
+				if (c != EOB && !lh_urldec_wanted(p, key ? key : "", keylen))
+					p->flags |= LH_UD_F_SKIP;
+				else if ((c == '&' || c == EOF) &&
+				         (p->flags & LH_UD_F_GOT_NAME))
+					lh_urldec_emit_tuple(p, key, keylen, NULL, 0);
 			}
 			else {
-				lh_urldec_invoke(p, NAME, buf + p->offset, keylen);
+				lh_urldec_emit_chunk(p, LH_UD_T_NAME, buf + p->offset,
+				                     keylen, c != EOB);
 			}
 
 			if (c == '=')
@@ -263,26 +879,42 @@ lh_urldec_step(struct lh_urldec *p, const char *buf, size_t off, int c)
 		if (c == '&' || c <= EOF) {
 			vallen = (off - p->offset);
 
-			if (p->flags & LH_UD_F_BUFFERING) {
-				lh_urldec_get_token(p, LH_UD_T_VALUE, &l);
-
-				if (l + vallen > p->size_limit)
+			/* the value of an unwanted tuple is not retained at all */
+			if (p->flags & LH_UD_F_SKIP) {
+				if (p->trace)
+					fprintf(p->trace, "Skipping %lu bytes of value\n",
+					        (unsigned long)vallen);
+			}
+			else if ((p->flags & LH_UD_F_IN_SPAN) && c != EOB) {
+				if (vallen > p->size_limit)
 					return lh_urldec_error(p, off, "the value exceeds the "
 					                               "maximum allowed size");
 
-				lh_urldec_set_token(p, LH_UD_T_VALUE, false,
-				                    buf + p->offset, vallen);
+				if (p->flags & LH_UD_F_GOT_NAME)
+					lh_urldec_emit_tuple(p, buf + p->span_offset, p->span_len,
+					                     buf + p->offset, vallen);
+			}
+			else if (p->flags & LH_UD_F_BUFFERING) {
+				/* the tuple is split, move the name span into the token */
+				if ((p->flags & LH_UD_F_IN_SPAN) &&
+				    !lh_urldec_set_token(p, LH_UD_T_NAME, true,
+				                         buf + p->span_offset, p->span_len))
+					return lh_urldec_nomem(p, off);
+
+				if (!lh_urldec_append_token(p, LH_UD_T_VALUE, off,
+				                            buf + p->offset, vallen, c != EOB))
+					return false;
 
 				if ((c != EOB) && (p->flags & LH_UD_F_GOT_NAME)) {
 					key = lh_urldec_get_token(p, LH_UD_T_NAME, &keylen);
 					val = lh_urldec_get_token(p, LH_UD_T_VALUE, &vallen);
 
-					lh_urldec_invoke(p, NAME, key, keylen);
-					lh_urldec_invoke(p, VALUE, val, vallen);
+					lh_urldec_emit_tuple(p, key, keylen, val, vallen);
 				}
 			}
 			else {
-				lh_urldec_invoke(p, VALUE, buf + p->offset, vallen);
+				lh_urldec_emit_chunk(p, LH_UD_T_VALUE, buf + p->offset,
+				                     vallen, c != EOB);
 			}
 
 			if (c > EOF)
@@ -306,31 +938,310 @@ lh_urldec_step(struct lh_urldec *p, const char *buf, size_t off, int c)
 		                               "error state");
 	}
 
+	if (c == EOB)
+		p->flags &= ~LH_UD_F_IN_SPAN;
+
 	return true;
 }
 
-bool
-lh_urldec_parse(struct lh_urldec *p, const char *buf, size_t len)
+/* Delimiter classes, bit 0 terminates a name and bit 1 a value. */
+static const unsigned char lh_urldec_delimiters[256] = {
+	['&'] = 3,
+	['='] = 1
+};
+
+#define SWAR_ONES  0x0101010101010101ULL
+#define SWAR_HIGHS 0x8080808080808080ULL
+#define SWAR_MATCH(w, c) \
+	((((w) ^ ((c) * SWAR_ONES)) - SWAR_ONES) & ~((w) ^ ((c) * SWAR_ONES)))
+
+/*
+ * Find the offset of the next byte terminating a name ('&' or '=') or a
+ * value ('&') within buf[off..len), returns len if there is none.
+ */
+static size_t
+lh_urldec_scan(const char *buf, size_t off, size_t len, bool name)
 {
-	size_t i;
+	unsigned char mask = name ? 1 : 2, d = name ? '=' : '&';
+
+#if defined(__SSE2__)
+	const __m128i amp = _mm_set1_epi8('&'), alt = _mm_set1_epi8(d);
+	__m128i v;
+	int m;
+
+	for (; off + 16 <= len; off += 16) {
+		v = _mm_loadu_si128((const __m128i *)(buf + off));
+		m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, amp),
+		                                   _mm_cmpeq_epi8(v, alt)));
+
+		if (m)
+			return off + __builtin_ctz(m);
+	}
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	const uint8x16_t amp = vdupq_n_u8('&'), alt = vdupq_n_u8(d);
+	uint8x16_t v;
+	uint64_t m;
+
+	for (; off + 16 <= len; off += 16) {
+		v = vld1q_u8((const uint8_t *)(buf + off));
+		v = vorrq_u8(vceqq_u8(v, amp), vceqq_u8(v, alt));
+		m = vget_lane_u64(vreinterpret_u64_u8(
+			vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0);
+
+		if (m)
+			return off + (__builtin_ctzll(m) >> 2);
+	}
+#else
+	uint64_t w, m;
+
+	for (; off + 8 <= len; off += 8) {
+		memcpy(&w, buf + off, sizeof(w));
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		w = __builtin_bswap64(w);
+#endif
+
+		m = (SWAR_MATCH(w, '&') | SWAR_MATCH(w, d)) & SWAR_HIGHS;
+
+		if (m)
+			return off + (__builtin_ctzll(m) >> 3);
+	}
+#endif
+
+	for (; off < len; off++)
+		if (lh_urldec_delimiters[(unsigned char)buf[off]] & mask)
+			return off;
+
+	return len;
+}
+
+static bool
+lh_urldec_exhausted(struct lh_urldec *p, size_t off)
+{
+	if (p->flags & LH_UD_F_OVERFLOW)
+		return lh_urldec_error(p, off, "the tuple array is exhausted");
+
+	return lh_urldec_error(p, off, "the memory budget is exhausted");
+}
+
+static bool
+lh_urldec_parse_data(struct lh_urldec *p, const char *buf, size_t len,
+                     bool last)
+{
+	size_t i, n;
 
 	p->offset = 0;
 
-	if (p->trace)
-		lh_urldec_dump(p->trace, "Parsing buffer", buf, len);
+	for (i = 0; i < len; i++) {
+		/* skip over the remainder of a name or value in bulk */
+		if (p->state == LH_UD_S_NAME || p->state == LH_UD_S_VALUE) {
+			n = lh_urldec_scan(buf, i, len, p->state == LH_UD_S_NAME);
+
+			if (n > i && p->state == LH_UD_S_NAME)
+				p->flags |= LH_UD_F_GOT_NAME;
+
+			i = n;
+
+			if (i == len)
+				break;
+		}
 
-	for (i = 0; i < len; i++)
 		if (!lh_urldec_step(p, buf, i, (unsigned char)buf[i]))
 			return false;
 
-	if (!lh_urldec_step(p, buf, len, buf ? EOB : EOF))
+		if (p->flags & (LH_UD_F_BUDGET|LH_UD_F_OVERFLOW))
+			return lh_urldec_exhausted(p, i);
+	}
+
+	if (!lh_urldec_step(p, buf, len, last ? EOF : EOB))
 		return false;
 
+	if (p->flags & (LH_UD_F_BUDGET|LH_UD_F_OVERFLOW))
+		return lh_urldec_exhausted(p, len);
+
 	p->total += i;
 
 	return true;
 }
 
+static bool
+lh_urldec_inflate_cb(const char *buf, size_t len, void *priv)
+{
+	return lh_urldec_parse_data(priv, buf, len, false);
+}
+
+static bool
+lh_urldec_parse_inflate(struct lh_urldec *p, const char *buf, size_t len,
+                        bool last)
+{
+	lh_inflate_set_limit(p->inflate, p->inflate_limit);
+
+	if ((buf && !lh_inflate_parse(p->inflate, buf, len,
+	                              lh_urldec_inflate_cb, p)) ||
+	    (last && !lh_inflate_parse(p->inflate, NULL, 0,
+	                               lh_urldec_inflate_cb, p))) {
+		if (p->inflate->error)
+			return lh_urldec_error(p, 0, "%s", p->inflate->error);
+
+		return false;
+	}
+
+	return last ? lh_urldec_parse_data(p, NULL, 0, true) : true;
+}
+
+bool
+lh_urldec_parse(struct lh_urldec *p, const char *buf, size_t len)
+{
+	bool last = !buf, excess = false, ok;
+
+	if (p->trace)
+		lh_urldec_dump(p->trace, "Parsing buffer", buf, len);
+
+	if (p->tee && !(buf ? lh_tee_write(p->tee, buf, len)
+	                    : lh_tee_flush(p->tee)))
+		return lh_urldec_error(p, 0, "unable to write the body copy: %s",
+		                       strerror(errno));
+
+	if ((p->flags & LH_UD_F_LENGTH) && p->state != LH_UD_S_ERROR) {
+		/* parse up to the declared length before failing, so that the
+		 * error does not depend on how the body is split into buffers */
+		if (len > p->content_length - p->received) {
+			len = p->content_length - p->received;
+			excess = true;
+		}
+
+		if (!buf && p->received < p->content_length)
+			return lh_urldec_error(p, 0, "the body is truncated, got %lu of "
+			                             "%lu declared bytes",
+			                       (unsigned long)p->received,
+			                       (unsigned long)p->content_length);
+
+		/* treat the final declared byte as end of input */
+		if (buf && len && p->received + len == p->content_length)
+			last = true;
+	}
+
+	p->received += len;
+
+	if (p->inflate)
+		ok = lh_urldec_parse_inflate(p, buf, len, last);
+	else
+		ok = lh_urldec_parse_data(p, buf, len, last);
+
+	if (ok && excess)
+		return lh_urldec_error(p, 0, "the body exceeds the declared length "
+		                             "of %lu bytes",
+		                       (unsigned long)p->content_length);
+
+	return ok;
+}
+
+/*
+ * Parse the given buffer like lh_urldec_parse() but store the complete
+ * buffered tuples in the given array instead of invoking the TUPLE, NAME and
+ * VALUE callbacks. The stored names and values remain valid until the next
+ * call and are percent decoded if decoding is enabled. An array with one
+ * entry more than the number of '&' characters in the buffer is always
+ * sufficient, the parser fails if it is exhausted. Not supported together
+ * with a content encoding.
+ *
+ * Returns the number of stored tuples, on failure the error member is set.
+ */
+
+size_t
+lh_urldec_parse_tuples(struct lh_urldec *p, const char *buf, size_t len,
+                       struct lh_urldec_tuple *tuples, size_t max)
+{
+	size_t need;
+	char *tmp;
+
+	if (p->inflate) {
+		lh_urldec_error(p, 0, "batched parsing does not support a content "
+		                      "encoding");
+
+		return 0;
+	}
+
+	/* decoding never grows data, except for a pending invalid escape */
+	need = p->token[LH_UD_T_NAME].len + p->token[LH_UD_T_VALUE].len +
+	       sizeof(p->escape) + len;
+
+	if (need > p->arena_size) {
+		if (!lh_urldec_charge(p, need - p->arena_size)) {
+			lh_urldec_error(p, 0, "the memory budget is exhausted");
+
+			return 0;
+		}
+
+		tmp = realloc(p->arena, need);
+
+		if (!tmp) {
+			lh_urldec_uncharge(p, need - p->arena_size);
+			lh_urldec_error(p, 0, "out of memory");
+
+			return 0;
+		}
+
+		p->arena = tmp;
+		p->arena_size = need;
+	}
+
+	p->batch = tuples;
+	p->batch_count = 0;
+	p->batch_max = max;
+	p->arena_len = 0;
+	p->flags |= LH_UD_F_BATCH;
+
+	lh_urldec_parse(p, buf, len);
+
+	p->flags &= ~LH_UD_F_BATCH;
+	p->batch = NULL;
+
+	return p->batch_count;
+}
+
+/*
+ * Iterate the segments of a bracket path such as "a[b][]". The offset must
+ * be zero before the first invocation and is advanced past the returned
+ * segment. The root segment is followed by one segment per bracket pair,
+ * empty brackets yield a NULL segment denoting an append. Names which are
+ * not well formed paths, like "a[b" or "[a]", form a single segment.
+ *
+ * Returns false if there are no more segments.
+ */
+
+bool
+lh_urldec_path_next(const char *name, size_t len, size_t *off,
+                    const char **seg, size_t *seglen)
+{
+	const char *s = name + *off, *e;
+
+	if (*off >= len)
+		return false;
+
+	if (*off == 0) {
+		if (!lh_urldec_is_path(name, len)) {
+			*seg = name;
+			*seglen = len;
+			*off = len;
+
+			return true;
+		}
+
+		e = memchr(name, '[', len);
+	}
+	else {
+		s++;
+		e = memchr(s, ']', name + len - s);
+	}
+
+	*seg = (e > s) ? s : NULL;
+	*seglen = e - s;
+	*off = (e - name) + (*off > 0);
+
+	return true;
+}
+
 void
 lh_urldec_free(struct lh_urldec *p)
 {
@@ -339,9 +1250,17 @@ lh_urldec_free(struct lh_urldec *p)
 	if (p->error)
 		free(p->error);
 
+	if (p->inflate)
+		lh_inflate_free(p->inflate);
+
 	for (i = 0; i < __LH_UD_T_COUNT; i++)
 		if (p->token[i].value)
 			free(p->token[i].value);
 
+	free(p->arena);
+
+	if (p->budget)
+		lh_budget_release(p->budget, p->reserved);
+
 	free(p);
 }
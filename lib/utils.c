@@ -18,10 +18,29 @@
 
 #include <lucihttp/utils.h>
 
+#include "hex.h"
+
 #include <stdbool.h>
 #include <stdlib.h>
-#include <ctype.h>
 #include <string.h>
+#include <stdint.h>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#endif
+
+/* SSE2 is the x86 baseline, AVX2 kernels are built through a function target
+ * attribute and only called if the CPU supports them */
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ >= 5)
+#include <immintrin.h>
+#define LH_AVX2_DISPATCH
+#define have_avx2() __builtin_cpu_supports("avx2")
+#endif
 
 #ifndef EOF
 # define EOF (-1)
@@ -29,28 +48,465 @@
 
 static const char *hexdigits = "0123456789ABCDEF";
 
+/*
+ * The classification tables below are expanded at compile time from the
+ * character class macros, one 256 entry table per combination of the
+ * LH_URLENCODE_FULL and LH_URLENCODE_SPACE_PLUS flags, so that neither
+ * encoding nor decoding depends on ctype functions or the process locale.
+ */
+
+#define LH_TABLE4(f, n)   f(n), f((n) + 1), f((n) + 2), f((n) + 3)
+#define LH_TABLE16(f, n)  LH_TABLE4(f, n), LH_TABLE4(f, (n) + 4), \
+                          LH_TABLE4(f, (n) + 8), LH_TABLE4(f, (n) + 12)
+#define LH_TABLE64(f, n)  LH_TABLE16(f, n), LH_TABLE16(f, (n) + 16), \
+                          LH_TABLE16(f, (n) + 32), LH_TABLE16(f, (n) + 48)
+#define LH_TABLE256(f)    LH_TABLE64(f, 0), LH_TABLE64(f, 64), \
+                          LH_TABLE64(f, 128), LH_TABLE64(f, 192)
+
+#define LH_IS_UNRESERVED(c) \
+	(((c) >= '0' && (c) <= '9') || ((c) >= 'A' && (c) <= 'Z') || \
+	 ((c) >= 'a' && (c) <= 'z') || (c) == '!' || (c) == '\'' || \
+	 (c) == '(' || (c) == ')' || (c) == '*' || (c) == '-' || (c) == '.' || \
+	 (c) == '_' || (c) == '~')
+
+#define LH_IS_RESERVED(c) \
+	((c) == '#' || (c) == '$' || (c) == '&' || (c) == '+' || (c) == ',' || \
+	 (c) == '/' || (c) == ':' || (c) == ';' || (c) == '=' || (c) == '?' || \
+	 (c) == '@')
+
+/* 0 keeps the byte, 1 replaces it with a plus and 3 percent encodes it, so
+ * that the encoded length of a byte is 1 + (class & 2) */
+#define LH_ENCODE_CLASS(c, full, plus) \
+	(((plus) && (c) == ' ') ? 1 : LH_IS_UNRESERVED(c) ? 0 : \
+	 LH_IS_RESERVED(c) ? ((full) ? 3 : 0) : 3)
+
+#define LH_ENCODE_DEFAULT(c)    LH_ENCODE_CLASS(c, 0, 0)
+#define LH_ENCODE_FULL(c)       LH_ENCODE_CLASS(c, 1, 0)
+#define LH_ENCODE_PLUS(c)       LH_ENCODE_CLASS(c, 0, 1)
+#define LH_ENCODE_FULL_PLUS(c)  LH_ENCODE_CLASS(c, 1, 1)
+
+static const unsigned char urlencode_class[4][256] = {
+	{ LH_TABLE256(LH_ENCODE_DEFAULT) },
+	{ LH_TABLE256(LH_ENCODE_FULL) },
+	{ LH_TABLE256(LH_ENCODE_PLUS) },
+	{ LH_TABLE256(LH_ENCODE_FULL_PLUS) }
+};
+
+/* the value of a hex digit or -1 */
+#define LH_HEX_VALUE(c) \
+	(((c) >= '0' && (c) <= '9') ? (c) - '0' : \
+	 ((c) >= 'A' && (c) <= 'F') ? (c) - 'A' + 10 : \
+	 ((c) >= 'a' && (c) <= 'f') ? (c) - 'a' + 10 : -1)
+
+const signed char lh_hexvalues[256] = {
+	LH_TABLE256(LH_HEX_VALUE)
+};
+
+/* RFC 2045 token characters, printable ASCII except space and tspecials */
+#define LH_IS_TSPECIAL(c) \
+	((c) == '(' || (c) == ')' || (c) == '<' || (c) == '>' || (c) == '@' || \
+	 (c) == ',' || (c) == ';' || (c) == ':' || (c) == '\\' || (c) == '"' || \
+	 (c) == '/' || (c) == '[' || (c) == ']' || (c) == '?' || (c) == '=')
+
+#define LH_IS_HEADER_TOKEN(c) \
+	((c) > ' ' && (c) <= '~' && !LH_IS_TSPECIAL(c))
+
+static const bool header_token[256] = {
+	LH_TABLE256(LH_IS_HEADER_TOKEN)
+};
+
+#define is_header_token(c) ((c) != EOF && header_token[(unsigned char)(c)])
+
+static inline unsigned int
+urlencode_table(unsigned int flags)
+{
+	return ((flags & LH_URLENCODE_FULL) ? 1 : 0) |
+	       ((flags & LH_URLENCODE_SPACE_PLUS) ? 2 : 0);
+}
+
+/* escapes truncated by the end of the input are literal */
 static inline bool
-is_urlencode_char(char c, bool full)
+is_urldecode_escape(const char *s, size_t i, size_t len)
 {
-	if (c == '!' || c == '\'' || c == '(' || c == ')' || c == '*' ||
-	    c == '-' || c == '.'  || c == '_' || c == '~' ||
-		(c >= '0' && c <= '9') ||
-		(c >= 'A' && c <= 'Z') ||
-		(c >= 'a' && c <= 'z'))
-		return false;
+	return (i + 2 < len && (hex_to_dec(s[i+1]) | hex_to_dec(s[i+2])) >= 0);
+}
+
+#if defined(__SSE2__) || \
+      (defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define URLENCODE_BLOCK 16
+#else
+#define URLENCODE_BLOCK 8
+#endif
 
-	if (c == '#' || c == '$' || c == '&' || c == '+' || c == ',' ||
-	    c == '/' || c == ':' || c == ';' || c == '=' || c == '?' ||
-	    c == '@')
-	    return full;
+#define SWAR_ONES  0x0101010101010101ULL
+#define SWAR_LOWS  0x7f7f7f7f7f7f7f7fULL
+#define SWAR_HIGHS 0x8080808080808080ULL
 
-	return true;
+/* high bit of each ASCII byte of w which is >= n, exact per byte */
+#define SWAR_GE(w, n) \
+	(((w) & SWAR_LOWS) + (0x80 - (n)) * SWAR_ONES)
+
+/* high bit of each byte of w equal to c, exact per byte */
+#define SWAR_EQ(w, c) \
+	(~(((((w) ^ ((c) * SWAR_ONES)) & SWAR_LOWS) + SWAR_LOWS) | \
+	   ((w) ^ ((c) * SWAR_ONES)) | SWAR_LOWS))
+
+#if defined(LH_AVX2_DISPATCH)
+__attribute__((target("avx2")))
+static inline uint32_t
+plain_mask_avx2(__m256i v)
+{
+	const __m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+	const __m256i a = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)),
+	                                  _mm256_set1_epi8('a'));
+	const __m256i p = _mm256_sub_epi8(v, _mm256_set1_epi8('-'));
+	__m256i m;
+
+	m = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+	m = _mm256_or_si256(m,
+		_mm256_cmpeq_epi8(_mm256_min_epu8(a, _mm256_set1_epi8(25)), a));
+	m = _mm256_or_si256(m,
+		_mm256_cmpeq_epi8(_mm256_min_epu8(p, _mm256_set1_epi8(1)), p));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('~')));
+
+	return (uint32_t)_mm256_movemask_epi8(m);
+}
+
+/* skip 32 byte blocks of plain bytes, returns the offset of the first other */
+__attribute__((target("avx2")))
+static size_t
+urlencode_plain_run_avx2(const char *s, size_t len)
+{
+	size_t off;
+
+	for (off = 0; off + 32 <= len; off += 32)
+		if (plain_mask_avx2(_mm256_loadu_si256((const __m256i *)(s + off))) !=
+		    0xffffffff)
+			break;
+
+	/* the callers continue with SSE code, avoid transition penalties */
+	_mm256_zeroupper();
+
+	return off;
+}
+
+/* find '%' or alt within 32 byte blocks, returns the offset of the match or of
+ * the trailing partial block */
+__attribute__((target("avx2")))
+static size_t
+urldecode_span_avx2(const char *s, size_t off, size_t len, char alt)
+{
+	const __m256i pct = _mm256_set1_epi8('%'), pls = _mm256_set1_epi8(alt);
+	__m256i v;
+	uint32_t m;
+
+	for (; off + 32 <= len; off += 32) {
+		v = _mm256_loadu_si256((const __m256i *)(s + off));
+		m = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, pct),
+		                                         _mm256_cmpeq_epi8(v, pls)));
+
+		if (m) {
+			off += __builtin_ctz(m);
+			break;
+		}
+	}
+
+	_mm256_zeroupper();
+
+	return off;
+}
+#endif
+
+#if defined(__SSE2__)
+static inline uint32_t
+plain_mask(__m128i v)
+{
+	const __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+	const __m128i a = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)),
+	                               _mm_set1_epi8('a'));
+	const __m128i p = _mm_sub_epi8(v, _mm_set1_epi8('-'));
+	__m128i m;
+
+	m = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(a, _mm_set1_epi8(25)), a));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(p, _mm_set1_epi8(1)), p));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('~')));
+
+	return (uint32_t)_mm_movemask_epi8(m);
+}
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/* one nibble per byte, set for bytes not in the plain set */
+static inline uint64_t
+plain_mask(uint8x16_t v)
+{
+	uint8x16_t m;
+
+	m = vcleq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(9));
+	m = vorrq_u8(m, vcleq_u8(vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)),
+	                                  vdupq_n_u8('a')), vdupq_n_u8(25)));
+	m = vorrq_u8(m, vcleq_u8(vsubq_u8(v, vdupq_n_u8('-')), vdupq_n_u8(1)));
+	m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('_')));
+	m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('~')));
+
+	return ~vget_lane_u64(vreinterpret_u64_u8(
+		vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+}
+#endif
+
+/*
+ * Test whether the next URLENCODE_BLOCK bytes at s consist only of the always
+ * unreserved characters [0-9A-Za-z._~-], which never need to be encoded.
+ */
+static inline bool
+urlencode_plain(const char *s)
+{
+#if defined(__SSE2__)
+	return (plain_mask(_mm_loadu_si128((const __m128i *)s)) == 0xffff);
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	return (plain_mask(vld1q_u8((const uint8_t *)s)) == 0);
+#else
+	uint64_t w;
+
+	memcpy(&w, s, sizeof(w));
+
+	return (((SWAR_GE(w, '0') & ~SWAR_GE(w, '9' + 1)) |
+	         (SWAR_GE(w, 'A') & ~SWAR_GE(w, 'Z' + 1)) |
+	         (SWAR_GE(w, 'a') & ~SWAR_GE(w, 'z' + 1)) |
+	         (SWAR_GE(w, '-') & ~SWAR_GE(w, '.' + 1)) |
+	         SWAR_EQ(w, '_') | SWAR_EQ(w, '~')) & ~w & SWAR_HIGHS) == SWAR_HIGHS;
+#endif
+}
+
+/*
+ * Return the length of the leading blocks of s[0..len) which consist only of
+ * plain bytes. Once a run has started, it is continued in 32 byte blocks if
+ * the CPU supports AVX2.
+ */
+static size_t
+urlencode_plain_run(const char *s, size_t len)
+{
+	size_t off = 0;
+
+	while (len - off >= URLENCODE_BLOCK && urlencode_plain(s + off)) {
+		off += URLENCODE_BLOCK;
+
+#if defined(LH_AVX2_DISPATCH)
+		if (have_avx2())
+			off += urlencode_plain_run_avx2(s + off, len - off);
+#endif
+	}
+
+	return off;
+}
+
+/*
+ * Find the offset of the next '%' or, if plus decoding is requested, '+'
+ * within s[off..len), returns len if there is none.
+ */
+static size_t
+urldecode_span(const char *s, size_t off, size_t len, bool plus)
+{
+	char alt = plus ? '+' : '%';
+
+#if defined(LH_AVX2_DISPATCH)
+	if (have_avx2() && len - off >= 32) {
+		off = urldecode_span_avx2(s, off, len, alt);
+
+		if (len - off >= 32)
+			return off;
+	}
+#endif
+
+#if defined(__SSE2__)
+	const __m128i pct = _mm_set1_epi8('%'), pls = _mm_set1_epi8(alt);
+	__m128i v;
+	uint32_t m;
+
+	for (; off + 16 <= len; off += 16) {
+		v = _mm_loadu_si128((const __m128i *)(s + off));
+		m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, pct),
+		                                   _mm_cmpeq_epi8(v, pls)));
+
+		if (m)
+			return off + __builtin_ctz(m);
+	}
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	const uint8x16_t pct = vdupq_n_u8('%'), pls = vdupq_n_u8(alt);
+	uint8x16_t v;
+	uint64_t m;
+
+	for (; off + 16 <= len; off += 16) {
+		v = vld1q_u8((const uint8_t *)(s + off));
+		v = vorrq_u8(vceqq_u8(v, pct), vceqq_u8(v, pls));
+		m = vget_lane_u64(vreinterpret_u64_u8(
+			vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0);
+
+		if (m)
+			return off + (__builtin_ctzll(m) >> 2);
+	}
+#else
+	uint64_t w, m;
+
+	for (; off + 8 <= len; off += 8) {
+		memcpy(&w, s + off, sizeof(w));
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		w = __builtin_bswap64(w);
+#endif
+
+		m = (SWAR_EQ(w, '%') | SWAR_EQ(w, alt)) & SWAR_HIGHS;
+
+		if (m)
+			return off + (__builtin_ctzll(m) >> 3);
+	}
+#endif
+
+	for (; off < len; off++)
+		if (s[off] == '%' || s[off] == alt)
+			return off;
+
+	return len;
+}
+
+/*
+ * Determine the encoded length of s[0..len) and whether any byte needs to be
+ * encoded at all. Blocks of plain bytes are skipped in bulk, others are
+ * classified byte by byte.
+ */
+static size_t
+urlencode_size(const char *s, size_t len, const unsigned char *class,
+               bool *changed)
+{
+	unsigned char mask = 0, c;
+	size_t i, n, enc_len;
+
+	for (i = 0, enc_len = len; i < len; ) {
+		i += urlencode_plain_run(s + i, len - i);
+
+		for (n = (len - i > URLENCODE_BLOCK) ? i + URLENCODE_BLOCK : len;
+		     i < n; i++) {
+			c = class[(unsigned char)s[i]];
+			mask |= c;
+			enc_len += (c & 2);
+		}
+	}
+
+	*changed = (mask != 0);
+
+	return enc_len;
+}
+
+/*
+ * Write the encoded form of s[0..len) to out, which must have room for the
+ * length computed by urlencode_size(). No terminating null byte is written.
+ */
+static void
+urlencode_write(const char *s, size_t len, const unsigned char *class,
+                char *ptr)
+{
+	size_t i, n;
+
+	for (i = 0; i < len; ) {
+		n = urlencode_plain_run(s + i, len - i);
+
+		memcpy(ptr, s + i, n);
+		ptr += n;
+		i += n;
+
+		for (n = (len - i > URLENCODE_BLOCK) ? i + URLENCODE_BLOCK : len;
+		     i < n; i++) {
+			switch (class[(unsigned char)s[i]]) {
+			case 0:
+				*ptr++ = s[i];
+				break;
+
+			case 1:
+				*ptr++ = '+';
+				break;
+
+			default:
+				*ptr++ = '%';
+				*ptr++ = hexdigits[(unsigned char)s[i] / 16];
+				*ptr++ = hexdigits[(unsigned char)s[i] % 16];
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * Determine the decoded length of s[0..len) and whether any byte gets
+ * decoded at all. Returns -1 if strict decoding is requested and the
+ * input contains an invalid escape sequence.
+ */
+static ssize_t
+urldecode_size(const char *s, size_t len, unsigned int flags, bool *changed)
+{
+	bool plus = (flags & LH_URLDECODE_PLUS);
+	size_t i, dec_len;
+
+	*changed = false;
+
+	for (i = 0, dec_len = len; ; i++) {
+		i = urldecode_span(s, i, len, plus);
+
+		if (i == len)
+			break;
+
+		if (s[i] == '%') {
+			if (is_urldecode_escape(s, i, len)) {
+				*changed = true;
+				dec_len -= 2;
+				i += 2;
+			}
+			else if (flags & LH_URLDECODE_STRICT) {
+				return -1;
+			}
+		}
+		else {
+			*changed = true;
+		}
+	}
+
+	return dec_len;
 }
 
-#define hex_to_dec(x) \
-	(((x) <= '9') ? ((x) - '0') : \
-		(((x) <= 'F') ? ((x) - 'A' + 10) : \
-			((x) - 'a' + 10)))
+/*
+ * Write the decoded form of s[0..len) to out and return its length. The
+ * output never runs ahead of the input, so out may be equal to s to decode
+ * in place. No terminating null byte is written.
+ */
+static size_t
+urldecode_write(const char *s, size_t len, bool plus, char *out)
+{
+	size_t i, n;
+	char *ptr;
+
+	for (i = 0, ptr = out; ; i++) {
+		n = urldecode_span(s, i, len, plus);
+		memmove(ptr, s + i, n - i);
+		ptr += n - i;
+		i = n;
+
+		if (i == len)
+			break;
+
+		if (s[i] == '%' && is_urldecode_escape(s, i, len)) {
+			*ptr++ = (char)(16 * hex_to_dec(s[i+1]) + hex_to_dec(s[i+2]));
+			i += 2;
+		}
+		else if (s[i] == '+' && plus) {
+			*ptr++ = ' ';
+		}
+		else {
+			*ptr++ = s[i];
+		}
+	}
+
+	return ptr - out;
+}
 
 /*
  * URL-encode given string and return encoded copy.
@@ -84,55 +540,71 @@ char *
 lh_urlencode(const char *s, size_t len, size_t *encoded_len,
              unsigned int flags)
 {
-	bool changed = false;
-	size_t i, enc_len;
-	char *enc, *ptr;
+	const unsigned char *class = urlencode_class[urlencode_table(flags)];
+	size_t enc_len;
+	bool changed;
+	char *enc;
 
-	for (i = 0, enc_len = 0; len ? (i < len) : (s[i] != 0); i++)  {
-		if ((s[i] == ' ') && (flags & LH_URLENCODE_SPACE_PLUS)) {
-			changed = true;
-			enc_len++;
-		}
-		else if (is_urlencode_char(s[i], (flags & LH_URLENCODE_FULL))) {
-			changed = true;
-			enc_len += 3;
-		}
-		else {
-			enc_len++;
-		}
-	}
+	if (!len)
+		len = strlen(s);
+
+	enc_len = urlencode_size(s, len, class, &changed);
 
 	if (encoded_len)
 		*encoded_len = enc_len;
 
-	if (changed || !(flags & LH_URLENCODE_IF_NEEDED))
-	{
-		enc = calloc(1, enc_len + 1);
+	if (!changed && (flags & LH_URLENCODE_IF_NEEDED))
+		return NULL;
 
-		if (!enc) {
-			if (encoded_len)
-				*encoded_len = 0;
+	enc = malloc(enc_len + 1);
 
-			return NULL;
-		}
+	if (!enc) {
+		if (encoded_len)
+			*encoded_len = 0;
 
-		for (i = 0, ptr = enc; len ? (i < len) : (s[i] != 0); i++)
-			if ((s[i] == ' ') && (flags & LH_URLENCODE_SPACE_PLUS)) {
-				*ptr++ = '+';
-			}
-			else if (is_urlencode_char(s[i], (flags & LH_URLENCODE_FULL))) {
-				*ptr++ = '%';
-				*ptr++ = hexdigits[(unsigned char)s[i] / 16];
-				*ptr++ = hexdigits[(unsigned char)s[i] % 16];
-			}
-			else {
-				*ptr++ = s[i];
-			}
+		return NULL;
+	}
+
+	urlencode_write(s, len, class, enc);
+	enc[enc_len] = 0;
+
+	return enc;
+}
+
+/*
+ * URL-encode given string into a caller supplied buffer.
+ *
+ * If a non-zero length is specified, encodes at most length bytes, else
+ * encodes until the first null byte.
+ *
+ * Returns the length of the encoded string. If the buffer size exceeds that
+ * length, the null terminated result is written to the buffer, otherwise
+ * the buffer is left untouched and the call may be repeated with a buffer
+ * of at least the returned length plus one.
+ *
+ * Takes the same flags as lh_urlencode(), except that LH_URLENCODE_IF_NEEDED
+ * is ignored.
+ */
+
+ssize_t
+lh_urlencode_into(const char *s, size_t len, char *buf, size_t size,
+                  unsigned int flags)
+{
+	const unsigned char *class = urlencode_class[urlencode_table(flags)];
+	size_t enc_len;
+	bool changed;
+
+	if (!len)
+		len = strlen(s);
 
-		return enc;
+	enc_len = urlencode_size(s, len, class, &changed);
+
+	if (enc_len < size) {
+		urlencode_write(s, len, class, buf);
+		buf[enc_len] = 0;
 	}
 
-	return NULL;
+	return enc_len;
 }
 
 /*
@@ -171,111 +643,183 @@ char *
 lh_urldecode(const char *s, size_t len, size_t *decoded_len,
              unsigned int flags)
 {
-	bool changed = false;
-	size_t i, dec_len;
-	char *dec, *ptr;
+	ssize_t dec_len;
+	bool changed;
+	char *dec;
 
 	if (decoded_len)
 		*decoded_len = 0;
 
-	for (i = 0, dec_len = 0; len ? (i < len) : (s[i] != 0); i++, dec_len++) {
-		if (s[i] == '%') {
-			if (isxdigit(s[i+1]) && isxdigit(s[i+2])) {
-				changed = true;
-				i += 2;
-			}
-			else if (flags & LH_URLDECODE_STRICT) {
-				return NULL;
-			}
-		}
-		else if ((s[i] == '+') && (flags & LH_URLDECODE_PLUS)) {
-			changed = true;
-		}
-	}
+	if (!len)
+		len = strlen(s);
+
+	dec_len = urldecode_size(s, len, flags, &changed);
+
+	if (dec_len < 0)
+		return NULL;
 
 	if (decoded_len)
 		*decoded_len = dec_len;
 
-	if (changed || !(flags & LH_URLDECODE_IF_NEEDED)) {
-		dec = calloc(1, dec_len + 1);
-
-		if (!dec) {
-			if (decoded_len)
-				*decoded_len = 0;
+	if (!changed && (flags & LH_URLDECODE_IF_NEEDED))
+		return NULL;
 
-			return NULL;
-		}
+	dec = malloc(dec_len + 1);
 
-		for (i = 0, ptr = dec; len ? (i < len) : (s[i] != 0); i++) {
-			if (s[i] == '%' && isxdigit(s[i+1]) && isxdigit(s[i+2])) {
-				*ptr++ = (char)(16 * hex_to_dec(s[i+1]) + hex_to_dec(s[i+2]));
-				i += 2;
-			}
-			else if ((s[i] == '+') && (flags & LH_URLDECODE_PLUS)) {
-				*ptr++ = ' ';
-			}
-			else {
-				*ptr++ = s[i];
-			}
-		}
+	if (!dec) {
+		if (decoded_len)
+			*decoded_len = 0;
 
-		return dec;
+		return NULL;
 	}
 
-	return NULL;
+	urldecode_write(s, len, (flags & LH_URLDECODE_PLUS), dec);
+	dec[dec_len] = 0;
+
+	return dec;
 }
 
 /*
- * Extract the given named attribute from the header value and perform various
- * decoding quirks.
- *
- * Returns a newly allocated string containing the decoded value of the found
- * named attribute of the input string. If a length pointer is provided, it is
- * set to the length of the decoded string.
+ * URL-decode given string into a caller supplied buffer.
  *
-   If a non-zero length is specified, decodes at most length bytes, else
+ * If a non-zero length is specified, decodes at most length bytes, else
  * decodes until the first null byte.
  *
- * If the input string cannot be parsed, if the named attribute is not found
- * or if memory allocation fails, returns NULL and sets the length to 0.
+ * Returns the length of the decoded string. If the buffer size exceeds that
+ * length, the null terminated result is written to the buffer, otherwise
+ * the buffer is left untouched and the call may be repeated with a buffer
+ * of at least the returned length plus one. Since decoding never grows the
+ * data, a buffer one byte larger than the input always suffices.
  *
- * The found attribute value is first non-strictly URL-decoded, then any
- * literal '\"' (backslash, quote) character sequence is replaced with just
- * a quote. This is needed to accomodate for various client specific encodings
- * caused by a lack of clear specification.
+ * Returns -1 if strict decoding is requested and the input contains an
+ * invalid escape sequence.
+ *
+ * Takes the same flags as lh_urldecode(), except that LH_URLDECODE_IF_NEEDED
+ * is ignored.
  */
 
-char *
-lh_header_attribute(const char *s, size_t len, const char *attr,
-                    size_t *attr_len)
+ssize_t
+lh_urldecode_into(const char *s, size_t len, char *buf, size_t size,
+                  unsigned int flags)
 {
-	enum { TYPE, NSTART, NAME, VALUE, QUOTED, QEND } state = TYPE;
-	const char *tspecial = "()<>@,;:\\\"/[]?=";
-	const char *nameptr = NULL, *valueptr = NULL;
-	size_t i = 0, namelen = 0, valuelen = 0;
-	size_t alen = attr ? strlen(attr) : 0;
-	char *value = NULL;
-	int c = 0;
+	ssize_t dec_len;
+	bool changed;
 
-	if (attr_len)
-		*attr_len = 0;
+	if (!len)
+		len = strlen(s);
 
-	while (c != EOF) {
-		c = (len ? (i < len) : s[i]) ? (unsigned char)s[i] : EOF;
+	/* the input length is an upper bound, skip the sizing pass if it fits */
+	if (len < size && !(flags & LH_URLDECODE_STRICT)) {
+		dec_len = urldecode_write(s, len, (flags & LH_URLDECODE_PLUS), buf);
+		buf[dec_len] = 0;
 
-		switch (state) {
-		case TYPE:
+		return dec_len;
+	}
+
+	dec_len = urldecode_size(s, len, flags, &changed);
+
+	if (dec_len >= 0 && (size_t)dec_len < size) {
+		urldecode_write(s, len, (flags & LH_URLDECODE_PLUS), buf);
+		buf[dec_len] = 0;
+	}
+
+	return dec_len;
+}
+
+/*
+ * URL-decode given string in place.
+ *
+ * If a non-zero length is specified, decodes at most length bytes, else
+ * decodes until the first null byte.
+ *
+ * Returns the length of the decoded string, which is null terminated if it
+ * is shorter than the given length or if the length was determined through
+ * the null byte. With strict decoding, returns -1 and leaves the string
+ * unmodified if it contains an invalid escape sequence.
+ *
+ * Takes the same flags as lh_urldecode(), except that LH_URLDECODE_IF_NEEDED
+ * is ignored.
+ */
+
+ssize_t
+lh_urldecode_inplace(char *s, size_t len, unsigned int flags)
+{
+	bool terminated = !len, changed;
+	size_t dec_len;
+
+	if (!len)
+		len = strlen(s);
+
+	if ((flags & LH_URLDECODE_STRICT) &&
+	    urldecode_size(s, len, flags, &changed) < 0)
+		return -1;
+
+	dec_len = urldecode_write(s, len, (flags & LH_URLDECODE_PLUS), s);
+
+	if (dec_len < len || terminated)
+		s[dec_len] = 0;
+
+	return dec_len;
+}
+
+/* decode the next byte of an URL encoded string, advancing the pointer */
+static inline char
+urldecode_char(const char **p, const char *e, bool plus)
+{
+	const char *s = *p;
+
+	if (*s == '%' && e - s > 2 && (hex_to_dec(s[1]) | hex_to_dec(s[2])) >= 0) {
+		*p += 3;
+
+		return (char)(16 * hex_to_dec(s[1]) + hex_to_dec(s[2]));
+	}
+
+	*p += 1;
+
+	return (plus && *s == '+') ? ' ' : *s;
+}
+
+typedef bool (*header_param_cb)(void *, const struct lh_header_param *);
+
+/*
+ * Tokenize the header value in a single pass, passing the media type, with
+ * a NULL name, and then each parameter to the callback until it returns
+ * true. Returns false if the input ends or turns out to be malformed before
+ * the callback stopped the parsing.
+ */
+static bool
+header_parse(const char *s, size_t len, header_param_cb cb, void *ctx)
+{
+	enum { TYPE, NSTART, NAME, VALUE, QUOTED, QEND } state = TYPE;
+	const char *nameptr = NULL, *valueptr = NULL;
+	size_t i = 0, namelen = 0, valuelen = 0;
+	struct lh_header_param param;
+	int c = 0;
+
+	while (c != EOF) {
+		c = (len ? (i < len) : s[i]) ? (unsigned char)s[i] : EOF;
+
+		switch (state) {
+		case TYPE:
 			if (!valueptr && (c == ' ' || c == '\t' || c == EOF))
 				break;
 
 			if (c == ';' || c == '\r' || c == EOF) {
 				state = NSTART;
 
+				if (!valueptr)
+					break;
+
 				if (!valuelen)
 					valuelen = s + i - valueptr;
 
-				if (!attr)
-					goto found;
+				param.name = NULL;
+				param.namelen = 0;
+				param.value = valueptr;
+				param.valuelen = valuelen;
+
+				if (cb(ctx, &param))
+					return true;
 			}
 			else if (c == ' ' || c == '\t') {
 				if (!valuelen)
@@ -285,10 +829,10 @@ lh_header_attribute(const char *s, size_t len, const char *attr,
 				if (!namelen)
 					namelen = s + i - nameptr;
 				else
-					return NULL;
+					return false;
 			}
-			else if (valuelen || strchr(tspecial, c) || c <= ' ' || c > '~') {
-				return NULL;
+			else if (valuelen || !is_header_token(c)) {
+				return false;
 			}
 			else if (!valueptr) {
 				nameptr = s + i;
@@ -314,9 +858,9 @@ lh_header_attribute(const char *s, size_t len, const char *attr,
 				namelen = s + i - nameptr;
 				valueptr = s + i + 1;
 			}
-			else if (strchr(tspecial, c) || c <= ' ' || c > '~') {
+			else if (!is_header_token(c)) {
 				/* RFC 2045 section 5.1 */
-				return NULL;
+				return false;
 			}
 
 			break;
@@ -329,14 +873,11 @@ lh_header_attribute(const char *s, size_t len, const char *attr,
 			else if (c == ';' || c == '\r' || c == EOF) {
 				state = NSTART;
 				valuelen = s + i - valueptr;
-
-				if (attr && nameptr && valueptr && namelen == alen &&
-				    !strncasecmp(nameptr, attr, namelen))
-					goto found;
+				goto emit;
 			}
-			else if (strchr(tspecial, c) || c <= ' ' || c > '~') {
+			else if (!is_header_token(c)) {
 				/* RFC 2045 section 5.1 */
-				return NULL;
+				return false;
 			}
 
 			break;
@@ -352,45 +893,939 @@ lh_header_attribute(const char *s, size_t len, const char *attr,
 		case QEND:
 			if (c == ';' || c == '\r' || c == EOF) {
 				state = NSTART;
-
-				if (attr && nameptr && valueptr && namelen == alen &&
-				    !strncasecmp(nameptr, attr, namelen))
-					goto found;
+				goto emit;
 			}
 			else if (c != ' ' && c != '\t') {
-				return NULL;
+				return false;
 			}
 
 			break;
 		}
 
+		i++;
+		continue;
+
+emit:
+		param.name = nameptr;
+		param.namelen = namelen;
+		param.value = valueptr;
+		param.valuelen = valuelen;
+
+		if (cb(ctx, &param))
+			return true;
+
 		i++;
 	}
 
-	return NULL;
+	return false;
+}
 
-found:
-	value = lh_urldecode(valueptr, valuelen, &valuelen,
-	                     LH_URLDECODE_KEEP_PLUS);
+/* match a parameter by case insensitive name, or the media type if NULL */
+static bool
+header_param_is(const struct lh_header_param *param, const char *name,
+                size_t len)
+{
+	if (!name)
+		return !param->name;
 
-	if (!value) {
-		if (attr_len)
-			*attr_len = valuelen;
+	return (param->name && param->namelen == len &&
+	        !strncasecmp(param->name, name, len));
+}
 
-		return NULL;
-	}
+struct header_lookup {
+	const char *name;
+	size_t len;
+	struct lh_header_param param;
+};
+
+static bool
+header_lookup_cb(void *ctx, const struct lh_header_param *param)
+{
+	struct header_lookup *l = ctx;
+
+	if (!header_param_is(param, l->name, l->len))
+		return false;
+
+	l->param = *param;
+
+	return true;
+}
 
-	for (i = 0, namelen = 0; i < valuelen; i++, namelen++) {
-		if (i && value[i] == '"' && value[i-1] == '\\')
-			namelen--;
+/*
+ * Locate the named attribute, or the type if attr is NULL, within the
+ * header value. Returns false if the header value cannot be parsed or if
+ * the attribute is not found.
+ */
+static bool
+header_attribute_find(const char *s, size_t len, const char *attr,
+                      struct lh_header_param *param)
+{
+	struct header_lookup l = { .name = attr, .len = attr ? strlen(attr) : 0 };
+
+	if (!header_parse(s, len, header_lookup_cb, &l))
+		return false;
+
+	*param = l.param;
+
+	return true;
+}
+
+/*
+ * Write the attribute value to out, if given, replacing any '\"' sequence
+ * in the decoded data with a plain quote. Returns the resulting length,
+ * which never exceeds the input length.
+ */
+static size_t
+header_attribute_value(const char *s, size_t len, char *out)
+{
+	const char *e = s + len;
+	char c, prev = 0;
+	size_t n = 0;
 
-		value[namelen] = value[i];
+	while (s < e) {
+		c = urldecode_char(&s, e, false);
+
+		if (c == '"' && prev == '\\')
+			n--;
+
+		if (out)
+			out[n] = c;
+
+		prev = c;
+		n++;
 	}
 
-	value[namelen] = 0;
+	return n;
+}
+
+/*
+ * Extract the given named attribute from the header value and perform various
+ * decoding quirks.
+ *
+ * Returns a newly allocated string containing the decoded value of the found
+ * named attribute of the input string. If a length pointer is provided, it is
+ * set to the length of the decoded string.
+ *
+   If a non-zero length is specified, decodes at most length bytes, else
+ * decodes until the first null byte.
+ *
+ * If the input string cannot be parsed, if the named attribute is not found
+ * or if memory allocation fails, returns NULL and sets the length to 0.
+ *
+ * The found attribute value is first non-strictly URL-decoded, then any
+ * literal '\"' (backslash, quote) character sequence is replaced with just
+ * a quote. This is needed to accomodate for various client specific encodings
+ * caused by a lack of clear specification.
+ */
+
+char *
+lh_header_attribute(const char *s, size_t len, const char *attr,
+                    size_t *attr_len)
+{
+	struct lh_header_param param;
+	size_t valuelen;
+	char *value;
+
+	if (attr_len)
+		*attr_len = 0;
+
+	if (!header_attribute_find(s, len, attr, &param))
+		return NULL;
+
+	value = malloc(param.valuelen + 1);
+
+	if (!value)
+		return NULL;
+
+	valuelen = header_attribute_value(param.value, param.valuelen, value);
+	value[valuelen] = 0;
 
 	if (attr_len)
-		*attr_len = namelen;
+		*attr_len = valuelen;
 
 	return value;
 }
+
+/*
+ * Extract the given named attribute from the header value into a caller
+ * supplied buffer, decoding it like lh_header_attribute() does.
+ *
+ * Returns the length of the decoded value. If the buffer size exceeds that
+ * length, the null terminated value is written to the buffer, otherwise
+ * the buffer is left untouched and the call may be repeated with a buffer
+ * of at least the returned length plus one.
+ *
+ * Returns -1 if the input string cannot be parsed or if the named attribute
+ * is not found.
+ */
+
+ssize_t
+lh_header_attribute_into(const char *s, size_t len, const char *attr,
+                         char *buf, size_t size)
+{
+	struct lh_header_param param;
+
+	if (!header_attribute_find(s, len, attr, &param))
+		return -1;
+
+	return lh_header_param_value(&param, buf, size);
+}
+
+struct header_params {
+	struct lh_header_param *params;
+	size_t max;
+	size_t count;
+};
+
+static bool
+header_params_cb(void *ctx, const struct lh_header_param *param)
+{
+	struct header_params *hp = ctx;
+
+	if (hp->count < hp->max)
+		hp->params[hp->count] = *param;
+
+	hp->count++;
+
+	return false;
+}
+
+/*
+ * Tokenize the header value once and store the media type, if any, followed
+ * by all parameters as spans pointing into the input. The media type entry
+ * has a NULL name, quoted values span the text between the quotes and none
+ * of the values are decoded yet, use lh_header_param_value() for that.
+ *
+ * If a non-zero length is specified, parses at most length bytes, else
+ * parses until the first null byte.
+ *
+ * Returns the number of entries found, which may exceed the array size in
+ * which case only the first max entries are stored. Parsing stops at the
+ * first syntax error, keeping the entries found before it, so that lookups
+ * behave like lh_header_attribute().
+ */
+
+size_t
+lh_header_params(const char *s, size_t len, struct lh_header_param *params,
+                 size_t max)
+{
+	struct header_params hp = { .params = params, .max = max };
+
+	header_parse(s, len, header_params_cb, &hp);
+
+	return hp.count;
+}
+
+/*
+ * Find the first entry with the given case insensitive name among the
+ * entries returned by lh_header_params(), or the media type if the name
+ * is NULL. Returns NULL if there is no such entry.
+ */
+
+const struct lh_header_param *
+lh_header_param_get(const struct lh_header_param *params, size_t count,
+                    const char *name)
+{
+	size_t i, len = name ? strlen(name) : 0;
+
+	for (i = 0; i < count; i++)
+		if (header_param_is(&params[i], name, len))
+			return &params[i];
+
+	return NULL;
+}
+
+/*
+ * Decode the value of an entry returned by lh_header_params() into a caller
+ * supplied buffer, applying the same quirks as lh_header_attribute().
+ *
+ * Returns the length of the decoded value. If the buffer size exceeds that
+ * length, the null terminated value is written to the buffer, otherwise
+ * the buffer is left untouched and the call may be repeated with a buffer
+ * of at least the returned length plus one.
+ */
+
+size_t
+lh_header_param_value(const struct lh_header_param *param, char *buf,
+                      size_t size)
+{
+	size_t n;
+
+	/* the raw length is an upper bound, skip the sizing pass if it fits */
+	if (param->valuelen < size) {
+		n = header_attribute_value(param->value, param->valuelen, buf);
+		buf[n] = 0;
+
+		return n;
+	}
+
+	n = header_attribute_value(param->value, param->valuelen, NULL);
+
+	if (n < size) {
+		header_attribute_value(param->value, param->valuelen, buf);
+		buf[n] = 0;
+	}
+
+	return n;
+}
+
+static bool
+query_name_eq(const char *s, const char *e, const char *name, size_t len)
+{
+	size_t i = 0;
+
+	while (s < e)
+		if (i == len || urldecode_char(&s, e, true) != name[i++])
+			return false;
+
+	return (i == len);
+}
+
+/*
+ * Look up the parameter with the given decoded name in a query string and
+ * decode its value into the given buffer, without parsing or allocating
+ * anything for the other parameters. A leading '?' is skipped.
+ *
+ * If a non-zero length is specified, scans at most length bytes, else
+ * scans until the first null byte.
+ *
+ * Like snprintf(), at most size - 1 bytes of the value are written and the
+ * result is always null terminated if size is non-zero.
+ *
+ * Returns the length of the decoded value of the first matching parameter,
+ * which may exceed the buffer size, or -1 if the parameter is not found.
+ */
+
+ssize_t
+lh_query_get(const char *s, size_t len, const char *name, char *buf,
+             size_t size)
+{
+	const char *end, *sep, *eq, *p;
+	size_t nlen = strlen(name), i;
+	char c;
+
+	end = s + (len ? len : strlen(s));
+
+	if (s < end && *s == '?')
+		s++;
+
+	for (;; s = sep + 1) {
+		sep = memchr(s, '&', end - s);
+
+		if (!sep)
+			sep = end;
+
+		eq = memchr(s, '=', sep - s);
+
+		if (query_name_eq(s, eq ? eq : sep, name, nlen)) {
+			for (p = eq ? eq + 1 : sep, i = 0; p < sep; i++) {
+				c = urldecode_char(&p, sep, true);
+
+				if (i + 1 < size)
+					buf[i] = c;
+			}
+
+			if (size)
+				buf[(i < size) ? i : size - 1] = 0;
+
+			return i;
+		}
+
+		if (sep == end)
+			return -1;
+	}
+}
+
+static const char base64_alphabet[2][65] = {
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/",
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"
+};
+
+/* the sextet value of a character of either alphabet or a marker above 63
+ * for padding, whitespace and invalid characters */
+#define LH_B64_SPACE    0x80
+#define LH_B64_PAD      0x81
+#define LH_B64_INVALID  0xff
+
+#define LH_B64_VALUE(c) \
+	(((c) >= 'A' && (c) <= 'Z') ? (c) - 'A' : \
+	 ((c) >= 'a' && (c) <= 'z') ? (c) - 'a' + 26 : \
+	 ((c) >= '0' && (c) <= '9') ? (c) - '0' + 52 : \
+	 ((c) == '+' || (c) == '-') ? 62 : \
+	 ((c) == '/' || (c) == '_') ? 63 : \
+	 ((c) == '=') ? LH_B64_PAD : \
+	 ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n') \
+		? LH_B64_SPACE : LH_B64_INVALID)
+
+static const unsigned char base64_values[256] = {
+	LH_TABLE256(LH_B64_VALUE)
+};
+
+/*
+ * The vector kernels map sextets to characters and back arithmetically
+ * instead of through table lookups, so that the same code serves both
+ * alphabets: 'A' is added to all values, 6 more from 26 on, 75 less from
+ * 52 on and finally the distance to the characters for 62 and 63.
+ */
+#if defined(__SSSE3__)
+static inline __m128i
+base64_encode_map(__m128i v, __m128i c62, __m128i c63)
+{
+	__m128i r = _mm_add_epi8(v, _mm_set1_epi8('A'));
+
+	r = _mm_add_epi8(r, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(25)),
+	                                  _mm_set1_epi8(6)));
+	r = _mm_add_epi8(r, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(51)),
+	                                  _mm_set1_epi8(-75)));
+	r = _mm_add_epi8(r, _mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(62)),
+	                                  c62));
+	r = _mm_add_epi8(r, _mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(63)),
+	                                  c63));
+
+	return r;
+}
+
+#define base64_range(c, lo, hi) \
+	_mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8((lo) - 1)), \
+	              _mm_cmplt_epi8(c, _mm_set1_epi8((hi) + 1)))
+
+#define base64_match(c, ch) \
+	_mm_cmpeq_epi8(c, _mm_set1_epi8(ch))
+
+/* turn 16 characters into sextets, returns false if any is not plain */
+static inline bool
+base64_decode_map(__m128i *v)
+{
+	__m128i m, shift, valid;
+
+	valid = m = base64_range(*v, 'A', 'Z');
+	shift = _mm_and_si128(m, _mm_set1_epi8(-'A'));
+
+	m = base64_range(*v, 'a', 'z');
+	shift = _mm_or_si128(shift, _mm_and_si128(m, _mm_set1_epi8(26 - 'a')));
+	valid = _mm_or_si128(valid, m);
+
+	m = base64_range(*v, '0', '9');
+	shift = _mm_or_si128(shift, _mm_and_si128(m, _mm_set1_epi8(52 - '0')));
+	valid = _mm_or_si128(valid, m);
+
+	m = _mm_or_si128(base64_match(*v, '+'), base64_match(*v, '-'));
+	shift = _mm_or_si128(shift, _mm_and_si128(base64_match(*v, '+'),
+	                                          _mm_set1_epi8(62 - '+')));
+	shift = _mm_or_si128(shift, _mm_and_si128(base64_match(*v, '-'),
+	                                          _mm_set1_epi8(62 - '-')));
+	valid = _mm_or_si128(valid, m);
+
+	m = _mm_or_si128(base64_match(*v, '/'), base64_match(*v, '_'));
+	shift = _mm_or_si128(shift, _mm_and_si128(base64_match(*v, '/'),
+	                                          _mm_set1_epi8(63 - '/')));
+	shift = _mm_or_si128(shift, _mm_and_si128(base64_match(*v, '_'),
+	                                          _mm_set1_epi8(63 - '_')));
+	valid = _mm_or_si128(valid, m);
+
+	if (_mm_movemask_epi8(valid) != 0xffff)
+		return false;
+
+	*v = _mm_add_epi8(*v, shift);
+
+	return true;
+}
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+static inline uint8x16_t
+base64_encode_map(uint8x16_t v, uint8x16_t c62, uint8x16_t c63)
+{
+	uint8x16_t r = vaddq_u8(v, vdupq_n_u8('A'));
+
+	r = vaddq_u8(r, vandq_u8(vcgtq_u8(v, vdupq_n_u8(25)), vdupq_n_u8(6)));
+	r = vaddq_u8(r, vandq_u8(vcgtq_u8(v, vdupq_n_u8(51)),
+	                         vdupq_n_u8((uint8_t)-75)));
+	r = vaddq_u8(r, vandq_u8(vceqq_u8(v, vdupq_n_u8(62)), c62));
+	r = vaddq_u8(r, vandq_u8(vceqq_u8(v, vdupq_n_u8(63)), c63));
+
+	return r;
+}
+
+#define base64_range(c, lo, hi) \
+	vandq_u8(vcgeq_u8(c, vdupq_n_u8(lo)), vcleq_u8(c, vdupq_n_u8(hi)))
+
+#define base64_match(c, ch) \
+	vceqq_u8(c, vdupq_n_u8(ch))
+
+#define base64_shift(m, n) \
+	vandq_u8(m, vdupq_n_u8((uint8_t)(n)))
+
+/* turn 16 characters into sextets, returns the mask of plain characters */
+static inline uint8x16_t
+base64_decode_map(uint8x16_t *v)
+{
+	uint8x16_t m, shift, valid;
+
+	valid = m = base64_range(*v, 'A', 'Z');
+	shift = base64_shift(m, -'A');
+
+	m = base64_range(*v, 'a', 'z');
+	shift = vorrq_u8(shift, base64_shift(m, 26 - 'a'));
+	valid = vorrq_u8(valid, m);
+
+	m = base64_range(*v, '0', '9');
+	shift = vorrq_u8(shift, base64_shift(m, 52 - '0'));
+	valid = vorrq_u8(valid, m);
+
+	m = base64_match(*v, '+');
+	shift = vorrq_u8(shift, base64_shift(m, 62 - '+'));
+	valid = vorrq_u8(valid, m);
+
+	m = base64_match(*v, '-');
+	shift = vorrq_u8(shift, base64_shift(m, 62 - '-'));
+	valid = vorrq_u8(valid, m);
+
+	m = base64_match(*v, '/');
+	shift = vorrq_u8(shift, base64_shift(m, 63 - '/'));
+	valid = vorrq_u8(valid, m);
+
+	m = base64_match(*v, '_');
+	shift = vorrq_u8(shift, base64_shift(m, 63 - '_'));
+	valid = vorrq_u8(valid, m);
+
+	*v = vaddq_u8(*v, shift);
+
+	return valid;
+}
+#endif
+
+/*
+ * Encode as many complete three byte groups of the input as possible and
+ * return the number of input bytes consumed.
+ */
+static size_t
+base64_encode_blocks(const unsigned char *in, size_t len, char *out,
+                     const char *alphabet)
+{
+	size_t i = 0;
+	uint32_t v;
+
+#if defined(__SSSE3__)
+	const __m128i c62 = _mm_set1_epi8(alphabet[62] - 58);
+	const __m128i c63 = _mm_set1_epi8(alphabet[63] - 59);
+	__m128i x;
+
+	/* spread 12 input bytes to 16 sextets, loading 4 bytes ahead */
+	for (; len - i >= 16; i += 12, out += 16) {
+		x = _mm_loadu_si128((const __m128i *)(in + i));
+		x = _mm_shuffle_epi8(x, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+		                                     4, 5, 3, 4, 1, 2, 0, 1));
+		x = _mm_or_si128(
+			_mm_mulhi_epu16(_mm_and_si128(x, _mm_set1_epi32(0x0fc0fc00)),
+			                _mm_set1_epi32(0x04000040)),
+			_mm_mullo_epi16(_mm_and_si128(x, _mm_set1_epi32(0x003f03f0)),
+			                _mm_set1_epi32(0x01000010)));
+
+		_mm_storeu_si128((__m128i *)out, base64_encode_map(x, c62, c63));
+	}
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	const uint8x16_t c62 = vdupq_n_u8((uint8_t)(alphabet[62] - 58));
+	const uint8x16_t c63 = vdupq_n_u8((uint8_t)(alphabet[63] - 59));
+	const uint8x16_t m63 = vdupq_n_u8(63);
+	uint8x16x3_t src;
+	uint8x16x4_t dst;
+
+	for (; len - i >= 48; i += 48, out += 64) {
+		src = vld3q_u8(in + i);
+
+		dst.val[0] = vshrq_n_u8(src.val[0], 2);
+		dst.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(src.val[0], 4),
+		                               vshrq_n_u8(src.val[1], 4)), m63);
+		dst.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(src.val[1], 2),
+		                               vshrq_n_u8(src.val[2], 6)), m63);
+		dst.val[3] = vandq_u8(src.val[2], m63);
+
+		dst.val[0] = base64_encode_map(dst.val[0], c62, c63);
+		dst.val[1] = base64_encode_map(dst.val[1], c62, c63);
+		dst.val[2] = base64_encode_map(dst.val[2], c62, c63);
+		dst.val[3] = base64_encode_map(dst.val[3], c62, c63);
+
+		vst4q_u8((uint8_t *)out, dst);
+	}
+#endif
+
+	for (; len - i >= 3; i += 3, out += 4) {
+		v = ((uint32_t)in[i] << 16) | ((uint32_t)in[i+1] << 8) | in[i+2];
+
+		out[0] = alphabet[v >> 18];
+		out[1] = alphabet[(v >> 12) & 63];
+		out[2] = alphabet[(v >> 6) & 63];
+		out[3] = alphabet[v & 63];
+	}
+
+	return i;
+}
+
+/*
+ * Decode as many complete groups of four plain alphabet characters as
+ * possible, stopping before the first group containing padding, whitespace
+ * or invalid characters, and return the number of input bytes consumed.
+ */
+static size_t
+base64_decode_blocks(const unsigned char *in, size_t len, char *out)
+{
+	unsigned char a, b, c, d;
+	size_t i = 0;
+	uint32_t v;
+
+#if defined(__SSSE3__)
+	__m128i x;
+
+	/* pack 16 sextets into 12 bytes */
+	for (; len - i >= 16; i += 16, out += 12) {
+		x = _mm_loadu_si128((const __m128i *)(in + i));
+
+		if (!base64_decode_map(&x))
+			break;
+
+		x = _mm_maddubs_epi16(x, _mm_set1_epi32(0x01400140));
+		x = _mm_madd_epi16(x, _mm_set1_epi32(0x00011000));
+		x = _mm_shuffle_epi8(x, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+		                                      14, 13, 12, -1, -1, -1, -1));
+
+		_mm_storel_epi64((__m128i *)out, x);
+		v = _mm_cvtsi128_si32(_mm_srli_si128(x, 8));
+		memcpy(out + 8, &v, sizeof(v));
+	}
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint8x16_t valid;
+	uint8x16x4_t src;
+	uint8x16x3_t dst;
+	uint8x8_t bad;
+
+	for (; len - i >= 64; i += 64, out += 48) {
+		src = vld4q_u8(in + i);
+
+		valid = vandq_u8(vandq_u8(base64_decode_map(&src.val[0]),
+		                          base64_decode_map(&src.val[1])),
+		                 vandq_u8(base64_decode_map(&src.val[2]),
+		                          base64_decode_map(&src.val[3])));
+
+		bad = vmvn_u8(vand_u8(vget_low_u8(valid), vget_high_u8(valid)));
+
+		if (vget_lane_u64(vreinterpret_u64_u8(bad), 0))
+			break;
+
+		dst.val[0] = vorrq_u8(vshlq_n_u8(src.val[0], 2),
+		                      vshrq_n_u8(src.val[1], 4));
+		dst.val[1] = vorrq_u8(vshlq_n_u8(src.val[1], 4),
+		                      vshrq_n_u8(src.val[2], 2));
+		dst.val[2] = vorrq_u8(vshlq_n_u8(src.val[2], 6), src.val[3]);
+
+		vst3q_u8((uint8_t *)out, dst);
+	}
+#endif
+
+	for (; len - i >= 4; i += 4, out += 3) {
+		a = base64_values[in[i]];
+		b = base64_values[in[i+1]];
+		c = base64_values[in[i+2]];
+		d = base64_values[in[i+3]];
+
+		if ((a | b | c | d) & 0xc0)
+			break;
+
+		v = ((uint32_t)a << 18) | ((uint32_t)b << 12) | (c << 6) | d;
+
+		out[0] = (char)(v >> 16);
+		out[1] = (char)(v >> 8);
+		out[2] = (char)v;
+	}
+
+	return i;
+}
+
+/*
+ * Initialize the state for an incremental base64 encoding or decoding run.
+ *
+ * Takes a number of possible flags to influence encoding:
+ *
+ *  LH_BASE64_URL
+ *  Use the URL and filename safe alphabet with '-' and '_' instead of '+'
+ *  and '/'. The decoder always accepts both alphabets.
+ *
+ *  LH_BASE64_NO_PAD
+ *  Do not pad the encoded output with '=' characters.
+ */
+
+void
+lh_base64_init(struct lh_base64 *b, unsigned int flags)
+{
+	memset(b, 0, sizeof(*b));
+
+	b->flags = flags;
+}
+
+/*
+ * Base64-encode the next chunk of input and write the result to out, which
+ * must have room for LH_BASE64_ENCODED_SIZE(len) bytes. Up to two trailing
+ * bytes are kept in the state until more input or the final call arrives.
+ *
+ * Returns the number of characters written.
+ */
+
+size_t
+lh_base64_encode_update(struct lh_base64 *b, const char *s, size_t len,
+                        char *out)
+{
+	const char *alphabet = base64_alphabet[(b->flags & LH_BASE64_URL) ? 1 : 0];
+	const unsigned char *in = (const unsigned char *)s;
+	size_t i = 0, n = 0, k;
+
+	/* complete a group left over from the previous call first */
+	while (b->count && i < len) {
+		b->bits = (b->bits << 8) | in[i++];
+
+		if (++b->count == 3) {
+			out[0] = alphabet[(b->bits >> 18) & 63];
+			out[1] = alphabet[(b->bits >> 12) & 63];
+			out[2] = alphabet[(b->bits >> 6) & 63];
+			out[3] = alphabet[b->bits & 63];
+
+			b->count = 0;
+			n = 4;
+		}
+	}
+
+	k = base64_encode_blocks(in + i, len - i, out + n, alphabet);
+	i += k;
+	n += k / 3 * 4;
+
+	for (; i < len; i++, b->count++)
+		b->bits = (b->bits << 8) | in[i];
+
+	return n;
+}
+
+/*
+ * Finish an incremental encoding run by writing the characters for any
+ * remaining input bytes, including padding, to out, which must have room
+ * for 4 bytes. The state is reset for another run.
+ *
+ * Returns the number of characters written.
+ */
+
+size_t
+lh_base64_encode_final(struct lh_base64 *b, char *out)
+{
+	const char *alphabet = base64_alphabet[(b->flags & LH_BASE64_URL) ? 1 : 0];
+	uint32_t v = b->bits << (8 * (3 - b->count));
+	size_t n = 0;
+
+	if (b->count) {
+		out[n++] = alphabet[(v >> 18) & 63];
+		out[n++] = alphabet[(v >> 12) & 63];
+
+		if (b->count == 2)
+			out[n++] = alphabet[(v >> 6) & 63];
+
+		while (n < 4 && !(b->flags & LH_BASE64_NO_PAD))
+			out[n++] = '=';
+	}
+
+	lh_base64_init(b, b->flags);
+
+	return n;
+}
+
+/*
+ * Base64-decode the next chunk of input and write the result to out, which
+ * must have room for LH_BASE64_DECODED_SIZE(len) bytes. Whitespace is
+ * skipped and either alphabet is accepted. Up to three trailing characters
+ * are kept in the state until more input or the final call arrives.
+ *
+ * Returns the number of bytes written or -1 if the input contains invalid
+ * characters or data after the padding.
+ */
+
+ssize_t
+lh_base64_decode_update(struct lh_base64 *b, const char *s, size_t len,
+                        char *out)
+{
+	const unsigned char *in = (const unsigned char *)s;
+	size_t i = 0, n = 0, k;
+	unsigned char c;
+	uint32_t v;
+
+	while (i < len) {
+		/* on group boundaries, decode runs of plain groups in bulk */
+		if (!b->count && !b->pad) {
+			k = base64_decode_blocks(in + i, len - i, out + n);
+			i += k;
+			n += k / 4 * 3;
+
+			if (i == len)
+				break;
+		}
+
+		c = base64_values[in[i++]];
+
+		if (c == LH_B64_SPACE)
+			continue;
+
+		if (c == LH_B64_PAD) {
+			if (b->count < 2)
+				return -1;
+
+			if (b->count + ++b->pad == 4) {
+				v = b->bits << (6 * b->pad);
+
+				out[n++] = (char)(v >> 16);
+
+				if (b->count == 3)
+					out[n++] = (char)(v >> 8);
+
+				b->count = 0;
+			}
+
+			continue;
+		}
+
+		if (c == LH_B64_INVALID || b->pad)
+			return -1;
+
+		b->bits = (b->bits << 6) | c;
+
+		if (++b->count == 4) {
+			out[n++] = (char)(b->bits >> 16);
+			out[n++] = (char)(b->bits >> 8);
+			out[n++] = (char)b->bits;
+
+			b->count = 0;
+		}
+	}
+
+	return n;
+}
+
+/*
+ * Finish an incremental decoding run by writing the bytes of a remaining
+ * group without, or with incomplete, padding to out, which must have room
+ * for 2 bytes. The state is reset for another run.
+ *
+ * Returns the number of bytes written or -1 if the input was truncated
+ * within a byte.
+ */
+
+ssize_t
+lh_base64_decode_final(struct lh_base64 *b, char *out)
+{
+	uint32_t v = b->bits << (6 * (4 - b->count));
+	unsigned int count = b->count;
+	size_t n = 0;
+
+	lh_base64_init(b, b->flags);
+
+	if (count == 1)
+		return -1;
+
+	if (count) {
+		out[n++] = (char)(v >> 16);
+
+		if (count == 3)
+			out[n++] = (char)(v >> 8);
+	}
+
+	return n;
+}
+
+/*
+ * Base64-encode given data and return encoded copy.
+ *
+ * Returns a newly allocated string containing the encoded contents of the
+ * input. If a length pointer is provided, it is set to the length of the
+ * encoded string.
+ *
+ * If a non-zero length is specified, encodes at most length bytes, else
+ * encodes until the first null byte.
+ *
+ * In case memory allocation fails, returns NULL and sets the length pointer
+ * to zero. Takes the flags described for lh_base64_init().
+ */
+
+char *
+lh_base64_encode(const char *s, size_t len, size_t *encoded_len,
+                 unsigned int flags)
+{
+	struct lh_base64 b;
+	size_t n;
+	char *enc;
+
+	if (encoded_len)
+		*encoded_len = 0;
+
+	if (!len)
+		len = strlen(s);
+
+	enc = malloc(LH_BASE64_ENCODED_SIZE(len) + 1);
+
+	if (!enc)
+		return NULL;
+
+	lh_base64_init(&b, flags);
+
+	n = lh_base64_encode_update(&b, s, len, enc);
+	n += lh_base64_encode_final(&b, enc + n);
+	enc[n] = 0;
+
+	if (encoded_len)
+		*encoded_len = n;
+
+	return enc;
+}
+
+/*
+ * Base64-decode given string and return decoded copy.
+ *
+ * Returns a newly allocated, null terminated buffer containing the decoded
+ * data. If a length pointer is provided, it is set to the decoded length.
+ *
+ * If a non-zero length is specified, decodes at most length bytes, else
+ * decodes until the first null byte.
+ *
+ * In case memory allocation fails or if the input is not valid base64,
+ * returns NULL and sets the length pointer to zero. The flags are passed
+ * to lh_base64_init() and currently do not affect decoding.
+ */
+
+char *
+lh_base64_decode(const char *s, size_t len, size_t *decoded_len,
+                 unsigned int flags)
+{
+	struct lh_base64 b;
+	ssize_t n, m;
+	char *dec;
+
+	if (decoded_len)
+		*decoded_len = 0;
+
+	if (!len)
+		len = strlen(s);
+
+	dec = malloc(LH_BASE64_DECODED_SIZE(len) + 1);
+
+	if (!dec)
+		return NULL;
+
+	lh_base64_init(&b, flags);
+
+	n = lh_base64_decode_update(&b, s, len, dec);
+	m = (n < 0) ? -1 : lh_base64_decode_final(&b, dec + n);
+
+	if (m < 0) {
+		free(dec);
+
+		return NULL;
+	}
+
+	dec[n + m] = 0;
+
+	if (decoded_len)
+		*decoded_len = n + m;
+
+	return dec;
+}
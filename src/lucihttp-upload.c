@@ -0,0 +1,819 @@
+/*
+ * lucihttp - HTTP utility library - standalone upload ingestion tool
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Reads a multipart/form-data request body from stdin, as passed to a CGI
+ * program, stores each file part in the target directory and prints a JSON
+ * manifest describing the received fields and files:
+ *
+ *  {"fields":[{"name":"...","value":"..."}],
+ *   "files":[{"name":"...","filename":"...","path":"...","size":123}]}
+ *
+ * On failure, all stored files are removed again and {"error":"..."} is
+ * printed instead.
+ *
+ * If the kernel supports it, the request body is read into the ring buffer
+ * and file data is written out of it using io_uring with the ring registered
+ * as fixed buffer, so that the writes of one parse round are submitted along
+ * with the next read in a single system call. Otherwise, or with -n, plain
+ * read() and pwrite() calls are used.
+ */
+
+#include <lucihttp/multipart-parser.h>
+#include <lucihttp/ring-buffer.h>
+#include <lucihttp/form.h>
+#include <lucihttp/utils.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#if defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#endif
+
+/* reads from the current file position need Linux 5.6 or later */
+#if defined(IORING_FEAT_RW_CUR_POS)
+#define HAVE_IO_URING
+#endif
+
+
+#define RING_SIZE (256 * 1024)
+#define URING_ENTRIES 32
+
+#ifdef HAVE_IO_URING
+struct upload_uring {
+	int fd;
+	void *sq_map, *cq_map;
+	size_t sq_map_size, cq_map_size;
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	const char *buf;
+	size_t buflen;
+	unsigned int queued;
+	struct {
+		int opcode;
+		int fd;
+		const char *buf;
+		size_t len;
+		off_t offset;
+	} ops[URING_ENTRIES];
+};
+#endif
+
+struct upload_context {
+	const char *directory;
+	int dirfd;
+	char *header;
+	char *filename;
+	bool is_file;
+	int fd;
+	off_t offset;
+	char path[PATH_MAX];
+#ifdef HAVE_IO_URING
+	struct upload_uring *uring;
+#endif
+	const char *error;
+	int status;
+	int err;
+};
+
+static char *memdup(const char *data, size_t len)
+{
+	char *copy = calloc(1, len + 1);
+
+	if (copy && len)
+		memcpy(copy, data, len);
+
+	return copy;
+}
+
+/* the first failure determines the reported error and response status */
+static void fail(struct upload_context *ctx, int status, const char *error,
+                 int err)
+{
+	if (!ctx->error) {
+		if (status == 500 && (err == ENOSPC || err == EDQUOT))
+			status = 507;
+
+		ctx->error = error;
+		ctx->status = status;
+		ctx->err = err;
+	}
+}
+
+static const char *status_text(int status)
+{
+	switch (status) {
+	case 200: return "200 OK";
+	case 400: return "400 Bad Request";
+	case 507: return "507 Insufficient Storage";
+	default:  return "500 Internal Server Error";
+	}
+}
+
+/*
+ * Reduce a client supplied file name to a safe local name: strip any
+ * directory components, including DOS style ones sent by some browsers,
+ * and reject names which are empty, dot entries or contain control bytes.
+ */
+
+static const char *sanitize_filename(const char *name)
+{
+	const char *p, *base = name;
+
+	for (p = name; *p; p++) {
+		if (*p == '/' || *p == '\\')
+			base = p + 1;
+		else if ((unsigned char)*p < ' ' || *p == 0x7f)
+			return "upload";
+	}
+
+	if (!*base || !strcmp(base, ".") || !strcmp(base, ".."))
+		return "upload";
+
+	return base;
+}
+
+static bool open_file(struct upload_context *ctx, const char *filename)
+{
+	const char *name = sanitize_filename(filename);
+	char local[NAME_MAX + 1];
+	int i;
+
+	/* never overwrite existing files, pick the first free suffix instead */
+	for (i = 0; i < 100; i++) {
+		if (i)
+			snprintf(local, sizeof(local), "%.*s.%d", NAME_MAX - 3, name, i);
+		else
+			snprintf(local, sizeof(local), "%s", name);
+
+		ctx->fd = openat(ctx->dirfd, local,
+		                 O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW|O_CLOEXEC, 0600);
+
+		if (ctx->fd >= 0)
+			break;
+
+		if (errno != EEXIST) {
+			fail(ctx, 500, "Unable to create file", errno);
+			return false;
+		}
+	}
+
+	if (ctx->fd < 0) {
+		fail(ctx, 500, "Unable to create file", EEXIST);
+		return false;
+	}
+
+	snprintf(ctx->path, sizeof(ctx->path), "%s/%s", ctx->directory, local);
+	ctx->offset = 0;
+
+	return true;
+}
+
+static bool pwrite_all(int fd, const char *buf, size_t len, off_t offset)
+{
+	ssize_t rv;
+
+	while (len > 0) {
+		rv = pwrite(fd, buf, len, offset);
+
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		buf += rv;
+		len -= rv;
+		offset += rv;
+	}
+
+	return true;
+}
+
+#ifdef HAVE_IO_URING
+static int uring_setup(unsigned int entries, struct io_uring_params *params)
+{
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, unsigned int submit, unsigned int wait)
+{
+	return syscall(__NR_io_uring_enter, fd, submit, wait,
+	               wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned int opcode, void *arg,
+                          unsigned int nargs)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nargs);
+}
+
+static void uring_free(struct upload_uring *u)
+{
+	if (u->sq_map && u->sq_map != MAP_FAILED)
+		munmap(u->sq_map, u->sq_map_size);
+
+	if (u->cq_map && u->cq_map != MAP_FAILED)
+		munmap(u->cq_map, u->cq_map_size);
+
+	if (u->sqes && u->sqes != MAP_FAILED)
+		munmap(u->sqes, URING_ENTRIES * sizeof(*u->sqes));
+
+	if (u->fd >= 0)
+		close(u->fd);
+
+	free(u);
+}
+
+/*
+ * Set up an io_uring instance with the mirrored ring buffer registered as
+ * fixed buffer. Returns NULL if the kernel lacks io_uring, forbids it or
+ * cannot read from the current file position, the caller then falls back
+ * to plain system calls.
+ */
+
+static struct upload_uring *uring_new(struct lh_ring *ring)
+{
+	struct io_uring_params params = { 0 };
+	struct upload_uring *u;
+	struct iovec iov;
+
+	u = calloc(1, sizeof(*u));
+
+	if (!u)
+		return NULL;
+
+	u->fd = uring_setup(URING_ENTRIES, &params);
+
+	if (u->fd < 0 || !(params.features & IORING_FEAT_RW_CUR_POS))
+		goto err;
+
+	u->sq_map_size = params.sq_off.array +
+	                 params.sq_entries * sizeof(unsigned int);
+	u->cq_map_size = params.cq_off.cqes +
+	                 params.cq_entries * sizeof(struct io_uring_cqe);
+
+	u->sq_map = mmap(NULL, u->sq_map_size, PROT_READ|PROT_WRITE,
+	                 MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	u->cq_map = mmap(NULL, u->cq_map_size, PROT_READ|PROT_WRITE,
+	                 MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+	u->sqes = mmap(NULL, URING_ENTRIES * sizeof(*u->sqes),
+	               PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+	               u->fd, IORING_OFF_SQES);
+
+	if (u->sq_map == MAP_FAILED || u->cq_map == MAP_FAILED ||
+	    u->sqes == MAP_FAILED)
+		goto err;
+
+	u->sq_head = (unsigned int *)((char *)u->sq_map + params.sq_off.head);
+	u->sq_tail = (unsigned int *)((char *)u->sq_map + params.sq_off.tail);
+	u->sq_mask = (unsigned int *)((char *)u->sq_map + params.sq_off.ring_mask);
+	u->sq_array = (unsigned int *)((char *)u->sq_map + params.sq_off.array);
+	u->cq_head = (unsigned int *)((char *)u->cq_map + params.cq_off.head);
+	u->cq_tail = (unsigned int *)((char *)u->cq_map + params.cq_off.tail);
+	u->cq_mask = (unsigned int *)((char *)u->cq_map + params.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)((char *)u->cq_map + params.cq_off.cqes);
+
+	/* both halves of the mirror, so that wrapped windows are covered too */
+	u->buf = ring->base;
+	u->buflen = 2 * ring->size;
+
+	iov.iov_base = ring->base;
+	iov.iov_len = u->buflen;
+
+	if (uring_register(u->fd, IORING_REGISTER_BUFFERS, &iov, 1) == -1)
+		goto err;
+
+	return u;
+
+err:
+	uring_free(u);
+
+	return NULL;
+}
+
+static void uring_queue(struct upload_uring *u, int opcode, int fd,
+                        const char *buf, size_t len, off_t offset,
+                        unsigned int flags)
+{
+	unsigned int tail = *u->sq_tail;
+	unsigned int idx = tail & *u->sq_mask;
+	struct io_uring_sqe *sqe = &u->sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+
+	sqe->opcode = opcode;
+	sqe->flags = flags;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long)buf;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->buf_index = 0;
+	sqe->user_data = u->queued;
+
+	u->ops[u->queued].opcode = opcode;
+	u->ops[u->queued].fd = fd;
+	u->ops[u->queued].buf = buf;
+	u->ops[u->queued].len = len;
+	u->ops[u->queued].offset = offset;
+	u->queued++;
+
+	u->sq_array[idx] = idx;
+
+	__atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Submit all queued operations and wait for their completion. Short writes
+ * are completed synchronously, write errors fail the upload. Returns the
+ * result of the last operation, which is the read if one was queued.
+ */
+
+static ssize_t uring_flush(struct upload_context *ctx)
+{
+	struct upload_uring *u = ctx->uring;
+	unsigned int head, done = 0, pending = u->queued;
+	struct io_uring_cqe *cqe;
+	ssize_t last = 0;
+	int rv, res, i;
+
+	while (done < pending) {
+		rv = uring_enter(u->fd, *u->sq_tail -
+		                 __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE), 1);
+
+		if (rv == -1 && errno != EINTR) {
+			fail(ctx, 500, "Unable to submit I/O", errno);
+			break;
+		}
+
+		head = *u->cq_head;
+
+		while (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+			cqe = &u->cqes[head & *u->cq_mask];
+			res = cqe->res;
+			i = cqe->user_data;
+
+			if (i == pending - 1)
+				last = res;
+
+			if (u->ops[i].opcode == IORING_OP_WRITE_FIXED &&
+			    (res < 0 || (size_t)res != u->ops[i].len)) {
+				if (res < 0)
+					fail(ctx, 500, "Unable to write file", -res);
+				else if (!pwrite_all(u->ops[i].fd, u->ops[i].buf + res,
+				                     u->ops[i].len - res,
+				                     u->ops[i].offset + res))
+					fail(ctx, 500, "Unable to write file", errno);
+			}
+
+			head++;
+			done++;
+		}
+
+		__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	u->queued = 0;
+
+	return last;
+}
+#endif
+
+static ssize_t read_input(struct upload_context *ctx, char *buf, size_t len)
+{
+	ssize_t n;
+
+#ifdef HAVE_IO_URING
+	if (ctx->uring) {
+		/* the read lands in space just freed by the parser, so it must not
+		 * start before the writes out of that space completed */
+		do {
+			uring_queue(ctx->uring, IORING_OP_READ_FIXED, STDIN_FILENO,
+			            buf, len, -1, IOSQE_IO_DRAIN);
+
+			n = uring_flush(ctx);
+		} while (n == -EINTR);
+
+		if (n < 0) {
+			errno = -n;
+			n = -1;
+		}
+
+		return n;
+	}
+#endif
+
+	do {
+		n = read(STDIN_FILENO, buf, len);
+	} while (n == -1 && errno == EINTR);
+
+	return n;
+}
+
+static bool write_data(struct upload_context *ctx, const char *buf, size_t len)
+{
+	off_t offset = ctx->offset;
+
+	ctx->offset += len;
+
+#ifdef HAVE_IO_URING
+	/* data still in the registered ring is written from there without
+	 * copying, other buffers only live until the callback returns */
+	if (ctx->uring && buf >= ctx->uring->buf &&
+	    buf + len <= ctx->uring->buf + ctx->uring->buflen) {
+		/* keep room for the read */
+		if (ctx->uring->queued == URING_ENTRIES - 1)
+			uring_flush(ctx);
+
+		uring_queue(ctx->uring, IORING_OP_WRITE_FIXED, ctx->fd,
+		            buf, len, offset, 0);
+
+		return !ctx->error;
+	}
+#endif
+
+	if (!pwrite_all(ctx->fd, buf, len, offset)) {
+		fail(ctx, 500, "Unable to write file", errno);
+		return false;
+	}
+
+	return true;
+}
+
+static void close_file(struct upload_context *ctx, bool remove)
+{
+	if (ctx->fd < 0)
+		return;
+
+#ifdef HAVE_IO_URING
+	if (ctx->uring && ctx->uring->queued)
+		uring_flush(ctx);
+#endif
+
+	if (close(ctx->fd) == -1 && !remove)
+		fail(ctx, 500, "Unable to write file", errno);
+
+	if (remove)
+		unlink(ctx->path);
+
+	ctx->fd = -1;
+}
+
+static bool upload_callback(struct lh_mpart *p,
+                            enum lh_mpart_callback_type type,
+                            const char *buffer, size_t length, void *priv)
+{
+	struct upload_context *ctx = priv;
+
+	if (ctx->error)
+		return false;
+
+	switch (type) {
+	case LH_MP_CB_PART_INIT:
+		free(ctx->filename);
+		ctx->filename = NULL;
+		ctx->is_file = false;
+
+		/* buffer the part headers */
+		return true;
+
+	case LH_MP_CB_HEADER_NAME:
+		free(ctx->header);
+		ctx->header = memdup(buffer, length);
+		break;
+
+	case LH_MP_CB_HEADER_VALUE:
+		if (ctx->header && !strcasecmp(ctx->header, "Content-Disposition")) {
+			free(ctx->filename);
+			ctx->filename = lh_header_attribute(buffer, length,
+			                                    "filename", NULL);
+			ctx->is_file = !!ctx->filename;
+		}
+
+		break;
+
+	case LH_MP_CB_PART_BEGIN:
+		if (!ctx->is_file)
+			return true;
+
+		if (open_file(ctx, ctx->filename))
+			lh_form_set_path(p->form, ctx->path);
+
+		/* stream file data instead of buffering it */
+		return false;
+
+	case LH_MP_CB_PART_DATA:
+		if (ctx->fd >= 0)
+			write_data(ctx, buffer, length);
+
+		break;
+
+	case LH_MP_CB_PART_END:
+		close_file(ctx, false);
+		break;
+
+	default:
+		break;
+	}
+
+	return true;
+}
+
+static void print_string(const char *s, size_t len)
+{
+	size_t i;
+
+	putchar('"');
+
+	for (i = 0; i < len; i++) {
+		switch (s[i]) {
+		case '"':  fputs("\\\"", stdout); break;
+		case '\\': fputs("\\\\", stdout); break;
+		case '\b': fputs("\\b", stdout);  break;
+		case '\f': fputs("\\f", stdout);  break;
+		case '\n': fputs("\\n", stdout);  break;
+		case '\r': fputs("\\r", stdout);  break;
+		case '\t': fputs("\\t", stdout);  break;
+		default:
+			if ((unsigned char)s[i] < ' ')
+				printf("\\u%04x", (unsigned char)s[i]);
+			else
+				putchar(s[i]);
+
+			break;
+		}
+	}
+
+	putchar('"');
+}
+
+static void print_manifest(struct lh_form *form)
+{
+	struct lh_form_field field = { 0 };
+	const char *sep = "";
+
+	printf("{\"fields\":[");
+
+	while (lh_form_next(form, &field)) {
+		if (field.type != LH_FORM_FIELD)
+			continue;
+
+		printf("%s{\"name\":", sep);
+		print_string(field.name, field.namelen);
+		printf(",\"value\":");
+		print_string(field.value, field.valuelen);
+		printf("}");
+
+		sep = ",";
+	}
+
+	printf("],\"files\":[");
+
+	memset(&field, 0, sizeof(field));
+	sep = "";
+
+	while (lh_form_next(form, &field)) {
+		if (field.type != LH_FORM_FILE || !field.path)
+			continue;
+
+		printf("%s{\"name\":", sep);
+		print_string(field.name, field.namelen);
+		printf(",\"filename\":");
+		print_string(field.value, field.valuelen);
+		printf(",\"path\":");
+		print_string(field.path, field.pathlen);
+		printf(",\"size\":%llu}", (unsigned long long)field.size);
+
+		sep = ",";
+	}
+
+	printf("]}\n");
+}
+
+static void remove_files(struct lh_form *form)
+{
+	struct lh_form_field field = { 0 };
+
+	while (lh_form_next(form, &field))
+		if (field.type == LH_FORM_FILE && field.path)
+			unlink(field.path);
+}
+
+static bool parse_input(struct lh_mpart *p, struct upload_context *ctx,
+                        size_t length, bool uring)
+{
+	size_t avail, remaining = length;
+	struct lh_ring *ring;
+	bool ok = true;
+	ssize_t n;
+	char *ptr;
+
+	ring = lh_ring_new(RING_SIZE);
+
+	if (!ring) {
+		fail(ctx, 500, "Unable to allocate buffer", errno);
+		return false;
+	}
+
+#ifdef HAVE_IO_URING
+	if (uring)
+		ctx->uring = uring_new(ring);
+#endif
+
+	while (ok && !ctx->error) {
+		ptr = lh_ring_write_ptr(ring, &avail);
+
+		if (avail > remaining)
+			avail = remaining;
+
+		n = avail ? read_input(ctx, ptr, avail) : 0;
+
+		if (n == -1) {
+			fail(ctx, 400, "Unable to read request body", errno);
+			break;
+		}
+
+		lh_ring_commit(ring, n);
+		remaining -= n;
+
+		ok = lh_mpart_parse_ring(p, ring, n == 0);
+
+		if (n == 0)
+			break;
+	}
+
+	/* complete outstanding writes before the ring goes away */
+	close_file(ctx, !ok || ctx->error);
+
+#ifdef HAVE_IO_URING
+	if (ctx->uring) {
+		uring_free(ctx->uring);
+		ctx->uring = NULL;
+	}
+#endif
+
+	lh_ring_free(ring);
+
+	return ok && !ctx->error;
+}
+
+int main(int argc, char **argv)
+{
+	struct upload_context ctx = { .directory = "/tmp", .fd = -1 };
+	const char *type = getenv("CONTENT_TYPE");
+	const char *length = getenv("CONTENT_LENGTH");
+	const char *encoding = getenv("HTTP_CONTENT_ENCODING");
+	size_t body_limit = 0, size_limit = 0, len;
+	struct lh_form *form = NULL;
+	struct lh_mpart *p = NULL;
+	bool cgi = false, uring = true, ok = false;
+	char *end;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "cd:l:ns:")) != -1) {
+		switch (opt) {
+		case 'c':
+			cgi = true;
+			break;
+
+		case 'n':
+			uring = false;
+			break;
+
+		case 'd':
+			ctx.directory = optarg;
+			break;
+
+		case 'l':
+			body_limit = strtoul(optarg, NULL, 0);
+			break;
+
+		case 's':
+			size_limit = strtoul(optarg, NULL, 0);
+			break;
+
+		default:
+			fprintf(stderr,
+			        "Usage: %s [-c] [-n] [-d <dir>] [-l body-limit] "
+			        "[-s field-limit]\n", argv[0]);
+
+			return 1;
+		}
+	}
+
+	ctx.dirfd = open(ctx.directory, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	p = lh_mpart_new(NULL);
+	form = lh_form_new();
+
+	if (ctx.dirfd == -1) {
+		fail(&ctx, 500, "Unable to open target directory", errno);
+		goto out;
+	}
+
+	if (!p || !form) {
+		fail(&ctx, 500, "Out of memory", ENOMEM);
+		goto out;
+	}
+
+	if (!type || !lh_mpart_parse_boundary(p, type, NULL)) {
+		fail(&ctx, 400, "Invalid or missing multipart content type", 0);
+		goto out;
+	}
+
+	len = length ? strtoul(length, &end, 10) : 0;
+
+	if (!length || !*length || *end) {
+		fail(&ctx, 400, "Invalid or missing content length", 0);
+		goto out;
+	}
+
+	if (encoding && !lh_mpart_set_content_encoding(p, encoding)) {
+		fail(&ctx, 400, "Unsupported content encoding", 0);
+		goto out;
+	}
+
+	if (size_limit)
+		lh_mpart_set_size_limit(p, size_limit);
+
+	lh_mpart_set_body_limit(p, body_limit);
+	lh_mpart_set_callback(p, upload_callback, &ctx);
+	lh_mpart_set_form(p, form);
+
+	if (!lh_mpart_set_content_length(p, len) ||
+	    !parse_input(p, &ctx, len, uring)) {
+		fail(&ctx, 400, p->error ? p->error : "Unable to parse request body",
+		     0);
+		goto out;
+	}
+
+	if (!lh_form_finish(form, NULL)) {
+		fail(&ctx, 500, "Out of memory", ENOMEM);
+		goto out;
+	}
+
+	ok = true;
+
+out:
+	if (!ok && form)
+		remove_files(form);
+
+	if (cgi)
+		printf("Status: %s\r\nContent-Type: application/json\r\n\r\n",
+		       status_text(ok ? 200 : ctx.status));
+
+	if (ok) {
+		print_manifest(form);
+	}
+	else {
+		printf("{\"error\":");
+		print_string(ctx.error, strlen(ctx.error));
+
+		if (ctx.err) {
+			printf(",\"reason\":");
+			print_string(strerror(ctx.err), strlen(strerror(ctx.err)));
+		}
+
+		printf("}\n");
+	}
+
+	if (p)
+		lh_mpart_free(p);
+
+	if (form)
+		lh_form_free(form);
+
+	if (ctx.dirfd != -1)
+		close(ctx.dirfd);
+
+	free(ctx.header);
+	free(ctx.filename);
+
+	return !ok;
+}
@@ -17,6 +17,13 @@
  */
 
 #include <lucihttp/multipart-parser.h>
+#include <lucihttp/ring-buffer.h>
+#include <lucihttp/progress.h>
+#include <lucihttp/tee.h>
+#include <lucihttp/form.h>
+#include <lucihttp/budget.h>
+#include <lucihttp/fieldset.h>
+#include <lucihttp/ingest.h>
 #include <lucihttp/utils.h>
 
 #include <stdlib.h>
@@ -28,8 +35,18 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
 
 
+enum input_mode {
+	INPUT_READ,
+	INPUT_RING,
+	INPUT_EPOLL
+};
+
 struct test_context {
 	bool is_file;
 	char *header;
@@ -116,6 +133,9 @@ static bool test_callback(struct lh_mpart *p,
 						        path, strerror(errno));
 					else
 						ctx->dumpcount++;
+
+					if (ctx->dumpfd >= 0 && p->form)
+						lh_form_set_path(p->form, path);
 				}
 
 				xfree(name);
@@ -168,8 +188,164 @@ static bool test_callback(struct lh_mpart *p,
 	return true;
 }
 
+static bool parse_ring(struct lh_mpart *p, FILE *file, size_t bufsize)
+{
+	struct lh_ring *ring;
+	size_t avail, n;
+	bool ok = true;
+	char *ptr;
+
+	ring = lh_ring_new(0);
+
+	if (!ring) {
+		fprintf(stderr, "Unable to allocate ring: %s\n", strerror(errno));
+		return false;
+	}
+
+	while (ok) {
+		ptr = lh_ring_write_ptr(ring, &avail);
+		n = fread(ptr, 1, (avail < bufsize) ? avail : bufsize, file);
+
+		lh_ring_commit(ring, n);
+
+		ok = lh_mpart_parse_ring(p, ring, n == 0);
+
+		if (n == 0)
+			break;
+	}
+
+	lh_ring_free(ring);
+
+	return ok;
+}
+
+/*
+ * Feed the body through a pipe from a child process and parse it using the
+ * non-blocking ingest adapter driven by an epoll loop.
+ */
+
+static bool parse_epoll(struct lh_mpart *p, FILE *file, size_t bufsize)
+{
+	enum lh_ingest_status status = LH_INGEST_AGAIN;
+	struct lh_ingest *in = NULL;
+	struct epoll_event ev;
+	int pfd[2], epfd;
+	char buf[4096];
+	pid_t pid;
+	size_t n;
+
+	if (pipe(pfd) == -1) {
+		fprintf(stderr, "Unable to create pipe: %s\n", strerror(errno));
+		return false;
+	}
+
+	fflush(stdout);
+
+	pid = fork();
+
+	if (pid == 0) {
+		close(pfd[0]);
+
+		while ((n = fread(buf, 1, bufsize, file)) > 0)
+			if (write(pfd[1], buf, n) != (ssize_t)n)
+				break;
+
+		_exit(0);
+	}
+
+	close(pfd[1]);
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	in = lh_ingest_new(pfd[0], true, 0);
+
+	if (pid == -1 || epfd == -1 || !in || !lh_ingest_register(in, epfd, NULL)) {
+		fprintf(stderr, "Unable to set up ingest: %s\n", strerror(errno));
+		status = LH_INGEST_ERROR;
+	}
+	else {
+		lh_ingest_set_mpart(in, p);
+	}
+
+	while (status == LH_INGEST_AGAIN && epoll_wait(epfd, &ev, 1, -1) == 1)
+		status = lh_ingest_handle(ev.data.ptr);
+
+	if (in)
+		lh_ingest_free(in);
+	else
+		close(pfd[0]);
+
+	if (epfd != -1)
+		close(epfd);
+
+	if (pid > 0)
+		waitpid(pid, NULL, 0);
+
+	return (status == LH_INGEST_DONE);
+}
+
+static bool dump_form(struct lh_form *form)
+{
+	struct lh_form_field field = { 0 };
+	struct lh_form *copy;
+	struct stat st;
+	void *data;
+	int fd;
+
+	/* pass the snapshot through a memfd like a consumer process would */
+	fd = lh_form_memfd(form);
+
+	if (fd == -1 || fstat(fd, &st) == -1) {
+		fprintf(stderr, "Unable to serialize form: %s\n", strerror(errno));
+		return false;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "Unable to map form: %s\n", strerror(errno));
+		return false;
+	}
+
+	copy = lh_form_load(data, st.st_size);
+
+	if (!copy) {
+		fprintf(stderr, "Unable to load form: %s\n", strerror(errno));
+		munmap(data, st.st_size);
+		return false;
+	}
+
+	while (lh_form_next(copy, &field)) {
+		if (field.type == LH_FORM_FILE)
+			printf("file  %s size=%llu filename=%s path=%s\n", field.name,
+			       (unsigned long long)field.size, field.value,
+			       field.path ? field.path : "-");
+		else
+			printf("field %s size=%llu value=%s\n", field.name,
+			       (unsigned long long)field.size, field.value);
+	}
+
+	lh_form_free(copy);
+	munmap(data, st.st_size);
+
+	return true;
+}
+
+static struct lh_fieldset *parse_fields(char *list)
+{
+	char *names[16], *s;
+	size_t n = 0;
+
+	for (s = strtok(list, ", \r\n"); s && n < 16; s = strtok(NULL, ", \r\n"))
+		names[n++] = s;
+
+	return lh_fieldset_new((const char * const *)names, n);
+}
+
 static int run_test(FILE *trace, const char *path, const char *dumpprefix,
-                    size_t bufsize)
+                    size_t bufsize, size_t chunksize, enum input_mode mode,
+                    const char *progresspath, const char *teepath,
+                    bool show_form)
 {
 	struct test_context ctx = {
 		.bufsize = bufsize ? bufsize : 128,
@@ -177,7 +353,12 @@ static int run_test(FILE *trace, const char *path, const char *dumpprefix,
 		.dumpfd = -1
 	};
 
+	struct lh_progress *progress = NULL;
 	struct lh_mpart *p = NULL;
+	struct lh_tee *tee = NULL;
+	struct lh_form *form = NULL;
+	struct lh_budget *budget = NULL;
+	struct lh_fieldset *fields = NULL;
 	bool ok = true;
 	char line[4096];
 	int rv = -1;
@@ -220,6 +401,47 @@ static int run_test(FILE *trace, const char *path, const char *dumpprefix,
 
 			ctx.bufsize = n;
 		}
+		else if (!strncmp(line, "X-Content-Length: ", 18)) {
+			if (!lh_mpart_set_content_length(p, strtoul(line + 18, NULL, 0))) {
+				fprintf(stderr, "Invalid content length\n");
+				goto out;
+			}
+		}
+		else if (!strncmp(line, "Content-Encoding: ", 18)) {
+			line[strcspn(line, "\r\n")] = 0;
+
+			if (!lh_mpart_set_content_encoding(p, line + 18)) {
+				fprintf(stderr, "Unsupported content encoding\n");
+				goto out;
+			}
+		}
+		else if (!strncmp(line, "X-Body-Limit: ", 14)) {
+			lh_mpart_set_body_limit(p, strtoul(line + 14, NULL, 0));
+		}
+		else if (!strncmp(line, "X-Inflate-Limit: ", 17)) {
+			lh_mpart_set_inflate_limit(p, strtoul(line + 17, NULL, 0));
+		}
+		else if (!strncmp(line, "X-Transfer-Decoding: ", 21)) {
+			lh_mpart_set_transfer_decoding(p, !strncmp(line + 21, "on", 2));
+		}
+		else if (!fields && !strncmp(line, "X-Fields: ", 10)) {
+			fields = parse_fields(line + 10);
+
+			if (!fields) {
+				fprintf(stderr, "Out of memory\n");
+				goto out;
+			}
+
+			lh_mpart_set_fields(p, fields);
+		}
+		else if (!budget && !strncmp(line, "X-Memory-Budget: ", 17)) {
+			budget = lh_budget_new(strtoul(line + 17, NULL, 0));
+
+			if (!budget || !lh_mpart_set_budget(p, budget)) {
+				fprintf(stderr, "Unable to apply memory budget\n");
+				goto out;
+			}
+		}
 		else if (!strncmp(line, "X-Expect-", 9)) {
 			char *p = NULL, **q = NULL;
 
@@ -267,18 +489,65 @@ static int run_test(FILE *trace, const char *path, const char *dumpprefix,
 	}
 
 	lh_mpart_set_callback(p, test_callback, &ctx);
+	lh_mpart_set_chunk_size(p, chunksize);
 
-	while ((i = fread(line, 1, ctx.bufsize, file)) > 0) {
-		ok = lh_mpart_parse(p, line, i);
+	if (progresspath) {
+		progress = lh_progress_open(progresspath, 1);
 
-		if (!ok)
-			break;
+		if (!progress) {
+			fprintf(stderr, "Unable to create progress file: %s\n",
+			        strerror(errno));
+			goto out;
+		}
+
+		lh_mpart_set_progress(p, progress);
+	}
+
+	if (teepath) {
+		tee = lh_tee_open(teepath);
+
+		if (!tee) {
+			fprintf(stderr, "Unable to create tee file: %s\n",
+			        strerror(errno));
+			goto out;
+		}
+
+		lh_mpart_set_tee(p, tee);
+	}
+
+	form = lh_form_new();
+
+	if (!form) {
+		fprintf(stderr, "Out of memory\n");
+		goto out;
 	}
 
-	if (ok)
-		lh_mpart_parse(p, NULL, 0);
+	lh_mpart_set_form(p, form);
 
-	if (!ctx.expect_error && p->error) {
+	if (mode == INPUT_RING) {
+		ok = parse_ring(p, file, ctx.bufsize);
+	}
+	else if (mode == INPUT_EPOLL) {
+		ok = parse_epoll(p, file, ctx.bufsize);
+	}
+	else {
+		while ((i = fread(line, 1, ctx.bufsize, file)) > 0) {
+			ok = lh_mpart_parse(p, line, i);
+
+			if (!ok)
+				break;
+		}
+
+		if (ok)
+			lh_mpart_parse(p, NULL, 0);
+	}
+
+	if (!ok && !p->error) {
+		printf("ERROR: Unable to feed the request body to the parser\n");
+
+		goto out;
+	}
+	else if (!ctx.expect_error && p->error) {
 		printf("ERROR: Expected parser to finish but got error:\n  [%s]\n",
 		       p->error);
 
@@ -320,14 +589,40 @@ static int run_test(FILE *trace, const char *path, const char *dumpprefix,
 
 		goto out;
 	}
+	else if (budget &&
+	         lh_budget_used(budget) != p->reserved + form->reserved) {
+		printf("ERROR: Memory budget accounts %lu bytes but parser holds "
+		       "%lu bytes\n", (unsigned long)lh_budget_used(budget),
+		       (unsigned long)(p->reserved + form->reserved));
+
+		goto out;
+	}
 
 	printf("OK\n");
 	rv = 0;
 
+	if (show_form && !dump_form(form))
+		rv = -1;
+
 out:
 	if (p)
 		lh_mpart_free(p);
 
+	if (progress)
+		lh_progress_close(progress);
+
+	if (tee)
+		lh_tee_free(tee);
+
+	if (form)
+		lh_form_free(form);
+
+	if (budget)
+		lh_budget_free(budget);
+
+	if (fields)
+		lh_fieldset_free(fields);
+
 	xfree(ctx.header);
 	xfree(ctx.expect_error);
 	xfree(ctx.expect_pname);
@@ -338,7 +633,8 @@ out:
 	return rv;
 }
 
-static int run_tests(FILE *trace, const char *dir, size_t bufsize)
+static int run_tests(FILE *trace, const char *dir, size_t bufsize,
+                     size_t chunksize, enum input_mode mode)
 {
 	DIR *tests;
 	char path[128];
@@ -356,7 +652,8 @@ static int run_tests(FILE *trace, const char *dir, size_t bufsize)
 		if (entry->d_type == DT_REG) {
 			snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
 
-			if (run_test(trace, path, NULL, bufsize))
+			if (run_test(trace, path, NULL, bufsize, chunksize, mode,
+			             NULL, NULL, false))
 				fails++;
 		}
 	}
@@ -376,16 +673,32 @@ int main(int argc, char **argv)
 	const char *testfile = NULL;
 	const char *testdir = NULL;
 	const char *dumpprefix = NULL;
-	size_t bufsize = 0;
+	const char *progresspath = NULL;
+	const char *teepath = NULL;
+	size_t bufsize = 0, chunksize = 0;
+	enum input_mode mode = INPUT_READ;
+	bool show_form = false;
 	FILE *trace = NULL;
 	int opt;
 
-	while ((opt = getopt(argc, argv, "vb:d:f:x:")) != -1) {
+	while ((opt = getopt(argc, argv, "vresb:c:d:f:p:t:x:")) != -1) {
 		switch (opt) {
 		case 'v':
 			trace = stderr;
 			break;
 
+		case 'r':
+			mode = INPUT_RING;
+			break;
+
+		case 'e':
+			mode = INPUT_EPOLL;
+			break;
+
+		case 's':
+			show_form = true;
+			break;
+
 		case 'b':
 			bufsize = strtoul(optarg, NULL, 0);
 
@@ -396,6 +709,10 @@ int main(int argc, char **argv)
 
 			break;
 
+		case 'c':
+			chunksize = strtoul(optarg, NULL, 0);
+			break;
+
 		case 'd':
 			testdir = optarg;
 			break;
@@ -404,13 +721,22 @@ int main(int argc, char **argv)
 			testfile = optarg;
 			break;
 
+		case 'p':
+			progresspath = optarg;
+			break;
+
+		case 't':
+			teepath = optarg;
+			break;
+
 		case 'x':
 			dumpprefix = optarg;
 			break;
 
 		default:
 			fprintf(stderr,
-			        "Usage: %s [-v] [-b #] {-d <dir>|[-x pfx] -f <file>}\n",
+			        "Usage: %s [-v] [-r|-e] [-b #] [-c #] "
+			        "{-d <dir>|[-s] [-x pfx] [-p file] [-t file] -f <file>}\n",
 			        argv[0]);
 
 			return 1;
@@ -418,10 +744,11 @@ int main(int argc, char **argv)
 	}
 
 	if (testdir) {
-		return run_tests(trace, testdir, bufsize);
+		return run_tests(trace, testdir, bufsize, chunksize, mode);
 	}
 	else if (testfile) {
-		return run_test(trace, testfile, dumpprefix, bufsize);
+		return run_test(trace, testfile, dumpprefix, bufsize, chunksize,
+		                mode, progresspath, teepath, show_form);
 	}
 
 	fprintf(stderr, "One of -d or -f is required\n");
@@ -0,0 +1,386 @@
+/*
+ * lucihttp - HTTP utility library - tar extractor tester
+ *
+ * Copyright 2026 Jo-Philipp Wich <jo@mein.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <lucihttp/untar.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <ftw.h>
+#include <libgen.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+
+#define MAX_EXPECT 16
+
+struct member_log {
+	char *members[MAX_EXPECT];
+	size_t count;
+};
+
+/* record each member as "<type> <mode> <size> <name>[ -> <link>]" */
+static bool list_cb(struct lh_untar *u, enum lh_untar_callback_type type,
+                    const char *buf, size_t len, void *priv)
+{
+	static const char types[] = "fdlho";
+	struct member_log *log = priv;
+	char *s;
+	int rv;
+
+	if (type != LH_UT_CB_MEMBER_BEGIN || log->count >= MAX_EXPECT)
+		return true;
+
+	if (u->member.type == LH_UT_M_SYMLINK ||
+	    u->member.type == LH_UT_M_HARDLINK)
+		rv = asprintf(&s, "%c %04o %llu %s -> %s", types[u->member.type],
+		              (unsigned int)(u->member.mode & 07777),
+		              (unsigned long long)u->member.size, u->member.name,
+		              u->member.linkname);
+	else
+		rv = asprintf(&s, "%c %04o %llu %s", types[u->member.type],
+		              (unsigned int)(u->member.mode & 07777),
+		              (unsigned long long)u->member.size, u->member.name);
+
+	if (rv != -1)
+		log->members[log->count++] = s;
+
+	return true;
+}
+
+static int remove_cb(const char *path, const struct stat *st, int flag,
+                     struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static char *trim(char *s)
+{
+	s[strcspn(s, "\r\n")] = 0;
+
+	return s;
+}
+
+/* compare a "path=content" or "path -> target" expectation against disk */
+static bool check_file(const char *root, char *spec)
+{
+	char path[512], data[512], *val;
+	bool link = false;
+	ssize_t n;
+	FILE *f;
+
+	val = strstr(spec, " -> ");
+
+	if (val) {
+		*val = 0;
+		val += 4;
+		link = true;
+	}
+	else if ((val = strchr(spec, '=')) != NULL) {
+		*val++ = 0;
+	}
+	else {
+		return false;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s", root, spec);
+
+	if (link) {
+		n = readlink(path, data, sizeof(data) - 1);
+	}
+	else {
+		f = fopen(path, "r");
+
+		if (!f)
+			return false;
+
+		n = fread(data, 1, sizeof(data) - 1, f);
+		fclose(f);
+	}
+
+	if (n < 0)
+		return false;
+
+	data[n] = 0;
+
+	return !strcmp(data, val);
+}
+
+static bool check_absent(const char *root, const char *spec)
+{
+	char path[512];
+	struct stat st;
+
+	snprintf(path, sizeof(path), "%s/%s", root, spec);
+
+	return (lstat(path, &st) == -1 && errno == ENOENT);
+}
+
+static int run_test(FILE *trace, const char *path, size_t bufsize)
+{
+	char *expect_error = NULL, *expect_member[MAX_EXPECT] = { 0 };
+	char *expect_file[MAX_EXPECT] = { 0 }, *expect_absent[MAX_EXPECT] = { 0 };
+	size_t i, n, nmembers = 0, nfiles = 0, nabsent = 0;
+	char base[] = "/tmp/test-untar.XXXXXX";
+	struct member_log log = { 0 };
+	char root[sizeof(base) + 5];
+	struct lh_untar *u = NULL;
+	bool extract = false;
+	bool ok = true;
+	char line[4096];
+	int rv = -1;
+	FILE *file;
+
+	printf("Testing %-40s ... ", basename((char *)path));
+
+	file = fopen(path, "r");
+
+	if (!file) {
+		fprintf(stderr, "Unable to open file: %s\n", strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		if (!strncmp(line, "X-Expect-Error: ", 16)) {
+			expect_error = strdup(trim(line + 16));
+		}
+		else if (!strncmp(line, "X-Expect-Member: ", 17) &&
+		         nmembers < MAX_EXPECT) {
+			expect_member[nmembers++] = strdup(trim(line + 17));
+		}
+		else if (!strncmp(line, "X-Expect-File: ", 15) &&
+		         nfiles < MAX_EXPECT) {
+			expect_file[nfiles++] = strdup(trim(line + 15));
+			extract = true;
+		}
+		else if (!strncmp(line, "X-Expect-Absent: ", 17) &&
+		         nabsent < MAX_EXPECT) {
+			expect_absent[nabsent++] = strdup(trim(line + 17));
+			extract = true;
+		}
+		else if (!strncmp(line, "X-Extract: ", 11)) {
+			extract = !strncmp(line + 11, "on", 2);
+		}
+		else if (!strcmp(line, "\r\n") || !strcmp(line, "\n")) {
+			break;
+		}
+	}
+
+	/* extract into "root" next to an "outside" directory which escaping
+	 * members would be able to reach */
+	if (extract) {
+		if (!mkdtemp(base)) {
+			fprintf(stderr, "Unable to create directory: %s\n",
+			        strerror(errno));
+			goto out;
+		}
+
+		snprintf(root, sizeof(root), "%s/root", base);
+		snprintf(line, sizeof(line), "%s/outside", base);
+
+		if (mkdir(root, 0755) == -1 || mkdir(line, 0755) == -1) {
+			fprintf(stderr, "Unable to create directory: %s\n",
+			        strerror(errno));
+			goto out;
+		}
+	}
+
+	u = lh_untar_new(trace);
+
+	if (!u) {
+		fprintf(stderr, "Out of memory\n");
+		goto out;
+	}
+
+	lh_untar_set_callback(u, list_cb, &log);
+
+	if (extract && !lh_untar_set_directory(u, root)) {
+		fprintf(stderr, "Unable to open directory: %s\n", strerror(errno));
+		goto out;
+	}
+
+	while (ok && (n = fread(line, 1, bufsize, file)) > 0)
+		ok = lh_untar_parse(u, line, n);
+
+	if (ok)
+		lh_untar_parse(u, NULL, 0);
+
+	if (!expect_error && u->error) {
+		printf("ERROR: Expected extractor to finish but got error:\n"
+		       "  [%s]\n", u->error);
+
+		goto out;
+	}
+	else if (expect_error && !u->error) {
+		printf("ERROR: Expected extractor to error with\n  [%s]\n"
+		       "but it finished instead\n", expect_error);
+
+		goto out;
+	}
+	else if (expect_error && strcmp(expect_error, u->error)) {
+		printf("ERROR: Expected extractor to error with\n  [%s]\n"
+		       "but got\n  [%s]\ninstead\n", expect_error, u->error);
+
+		goto out;
+	}
+
+	for (i = 0; i < nmembers; i++) {
+		if (i >= log.count || strcmp(expect_member[i], log.members[i])) {
+			printf("ERROR: Expected member\n  [%s]\nbut got\n  [%s]\n"
+			       "instead\n", expect_member[i],
+			       (i < log.count) ? log.members[i] : "(none)");
+
+			goto out;
+		}
+	}
+
+	if (nmembers && log.count > nmembers) {
+		printf("ERROR: Unexpected member [%s]\n", log.members[nmembers]);
+
+		goto out;
+	}
+
+	for (i = 0; i < nfiles; i++) {
+		if (!check_file(root, expect_file[i])) {
+			printf("ERROR: Did not find expected file [%s]\n",
+			       expect_file[i]);
+
+			goto out;
+		}
+	}
+
+	for (i = 0; i < nabsent; i++) {
+		if (!check_absent(root, expect_absent[i])) {
+			printf("ERROR: Found unexpected file [%s]\n", expect_absent[i]);
+
+			goto out;
+		}
+	}
+
+	printf("OK\n");
+	rv = 0;
+
+out:
+	if (u)
+		lh_untar_free(u);
+
+	if (extract && strcmp(base, "/tmp/test-untar.XXXXXX"))
+		nftw(base, remove_cb, 16, FTW_DEPTH|FTW_PHYS);
+
+	for (i = 0; i < log.count; i++)
+		free(log.members[i]);
+
+	for (i = 0; i < MAX_EXPECT; i++) {
+		free(expect_member[i]);
+		free(expect_file[i]);
+		free(expect_absent[i]);
+	}
+
+	free(expect_error);
+	fclose(file);
+
+	return rv;
+}
+
+static int run_tests(FILE *trace, const char *dir, size_t bufsize)
+{
+	DIR *tests;
+	char path[128];
+	struct dirent *entry;
+	int fails = 0;
+
+	tests = opendir(dir);
+
+	if (!tests) {
+		fprintf(stderr, "Unable to open tests: %s\n", strerror(errno));
+		return -1;
+	}
+
+	while ((entry = readdir(tests)) != NULL) {
+		if (entry->d_type == DT_REG) {
+			snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+
+			if (run_test(trace, path, bufsize))
+				fails++;
+		}
+	}
+
+	closedir(tests);
+
+	if (fails)
+		printf("\n%d test cases FAILED!\n", fails);
+	else
+		printf("\nAll test cases OK!\n");
+
+	return fails;
+}
+
+int main(int argc, char **argv)
+{
+	const char *testfile = NULL;
+	const char *testdir = NULL;
+	size_t bufsize = 4096;
+	FILE *trace = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "vb:d:f:")) != -1) {
+		switch (opt) {
+		case 'v':
+			trace = stderr;
+			break;
+
+		case 'b':
+			bufsize = strtoul(optarg, NULL, 0);
+
+			if (bufsize == 0 || bufsize > 4096) {
+				fprintf(stderr, "Invalid buffer size\n");
+				return 1;
+			}
+
+			break;
+
+		case 'd':
+			testdir = optarg;
+			break;
+
+		case 'f':
+			testfile = optarg;
+			break;
+
+		default:
+			fprintf(stderr, "Usage: %s [-v] [-b #] {-d <dir>|-f <file>}\n",
+			        argv[0]);
+
+			return 1;
+		}
+	}
+
+	if (testdir) {
+		return run_tests(trace, testdir, bufsize);
+	}
+	else if (testfile) {
+		return run_test(trace, testfile, bufsize);
+	}
+
+	fprintf(stderr, "One of -d or -f is required\n");
+	return 1;
+}
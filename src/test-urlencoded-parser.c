@@ -17,7 +17,12 @@
  */
 
 #include <lucihttp/urlencoded-parser.h>
+#include <lucihttp/form.h>
+#include <lucihttp/budget.h>
+#include <lucihttp/fieldset.h>
+#include <lucihttp/utils.h>
 
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
@@ -26,14 +31,127 @@
 #include <sys/types.h>
 
 
-static int run_test(FILE *trace, const char *path)
+static struct lh_fieldset *parse_fields(char *list)
 {
-	char *expect_error = NULL;
+	char *names[16], *s;
+	size_t n = 0;
+
+	for (s = strtok(list, ", \r\n"); s && n < 16; s = strtok(NULL, ", \r\n"))
+		names[n++] = s;
+
+	return lh_fieldset_new((const char * const *)names, n);
+}
+
+struct path_log {
+	char buf[1024];
+	size_t len;
+	bool first;
+};
+
+static void path_log_add(struct path_log *log, const char *s, size_t len)
+{
+	if (log->len + len < sizeof(log->buf)) {
+		memcpy(log->buf + log->len, s, len);
+		log->len += len;
+		log->buf[log->len] = 0;
+	}
+}
+
+/* record the segments of each tuple as "a/b/[]", separated by spaces */
+static bool path_cb(struct lh_urldec *p, enum lh_urldec_callback_type type,
+                    const char *buf, size_t len, void *priv)
+{
+	struct path_log *log = priv;
+
+	if (type == LH_UD_CB_NAME) {
+		if (log->len)
+			path_log_add(log, " ", 1);
+
+		log->first = true;
+	}
+	else if (type == LH_UD_CB_SEGMENT) {
+		if (!log->first)
+			path_log_add(log, "/", 1);
+
+		if (buf)
+			path_log_add(log, buf, len);
+		else
+			path_log_add(log, "[]", 2);
+
+		log->first = false;
+	}
+
+	return true;
+}
+
+/* parse into a tuple array and check it against the form snapshot */
+static bool parse_tuples(struct lh_urldec *p, struct lh_form *form,
+                         struct lh_form_field *field, const char *buf,
+                         size_t len)
+{
+	struct lh_urldec_tuple *tuples;
+	size_t i, n = 1, dnamelen, dvaluelen;
+	char *dname, *dvalue;
+	bool ok = true;
+
+	for (i = 0; buf && i < len; i++)
+		n += (buf[i] == '&');
+
+	tuples = calloc(n, sizeof(*tuples));
+
+	if (!tuples)
+		return false;
+
+	n = lh_urldec_parse_tuples(p, buf, len, tuples, n);
+
+	for (i = 0; ok && i < n; i++) {
+		if (p->flags & LH_UD_F_DECODE) {
+			dname = strndup(tuples[i].name, tuples[i].namelen);
+			dnamelen = tuples[i].namelen;
+			dvalue = strndup(tuples[i].value, tuples[i].valuelen);
+			dvaluelen = tuples[i].valuelen;
+		}
+		else {
+			dname = lh_urldecode(tuples[i].name, tuples[i].namelen, &dnamelen,
+			                     LH_URLDECODE_PLUS);
+			dvalue = lh_urldecode(tuples[i].value, tuples[i].valuelen,
+			                      &dvaluelen, LH_URLDECODE_PLUS);
+		}
+
+		ok = dname && dvalue && lh_form_next(form, field) &&
+		     field->namelen == dnamelen && field->valuelen == dvaluelen &&
+		     !memcmp(field->name, dname, dnamelen) &&
+		     !memcmp(field->value, dvalue, dvaluelen);
+
+		if (!ok)
+			printf("ERROR: Tuple %lu [%s=%s] does not match the form\n",
+			       (unsigned long)i, dname ? dname : "", dvalue ? dvalue : "");
+
+		free(dname);
+		free(dvalue);
+	}
+
+	free(tuples);
+
+	return ok && !p->error;
+}
+
+static int run_test(FILE *trace, const char *path, size_t bufsize,
+                    bool decode, bool spans, bool batch)
+{
+	struct lh_form_field tuple_field = { 0 };
+	char *expect_error = NULL, *expect_field[8] = { 0 }, *value;
+	char *expect_paths = NULL;
+	struct path_log paths = { 0 };
+	struct lh_budget *budget = NULL;
+	struct lh_fieldset *fields = NULL;
+	struct lh_form_field field;
+	struct lh_form *form;
 	struct lh_urldec *p;
 	bool ok = true;
-	char line[128];
+	char line[4096];
 	FILE *file;
-	size_t i;
+	size_t i, j, n, nfields = 0;
 
 	printf("Testing %-40s ... ", basename((char *)path));
 
@@ -51,6 +169,17 @@ static int run_test(FILE *trace, const char *path)
 		return -1;
 	}
 
+	form = lh_form_new();
+
+	if (!form) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+
+	lh_urldec_set_form(p, form);
+	lh_urldec_set_decode(p, decode);
+	lh_urldec_set_spans(p, spans);
+
 	while (fgets(line, sizeof(line), file)) {
 		if (!strncmp(line, "X-Expect-Error: ", 16)) {
 			for (i = strlen(line) - 1; i > 0; i--)
@@ -61,26 +190,92 @@ static int run_test(FILE *trace, const char *path)
 			line[i + 1] = 0;
 			expect_error = strdup(line + 16);
 		}
+		else if (!strncmp(line, "X-Content-Length: ", 18)) {
+			lh_urldec_set_content_length(p, strtoul(line + 18, NULL, 0));
+		}
+		else if (!strncmp(line, "Content-Encoding: ", 18)) {
+			line[strcspn(line, "\r\n")] = 0;
+
+			if (!lh_urldec_set_content_encoding(p, line + 18)) {
+				fprintf(stderr, "Unsupported content encoding\n");
+				return -1;
+			}
+		}
+		else if (nfields < 8 && !strncmp(line, "X-Expect-Field: ", 16)) {
+			line[strcspn(line, "\r\n")] = 0;
+			expect_field[nfields++] = strdup(line + 16);
+		}
+		else if (!expect_paths && !strncmp(line, "X-Expect-Paths: ", 16)) {
+			line[strcspn(line, "\r\n")] = 0;
+			expect_paths = strdup(line + 16);
+
+			lh_urldec_set_paths(p, true);
+			lh_urldec_set_callback(p, path_cb, &paths);
+		}
+		else if (!strncmp(line, "X-Body-Limit: ", 14)) {
+			lh_urldec_set_body_limit(p, strtoul(line + 14, NULL, 0));
+		}
+		else if (!strncmp(line, "X-Inflate-Limit: ", 17)) {
+			lh_urldec_set_inflate_limit(p, strtoul(line + 17, NULL, 0));
+		}
+		else if (!fields && !strncmp(line, "X-Fields: ", 10)) {
+			fields = parse_fields(line + 10);
+
+			if (!fields) {
+				fprintf(stderr, "Out of memory\n");
+				return -1;
+			}
+
+			lh_urldec_set_fields(p, fields);
+		}
+		else if (!budget && !strncmp(line, "X-Memory-Budget: ", 17)) {
+			budget = lh_budget_new(strtoul(line + 17, NULL, 0));
+
+			if (!budget || !lh_urldec_set_budget(p, budget)) {
+				fprintf(stderr, "Unable to apply memory budget\n");
+				return -1;
+			}
+		}
 		else if (!strcmp(line, "\r\n")) {
 			break;
 		}
 	}
 
-	while ((i = fread(line, 1, sizeof(line), file)) > 0) {
-		ok = lh_urldec_parse(p, line, i);
+	/* callbacks and content encodings are not supported in batch mode,
+	 * its storage would shift the point at which a budget is exhausted */
+	if (expect_paths || p->inflate || budget)
+		batch = false;
+
+	while ((i = fread(line, 1, bufsize, file)) > 0) {
+		if (batch)
+			ok = parse_tuples(p, form, &tuple_field, line, i);
+		else
+			ok = lh_urldec_parse(p, line, i);
 
 		if (!ok)
 			break;
 	}
 
-	if (ok)
+	if (ok && batch)
+		ok = parse_tuples(p, form, &tuple_field, NULL, 0);
+	else if (ok)
 		lh_urldec_parse(p, NULL, 0);
 
+	if (batch && ok && lh_form_next(form, &tuple_field)) {
+		printf("ERROR: Form field [%s] not returned as tuple\n",
+		       tuple_field.name);
+
+		lh_urldec_free(p);
+		lh_form_free(form);
+		return -1;
+	}
+
 	if (!expect_error && p->error) {
 		printf("ERROR: Expected parser to finish but got error:\n  [%s]\n",
 		       p->error);
 
 		lh_urldec_free(p);
+		lh_form_free(form);
 		return -1;
 	}
 	else if (expect_error && !p->error) {
@@ -88,6 +283,7 @@ static int run_test(FILE *trace, const char *path)
 		       "but it finished instead\n", expect_error);
 
 		lh_urldec_free(p);
+		lh_form_free(form);
 		return -1;
 	}
 	else if (expect_error && p->error) {
@@ -96,16 +292,66 @@ static int run_test(FILE *trace, const char *path)
 			       "but got\n  [%s]\ninstead\n", expect_error, p->error);
 
 			lh_urldec_free(p);
+			lh_form_free(form);
 			return -1;
 		}
 	}
 
+	/* repeated names are expected to carry the given values in order */
+	for (i = 0; i < nfields; i++) {
+		value = strchr(expect_field[i], '=');
+
+		if (value)
+			*value++ = 0;
+
+		for (j = 0, n = 0; j < i; j++)
+			if (!strcmp(expect_field[j], expect_field[i]))
+				n++;
+
+		ok = value && lh_form_get(form, expect_field[i], &field);
+
+		while (ok && n-- > 0)
+			ok = lh_form_get_next(form, &field);
+
+		if (!ok || strcmp(field.value, value)) {
+			printf("ERROR: Did not find expected field [%s] with value [%s]\n",
+			       expect_field[i], value ? value : "");
+
+			lh_urldec_free(p);
+			lh_form_free(form);
+			return -1;
+		}
+	}
+
+	if (expect_paths && strcmp(expect_paths, paths.buf)) {
+		printf("ERROR: Expected paths\n  [%s]\nbut got\n  [%s]\ninstead\n",
+		       expect_paths, paths.buf);
+
+		lh_urldec_free(p);
+		lh_form_free(form);
+		return -1;
+	}
+
 	printf("OK\n");
 	lh_urldec_free(p);
+	lh_form_free(form);
+
+	if (budget)
+		lh_budget_free(budget);
+
+	if (fields)
+		lh_fieldset_free(fields);
+
+	for (i = 0; i < nfields; i++)
+		free(expect_field[i]);
+
+	free(expect_paths);
+
 	return 0;
 }
 
-static int run_tests(FILE *trace, const char *dir)
+static int run_tests(FILE *trace, const char *dir, size_t bufsize,
+                     bool decode, bool spans, bool batch)
 {
 	DIR *tests;
 	char path[128];
@@ -123,7 +369,7 @@ static int run_tests(FILE *trace, const char *dir)
 		if (entry->d_type == DT_REG) {
 			snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
 
-			if (run_test(trace, path))
+			if (run_test(trace, path, bufsize, decode, spans, batch))
 				fails++;
 		}
 	}
@@ -142,15 +388,39 @@ int main(int argc, char **argv)
 {
 	const char *testfile = NULL;
 	const char *testdir = NULL;
+	size_t bufsize = 128;
+	bool decode = false, spans = false, batch = false;
 	FILE *trace = NULL;
 	int opt;
 
-	while ((opt = getopt(argc, argv, "vd:f:")) != -1) {
+	while ((opt = getopt(argc, argv, "vpstb:d:f:")) != -1) {
 		switch (opt) {
 		case 'v':
 			trace = stderr;
 			break;
 
+		case 'p':
+			decode = true;
+			break;
+
+		case 's':
+			spans = true;
+			break;
+
+		case 't':
+			batch = true;
+			break;
+
+		case 'b':
+			bufsize = strtoul(optarg, NULL, 0);
+
+			if (bufsize == 0 || bufsize > 4096) {
+				fprintf(stderr, "Invalid buffer size\n");
+				return 1;
+			}
+
+			break;
+
 		case 'd':
 			testdir = optarg;
 			break;
@@ -160,7 +430,7 @@ int main(int argc, char **argv)
 			break;
 
 		default:
-			fprintf(stderr, "Usage: %s [-v] {-d <dir>|-f <file>}\n",
+			fprintf(stderr, "Usage: %s [-v] [-p] [-s] [-t] [-b #] {-d <dir>|-f <file>}\n",
 			        argv[0]);
 
 			return 1;
@@ -168,10 +438,10 @@ int main(int argc, char **argv)
 	}
 
 	if (testdir) {
-		return run_tests(trace, testdir);
+		return run_tests(trace, testdir, bufsize, decode, spans, batch);
 	}
 	else if (testfile) {
-		return run_test(trace, testfile);
+		return run_test(trace, testfile, bufsize, decode, spans, batch);
 	}
 
 	fprintf(stderr, "One of -d or -f is required\n");
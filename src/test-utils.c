@@ -18,10 +18,243 @@
 
 #include <lucihttp/utils.h>
 
+#include <stdbool.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define cycles() __rdtsc()
+#else
+#define cycles() 0ULL
+#endif
+
+
+typedef char *(*codec_fn)(const char *, size_t, size_t *, unsigned int);
+
+static void bench_run(const char *label, codec_fn fn, const char *s,
+                      size_t len, unsigned int flags)
+{
+	unsigned long long c0, c1, runs = 0;
+	struct timespec t0, t1;
+	double secs;
+	size_t olen;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	c0 = cycles();
+
+	do {
+		free(fn(s, len, &olen, flags));
+		runs++;
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	} while (secs < 0.25);
+
+	c1 = cycles();
+
+	printf("%-8s %8zu bytes  %8.1f MB/s  %6.2f ns/byte", label, len,
+	       (double)len * runs / secs / 1e6, secs * 1e9 / ((double)len * runs));
+
+	if (c1 > c0)
+		printf("  %6.2f cycles/byte", (double)(c1 - c0) / ((double)len * runs));
+
+	printf("\n");
+}
+
+/* time encoding and decoding of unreserved text with an escaped byte
+ * every given number of bytes */
+static int bench_data(size_t len, size_t every)
+{
+	const char *mix = "abcdefghijklmnopqrstuvwxyz0123456789-_. /&=+%\xc3\xb6";
+	char *plain, *encoded;
+	size_t i, elen;
+
+	plain = malloc(len + 1);
+
+	if (!plain || !len)
+		return 1;
+
+	for (i = 0; i < len; i++)
+		plain[i] = (i % every) ? mix[i % 38] : mix[38 + (i / every) % 9];
+
+	plain[len] = 0;
+	encoded = lh_urlencode(plain, len, &elen, LH_URLENCODE_FULL);
+
+	if (!encoded)
+		return 1;
+
+	printf("Special byte every %zu bytes:\n", every);
+	bench_run("encode", lh_urlencode, plain, len, 0);
+	bench_run("encode", lh_urlencode, plain, len, LH_URLENCODE_FULL);
+	bench_run("decode", lh_urldecode, encoded, elen, LH_URLDECODE_PLUS);
+
+	free(plain);
+	free(encoded);
+
+	return 0;
+}
+
+/* time base64 encoding and decoding of arbitrary bytes */
+static int bench_base64(size_t len)
+{
+	char *plain, *encoded;
+	size_t i, elen;
+
+	plain = malloc(len + 1);
+
+	if (!plain || !len)
+		return 1;
+
+	for (i = 0; i < len; i++)
+		plain[i] = (char)(i * 2654435761u >> 13);
+
+	plain[len] = 0;
+	encoded = lh_base64_encode(plain, len, &elen, 0);
+
+	if (!encoded)
+		return 1;
+
+	printf("Base64:\n");
+	bench_run("encode", lh_base64_encode, plain, len, 0);
+	bench_run("decode", lh_base64_decode, encoded, elen, 0);
+
+	free(plain);
+	free(encoded);
+
+	return 0;
+}
+
+static int bench(size_t len)
+{
+	return bench_data(len, 7) || bench_data(len, 64) || bench_base64(len);
+}
+
+/* base64 encode or decode, feeding the streaming functions in chunks of the
+ * given size or using the one-shot functions if the size is zero */
+static int base64(const char *encode, const char *decode, size_t chunk,
+                  unsigned int flags)
+{
+	const char *in = encode ? encode : decode;
+	size_t i, n, len = strlen(in);
+	struct lh_base64 b;
+	ssize_t rv = 0, r;
+	char *out;
+
+	if (!chunk) {
+		out = encode ? lh_base64_encode(in, len, &n, flags)
+		             : lh_base64_decode(in, len, &n, flags);
+		rv = out ? (ssize_t)n : -1;
+	}
+	else {
+		out = malloc(LH_BASE64_ENCODED_SIZE(len) + 5);
+
+		if (!out)
+			return 1;
+
+		lh_base64_init(&b, flags);
+
+		for (i = 0; i < len && rv >= 0; i += n) {
+			n = (len - i < chunk) ? len - i : chunk;
+			r = encode ? (ssize_t)lh_base64_encode_update(&b, in + i, n, out + rv)
+			           : lh_base64_decode_update(&b, in + i, n, out + rv);
+			rv = (r < 0) ? -1 : rv + r;
+		}
+
+		if (rv >= 0) {
+			r = encode ? (ssize_t)lh_base64_encode_final(&b, out + rv)
+			           : lh_base64_decode_final(&b, out + rv);
+			rv = (r < 0) ? -1 : rv + r;
+		}
+
+		if (rv >= 0)
+			out[rv] = 0;
+	}
+
+	if (rv < 0)
+		printf("failed\n");
+	else
+		printf("length=%zd %s=%s\n", rv, encode ? "encoded" : "decoded", out);
+
+	free(out);
+
+	return 0;
+}
+
+/* print the media type and all parameters of a header value */
+static int params(const char *hval)
+{
+	struct lh_header_param params[16];
+	size_t i, n;
+	char *value;
+
+	n = lh_header_params(hval, 0, params, 16);
+
+	for (i = 0; i < n && i < 16; i++) {
+		value = malloc(params[i].valuelen + 1);
+
+		if (!value)
+			return 1;
+
+		lh_header_param_value(&params[i], value, params[i].valuelen + 1);
+
+		if (params[i].name)
+			printf("%.*s=%s\n", (int)params[i].namelen, params[i].name, value);
+		else
+			printf("type=%s\n", value);
+
+		free(value);
+	}
+
+	return 0;
+}
+
+/* exercise the caller buffer and in-place variants */
+static int into(const char *encode, const char *decode, const char *hval,
+                const char *attr, size_t size, unsigned int flags)
+{
+	char *buf = NULL;
+	ssize_t len;
+
+	if (!size) {
+		if (!decode)
+			return 1;
+
+		buf = strdup(decode);
+		len = buf ? lh_urldecode_inplace(buf, 0, flags) : -1;
+		size = len + 1;
+	}
+	else {
+		buf = malloc(size);
+
+		if (!buf)
+			return 1;
+
+		buf[0] = 0;
+
+		if (encode)
+			len = lh_urlencode_into(encode, 0, buf, size, flags);
+		else if (decode)
+			len = lh_urldecode_into(decode, 0, buf, size, flags);
+		else if (hval && attr)
+			len = lh_header_attribute_into(hval, 0, attr, buf, size);
+		else
+			len = -1;
+	}
+
+	if (len < 0)
+		printf("failed\n");
+	else if ((size_t)len >= size)
+		printf("length=%zd too small\n", len);
+	else
+		printf("length=%zd value=%s\n", len, buf);
+
+	free(buf);
+
+	return 0;
+}
 
 int main(int argc, char **argv)
 {
@@ -29,12 +262,21 @@ int main(int argc, char **argv)
 	const char *decode = NULL;
 	const char *hval = NULL;
 	const char *attr = NULL;
+	const char *query = NULL;
+	const char *name = NULL;
+	char value[256];
+	ssize_t vlen;
+	size_t benchlen = 0;
+	size_t bufsize = 0;
+	bool inplace = false;
+	bool b64 = false;
+	size_t chunk = 0;
 	unsigned int flags = 0;
 	size_t len;
 	char *rv;
 	int opt;
 
-	while ((opt = getopt(argc, argv, "e:d:f:v:a:")) != -1) {
+	while ((opt = getopt(argc, argv, "e:d:f:v:a:q:n:s:ibc:B:")) != -1) {
 		switch (opt) {
 		case 'e':
 			encode = optarg;
@@ -55,6 +297,10 @@ int main(int argc, char **argv)
 				flags |= LH_URLENCODE_SPACE_PLUS;
 			else if (!strcmp(optarg, "keep-plus"))
 				flags |= LH_URLDECODE_KEEP_PLUS;
+			else if (!strcmp(optarg, "url"))
+				flags |= LH_BASE64_URL;
+			else if (!strcmp(optarg, "no-pad"))
+				flags |= LH_BASE64_NO_PAD;
 			break;
 
 		case 'v':
@@ -65,16 +311,57 @@ int main(int argc, char **argv)
 			attr = optarg;
 			break;
 
+		case 'q':
+			query = optarg;
+			break;
+
+		case 'n':
+			name = optarg;
+			break;
+
+		case 's':
+			bufsize = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'i':
+			inplace = true;
+			break;
+
+		case 'b':
+			b64 = true;
+			break;
+
+		case 'c':
+			chunk = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'B':
+			benchlen = strtoul(optarg, NULL, 0);
+			break;
+
 		default:
-			fprintf(stderr, "Usage: %s [-f flag ...] -d <string>\n", argv[0]);
-			fprintf(stderr, "       %s [-f flag ...] -e <string>\n", argv[0]);
-			fprintf(stderr, "       %s -v <string> -a <string>\n", argv[0]);
+			fprintf(stderr, "Usage: %s [-f flag ...] [-s size | -i] -d <string>\n", argv[0]);
+			fprintf(stderr, "       %s [-f flag ...] [-s size] -e <string>\n", argv[0]);
+			fprintf(stderr, "       %s [-s size] -v <string> -a <string>\n", argv[0]);
+			fprintf(stderr, "       %s -v <string>\n", argv[0]);
+			fprintf(stderr, "       %s -b [-f flag ...] [-c chunk] -e|-d <string>\n", argv[0]);
+			fprintf(stderr, "       %s -q <string> -n <string>\n", argv[0]);
+			fprintf(stderr, "       %s -B <bytes>\n", argv[0]);
 
 			return 1;
 		}
 	}
 
-	if (encode) {
+	if (benchlen) {
+		return bench(benchlen);
+	}
+	else if (b64 && (encode || decode)) {
+		return base64(encode, decode, chunk, flags);
+	}
+	else if (bufsize || inplace) {
+		return into(encode, decode, hval, attr, bufsize, flags);
+	}
+	else if (encode) {
 		rv = lh_urlencode(encode, 0, &len, flags);
 		printf("length=%zd encoded=%s\n", len, rv);
 		return 0;
@@ -89,7 +376,21 @@ int main(int argc, char **argv)
 		printf("length=%zd value=%s\n", len, rv);
 		return 0;
 	}
+	else if (hval) {
+		return params(hval);
+	}
+
+	else if (query && name) {
+		vlen = lh_query_get(query, 0, name, value, sizeof(value));
+
+		if (vlen < 0)
+			printf("not found\n");
+		else
+			printf("length=%zd value=%s\n", vlen, value);
+
+		return 0;
+	}
 
-	fprintf(stderr, "One of -d or -e or -v & -a is required\n");
+	fprintf(stderr, "One of -d or -e or -v or -q & -n or -B is required\n");
 	return 1;
 }
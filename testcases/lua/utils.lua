@@ -111,6 +111,44 @@ local header_tests = {
 		"y"
 }
 
+local base64_encode_tests = {
+	"lucihttp",
+		{ },
+		"bHVjaWh0dHA=",
+
+	"lucihttp",
+		{ "BASE64_NO_PAD" },
+		"bHVjaWh0dHA",
+
+	"\251\255",
+		{ },
+		"+/8=",
+
+	"\251\255",
+		{ "BASE64_URL" },
+		"-_8="
+}
+
+local base64_decode_tests = {
+	"bHVjaWh0dHA=",
+		"lucihttp",
+
+	"bHVjaWh0dHA",
+		"lucihttp",
+
+	"bHVj\r\naWh0\r\ndHA=",
+		"lucihttp",
+
+	"-_8=",
+		"\251\255",
+
+	"bHVj*aWh0dHA=",
+		nil,
+
+	"bHVjaWh0dHA=bHVj",
+		nil
+}
+
 io.write("Performing URL encode tests ")
 
 local i, input, arg, expected
@@ -179,4 +217,48 @@ end
 
 io.write(" OK\n")
 
+io.write("Performing base64 encode tests ")
+
+i = 1
+while base64_encode_tests[i] do
+	input, arg, expected =
+		base64_encode_tests[i+0], base64_encode_tests[i+1], base64_encode_tests[i+2]
+
+	local result = lucihttp.base64_encode(input, mkflags(arg))
+
+	if expected == result then
+		io.write(".")
+	else
+		io.write(string.format("\nERROR: Expected\n [%s]\nbut got\n [%s]\n instead.\n",
+			expected or "(nil)", result or "(nil)"))
+		os.exit(1)
+	end
+
+	i = i + 3
+end
+
+io.write(" OK\n")
+
+io.write("Performing base64 decode tests ")
+
+i = 1
+while base64_decode_tests[i] do
+	input, expected =
+		base64_decode_tests[i+0], base64_decode_tests[i+1]
+
+	local result = lucihttp.base64_decode(input)
+
+	if expected == result then
+		io.write(".")
+	else
+		io.write(string.format("\nERROR: Expected\n [%s]\nbut got\n [%s]\n instead.\n",
+			expected or "(nil)", result or "(nil)"))
+		os.exit(1)
+	end
+
+	i = i + 2
+end
+
+io.write(" OK\n")
+
 os.exit(0)
@@ -100,6 +100,44 @@ let header_tests = [
 		"y"
 ];
 
+let base64_encode_tests = [
+	"lucihttp",
+		0,
+		"bHVjaWh0dHA=",
+
+	"lucihttp",
+		lh.BASE64_NO_PAD,
+		"bHVjaWh0dHA",
+
+	"\xfb\xff",
+		0,
+		"+/8=",
+
+	"\xfb\xff",
+		lh.BASE64_URL,
+		"-_8="
+];
+
+let base64_decode_tests = [
+	"bHVjaWh0dHA=",
+		"lucihttp",
+
+	"bHVjaWh0dHA",
+		"lucihttp",
+
+	"bHVj\r\naWh0\r\ndHA=",
+		"lucihttp",
+
+	"-_8=",
+		"\xfb\xff",
+
+	"bHVj*aWh0dHA=",
+		null,
+
+	"bHVjaWh0dHA=bHVj",
+		null
+];
+
 print("Performing URL encode tests ");
 
 let input, arg, expected;
@@ -162,4 +200,43 @@ for (let i = 0; i < length(header_tests); i += 3) {
 
 print(" OK\n");
 
+print("Performing base64 encode tests ");
+
+for (let i = 0; i < length(base64_encode_tests); i += 3) {
+	let input = base64_encode_tests[i+0],
+	    arg = base64_encode_tests[i+1],
+	    expected = base64_encode_tests[i+2];
+
+	let result = lh.base64_encode(input, arg);
+
+	if (expected == result) {
+		print(".");
+	}
+	else {
+		printf("\nERROR: Expected\n [%s]\nbut got\n [%s]\n instead.\n", expected, result);
+		exit(1);
+	}
+}
+
+print(" OK\n");
+
+print("Performing base64 decode tests ");
+
+for (let i = 0; i < length(base64_decode_tests); i += 2) {
+	let input = base64_decode_tests[i+0],
+	    expected = base64_decode_tests[i+1];
+
+	let result = lh.base64_decode(input);
+
+	if (expected == result) {
+		print(".");
+	}
+	else {
+		printf("\nERROR: Expected\n [%s]\nbut got\n [%s]\n instead.\n", expected, result);
+		exit(1);
+	}
+}
+
+print(" OK\n");
+
 exit(0);
@@ -0,0 +1,196 @@
+#!/bin/sh
+#
+# Runs lucihttp-upload on a number of request bodies and checks the printed
+# manifest, the stored files and the cleanup after failures. Every case is
+# run once using io_uring, where available, and once using plain system
+# calls (-n).
+#
+# Usage: run.sh <path to lucihttp-upload>
+
+UPLOAD="${1:-./lucihttp-upload}"
+BOUNDARY="----lucihttp-test"
+TMP="$(mktemp -d /tmp/test-upload.XXXXXX)" || exit 1
+DIR="$TMP/dir"
+FAILS=0
+
+trap 'rm -rf "$TMP"' EXIT
+
+part() {
+	printf -- '--%s\r\nContent-Disposition: form-data; name="%s"' \
+		"$BOUNDARY" "$1"
+
+	[ -n "$2" ] && printf '; filename="%s"' "$2"
+
+	printf '\r\n\r\n'
+}
+
+# run <name> <body file> <expected output> [flags...]
+run() {
+	name="$1" body="$2" expect="$3"
+	shift 3
+
+	for io in "" "-n"; do
+		rm -rf "$DIR" && mkdir "$DIR"
+
+		printf 'Testing %-40s ... ' "$name${io:+ ($io)}"
+
+		output="$(CONTENT_TYPE="multipart/form-data; boundary=$BOUNDARY" \
+			CONTENT_LENGTH="$(wc -c < "$body")" \
+			"$UPLOAD" -d "$DIR" $io "$@" < "$body" | tr -d '\r')"
+
+		if [ "$output" != "$expect" ]; then
+			printf 'ERROR: Expected output\n  [%s]\nbut got\n  [%s]\n' \
+				"$expect" "$output"
+			FAILS=$((FAILS + 1))
+		elif ! check; then
+			FAILS=$((FAILS + 1))
+		else
+			echo "OK"
+		fi
+	done
+}
+
+# compare a stored file against its expected content
+stored() {
+	if ! cmp -s "$DIR/$1" "$2"; then
+		printf 'ERROR: Stored file [%s] differs\n' "$1"
+		return 1
+	fi
+}
+
+empty() {
+	if [ -n "$(ls -A "$DIR")" ]; then
+		printf 'ERROR: Found leftover files [%s]\n' "$(ls -A "$DIR")"
+		return 1
+	fi
+}
+
+
+printf 'hello' > "$TMP/hello"
+printf 'world\r\n--not-a-boundary\r\n' > "$TMP/world"
+seq 1 200000 > "$TMP/large"
+
+{
+	part field1
+	printf 'value1\r\n'
+	part field2
+	printf 'line "1"\nline 2\r\n'
+	part file1 "../../etc/passwd"
+	cat "$TMP/hello"
+	printf '\r\n'
+	part file2 'C:\Users\test\world.txt'
+	cat "$TMP/world"
+	printf '\r\n'
+	part file3 "world.txt"
+	cat "$TMP/hello"
+	printf '\r\n'
+	part file4 ".."
+	printf '\r\n--%s--\r\n' "$BOUNDARY"
+} > "$TMP/manifest.body"
+
+check() {
+	stored passwd "$TMP/hello" &&
+	stored world.txt "$TMP/world" &&
+	stored world.txt.1 "$TMP/hello" &&
+	stored upload /dev/null
+}
+
+run manifest-and-sanitizing "$TMP/manifest.body" \
+'{"fields":[{"name":"field1","value":"value1"},'\
+'{"name":"field2","value":"line \"1\"\nline 2"}],"files":['\
+'{"name":"file1","filename":"../../etc/passwd","path":"'"$DIR"'/passwd","size":5},'\
+'{"name":"file2","filename":"C:\\Users\\test\\world.txt","path":"'"$DIR"'/world.txt","size":25},'\
+'{"name":"file3","filename":"world.txt","path":"'"$DIR"'/world.txt.1","size":5},'\
+'{"name":"file4","filename":"..","path":"'"$DIR"'/upload","size":0}]}'
+
+
+{
+	part large "large.txt"
+	cat "$TMP/large"
+	printf '\r\n--%s--\r\n' "$BOUNDARY"
+} > "$TMP/large.body"
+
+check() {
+	stored large.txt "$TMP/large"
+}
+
+run large-file "$TMP/large.body" \
+'{"fields":[],"files":[{"name":"large","filename":"large.txt",'\
+'"path":"'"$DIR"'/large.txt","size":1288895}]}'
+
+
+{
+	part file1 "complete.txt"
+	cat "$TMP/hello"
+	printf '\r\n'
+	part file2 "truncated.txt"
+	cat "$TMP/large"
+} > "$TMP/truncated.body"
+
+check() {
+	empty
+}
+
+run truncated-body-removes-files "$TMP/truncated.body" \
+'{"error":"At reading part data, byte offset 1289091, the body is truncated '\
+'at the declared length of 1289091 bytes"}'
+
+
+{
+	part file1 "complete.txt"
+	cat "$TMP/hello"
+	printf '\r\n'
+	part field1
+	printf '%02000d' 0
+	printf '\r\n--%s--\r\n' "$BOUNDARY"
+} > "$TMP/limit.body"
+
+check() {
+	empty
+}
+
+run field-limit-removes-files "$TMP/limit.body" \
+'{"error":"At reading part data, byte offset 2171, the value exceeds the '\
+'maximum allow size"}' -s 1024
+
+
+check() {
+	empty
+}
+
+run client-error-status "$TMP/truncated.body" \
+'Status: 400 Bad Request
+Content-Type: application/json
+
+{"error":"At reading part data, byte offset 1289091, the body is truncated '\
+'at the declared length of 1289091 bytes"}' -c
+
+
+check() {
+	true
+}
+
+rmdir "$TMP/missing" 2>/dev/null
+
+for io in "" "-n"; do
+	printf 'Testing %-40s ... ' "server-error-status${io:+ ($io)}"
+
+	output="$(CONTENT_TYPE="multipart/form-data; boundary=$BOUNDARY" \
+		CONTENT_LENGTH=0 "$UPLOAD" -c -d "$TMP/missing" $io < /dev/null |
+		head -n 1 | tr -d '\r')"
+
+	if [ "$output" != "Status: 500 Internal Server Error" ]; then
+		printf 'ERROR: Unexpected status [%s]\n' "$output"
+		FAILS=$((FAILS + 1))
+	else
+		echo "OK"
+	fi
+done
+
+
+if [ $FAILS -gt 0 ]; then
+	printf '\n%d test cases FAILED!\n' $FAILS
+	exit 1
+fi
+
+printf '\nAll test cases OK!\n'